@@ -17,6 +17,7 @@
 #include "attribute.h"
 
 #include <assert.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
@@ -37,13 +38,21 @@ GumboAttribute* gumbo_get_attribute(
   return NULL;
 }
 
+// The node an element is embedded in, so edits can allocate from its arena
+static const GumboNode* element_node(const GumboElement *element)
+{
+  return (const GumboNode *)((const char *)element - offsetof(GumboNode, v));
+}
+
 void gumbo_attribute_set_value(GumboAttribute *attr, const char *value)
 {
+  GumboArena *previous_arena = gumbo_arena_enter(gumbo_arena_of(attr));
   gumbo_free((void *)attr->value);
   attr->value = gumbo_strdup(value);
   attr->original_value = kGumboEmptyString;
   attr->value_start = kGumboEmptySourcePosition;
   attr->value_end = kGumboEmptySourcePosition;
+  gumbo_arena_leave(previous_arena);
 }
 
 void gumbo_destroy_attribute(GumboAttribute* attribute) {
@@ -55,6 +64,7 @@ void gumbo_destroy_attribute(GumboAttribute* attribute) {
 void gumbo_element_set_attribute(
     GumboElement *element, const char *name, const char *value)
 {
+  GumboArena *previous_arena = gumbo_arena_enter(gumbo_arena_of(element_node(element)));
   GumboVector *attributes = &element->attributes;
   GumboAttribute *attr = gumbo_get_attribute(attributes, name);
 
@@ -72,6 +82,7 @@ void gumbo_element_set_attribute(
   }
 
   gumbo_attribute_set_value(attr, value);
+  gumbo_arena_leave(previous_arena);
 }
 
 void gumbo_element_remove_attribute_at(GumboElement *element, unsigned int pos) {
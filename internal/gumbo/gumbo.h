@@ -556,6 +556,14 @@ typedef void* (*GumboAllocatorFunction)(void* userdata, size_t size);
  */
 typedef void (*GumboDeallocatorFunction)(void* userdata, void* ptr);
 
+/**
+ * A region that a parse can allocate its tree and all of its scratch memory
+ * from, see GumboOptions.arena.  Allocation is a pointer bump, frees are
+ * no-ops, and everything is released at once by gumbo_arena_destroy.
+ * An arena must only be used from one thread at a time.
+ */
+typedef struct GumboInternalArena GumboArena;
+
 /**
  * Input struct containing configuration options for the parser.
  * These let you specify alternate memory managers, provide different error
@@ -589,6 +597,15 @@ typedef struct GumboInternalOptions {
    * Default: -1
    */
   int max_errors;
+
+  /**
+   * The arena to allocate the parse from, or NULL to use the global allocator.
+   * A tree parsed into an arena is released by destroying the arena;
+   * gumbo_destroy_output is then a no-op for it.  Attributes and nodes added
+   * to such a tree with the editing functions also come from its arena.
+   * Default: NULL.
+   */
+  GumboArena* arena;
 } GumboOptions;
 
 /** Default options struct; use this with gumbo_parse_with_options. */
@@ -645,6 +662,15 @@ GumboOutput* gumbo_parse_fragment(
 /** Release the memory used for the parse tree & parse errors. */
 void gumbo_destroy_output(GumboOutput* output);
 
+/**
+ * Create an arena that grows in chunks of at least chunk_size bytes
+ * (0 picks a default suited to a typical xhtml document).
+ */
+GumboArena* gumbo_arena_create(size_t chunk_size);
+
+/** Release an arena and every tree that was parsed into it. */
+void gumbo_arena_destroy(GumboArena* arena);
+
 /** Allocate a new freestanding node */
 GumboNode *gumbo_create_node(GumboNodeType type);
 
@@ -144,7 +144,9 @@ void gumbo_append_node(GumboNode* parent, GumboNode* node) {
   }
   node->parent = parent;
   node->index_within_parent = children->length;
+  GumboArena* previous_arena = gumbo_arena_enter(gumbo_arena_of(parent));
   gumbo_vector_add((void*) node, children);
+  gumbo_arena_leave(previous_arena);
   assert(node->index_within_parent < children->length);
 }
 
@@ -171,7 +173,9 @@ void gumbo_insert_node(GumboNode* node, GumboNode* target_parent, int target_ind
     assert(index < children->length);
     node->parent = parent;
     node->index_within_parent = index;
+    GumboArena* previous_arena = gumbo_arena_enter(gumbo_arena_of(parent));
     gumbo_vector_insert_at((void*) node, index, children);
+    gumbo_arena_leave(previous_arena);
     assert(node->index_within_parent < children->length);
     for (int i = index + 1; i < children->length; ++i) {
       GumboNode* sibling = children->data[i];
@@ -212,6 +216,7 @@ void gumbo_remove_from_parent(GumboNode* node) {
 // values are fresh copies.
 GumboNode* clone_element_node(const GumboNode* node) {
   assert(node->type == GUMBO_NODE_ELEMENT || node->type == GUMBO_NODE_TEMPLATE);
+  GumboArena* previous_arena = gumbo_arena_enter(gumbo_arena_of(node));
   GumboNode* new_node = gumbo_malloc(sizeof(GumboNode));
   *new_node = *node;
   new_node->parent = NULL;
@@ -228,5 +233,6 @@ GumboNode* clone_element_node(const GumboNode* node) {
     attr->value = gumbo_strdup(old_attr->value);
     gumbo_vector_add(attr, &element->attributes);
   }
+  gumbo_arena_leave(previous_arena);
   return new_node;
 }
@@ -58,6 +58,7 @@ const GumboOptions kGumboDefaultOptions = {
   true,
   false,
   -1,
+  NULL,
 };
 
 static const GumboStringPiece kDoctypeHtml = GUMBO_STRING("html");
@@ -4035,6 +4036,7 @@ GumboOutput* gumbo_parse_fragment(
     const GumboTag fragment_ctx, const GumboNamespaceEnum fragment_namespace) {
   GumboParser parser;
   parser._options = options;
+  GumboArena* previous_arena = gumbo_arena_enter(options->arena);
   parser_state_init(&parser);
   // Must come after parser_state_init, since creating the document node must
   // reference parser_state->_current_node.
@@ -4170,10 +4172,15 @@ GumboOutput* gumbo_parse_fragment(
 
   parser_state_destroy(&parser);
   gumbo_tokenizer_state_destroy(&parser);
+  gumbo_arena_leave(previous_arena);
   return parser._output;
 }
 
 void gumbo_destroy_output(GumboOutput* output) {
+  // trees parsed into an arena go away with their arena
+  if (gumbo_arena_of(output)) {
+    return;
+  }
   free_node(output->document);
   for (int i = 0; i < output->errors.length; ++i) {
     gumbo_error_destroy(output->errors.data[i]);
@@ -48,6 +48,173 @@ void gumbo_memory_set_free(void (*free_p)(void *))
   gumbo_user_free = free_p ? free_p : free;
 }
 
+#if defined(_MSC_VER)
+#define GUMBO_THREAD_LOCAL __declspec(thread)
+#else
+#define GUMBO_THREAD_LOCAL __thread
+#endif
+
+// Keep every block aligned for any type the parser stores in it
+#define GUMBO_ALIGNMENT (2 * sizeof(void *))
+#define GUMBO_ALIGN(n) (((n) + GUMBO_ALIGNMENT - 1) & ~(GUMBO_ALIGNMENT - 1))
+
+#define GUMBO_DEFAULT_ARENA_CHUNK_SIZE (64 * 1024)
+
+typedef struct {
+  GumboArena *arena;
+  size_t size;
+} GumboBlockHeader;
+
+#define GUMBO_HEADER_SIZE GUMBO_ALIGN(sizeof(GumboBlockHeader))
+
+typedef struct GumboInternalArenaChunk {
+  struct GumboInternalArenaChunk *next;
+  char *cursor;
+  char *end;
+} GumboArenaChunk;
+
+#define GUMBO_CHUNK_HEADER_SIZE GUMBO_ALIGN(sizeof(GumboArenaChunk))
+
+struct GumboInternalArena {
+  // the chunk being bump allocated from, followed by all the full ones
+  GumboArenaChunk *chunks;
+  size_t chunk_size;
+};
+
+static GUMBO_THREAD_LOCAL GumboArena *gumbo_current_arena = NULL;
+
+static inline GumboBlockHeader *block_header(const void *ptr)
+{
+  return (GumboBlockHeader *)((char *)ptr - GUMBO_HEADER_SIZE);
+}
+
+static GumboArenaChunk *arena_new_chunk(size_t capacity)
+{
+  GumboArenaChunk *chunk = gumbo_user_allocator(NULL, GUMBO_CHUNK_HEADER_SIZE + capacity);
+  chunk->next = NULL;
+  chunk->cursor = (char *)chunk + GUMBO_CHUNK_HEADER_SIZE;
+  chunk->end = chunk->cursor + capacity;
+  return chunk;
+}
+
+static void *arena_malloc(GumboArena *arena, size_t size)
+{
+  size_t needed = GUMBO_HEADER_SIZE + GUMBO_ALIGN(size);
+  GumboArenaChunk *chunk = arena->chunks;
+  if ((size_t)(chunk->end - chunk->cursor) < needed) {
+    if (needed > arena->chunk_size / 4) {
+      // big blocks get a chunk of their own behind the current one so the
+      // space left in it is not wasted
+      GumboArenaChunk *big = arena_new_chunk(needed);
+      big->next = chunk->next;
+      chunk->next = big;
+      chunk = big;
+    } else {
+      chunk = arena_new_chunk(arena->chunk_size);
+      chunk->next = arena->chunks;
+      arena->chunks = chunk;
+    }
+  }
+  GumboBlockHeader *header = (GumboBlockHeader *)chunk->cursor;
+  chunk->cursor += needed;
+  header->arena = arena;
+  header->size = size;
+  return (char *)header + GUMBO_HEADER_SIZE;
+}
+
+static void *arena_realloc(GumboArena *arena, void *ptr, size_t size)
+{
+  GumboBlockHeader *header = block_header(ptr);
+  if (size <= header->size) {
+    return ptr;
+  }
+  // the most recent block of the current chunk can simply grow in place
+  GumboArenaChunk *chunk = arena->chunks;
+  char *block_end = (char *)ptr + GUMBO_ALIGN(header->size);
+  size_t extra = GUMBO_ALIGN(size) - GUMBO_ALIGN(header->size);
+  if (block_end == chunk->cursor && (size_t)(chunk->end - chunk->cursor) >= extra) {
+    chunk->cursor += extra;
+    header->size = size;
+    return ptr;
+  }
+  void *copy = arena_malloc(arena, size);
+  memcpy(copy, ptr, header->size);
+  return copy;
+}
+
+GumboArena *gumbo_arena_create(size_t chunk_size)
+{
+  GumboArena *arena = gumbo_user_allocator(NULL, sizeof(GumboArena));
+  arena->chunk_size = chunk_size ? GUMBO_ALIGN(chunk_size) : GUMBO_DEFAULT_ARENA_CHUNK_SIZE;
+  arena->chunks = arena_new_chunk(arena->chunk_size);
+  return arena;
+}
+
+void gumbo_arena_destroy(GumboArena *arena)
+{
+  if (!arena) {
+    return;
+  }
+  GumboArenaChunk *chunk = arena->chunks;
+  while (chunk) {
+    GumboArenaChunk *next = chunk->next;
+    gumbo_user_free(chunk);
+    chunk = next;
+  }
+  gumbo_user_free(arena);
+}
+
+GumboArena *gumbo_arena_enter(GumboArena *arena)
+{
+  GumboArena *previous = gumbo_current_arena;
+  gumbo_current_arena = arena;
+  return previous;
+}
+
+void gumbo_arena_leave(GumboArena *previous)
+{
+  gumbo_current_arena = previous;
+}
+
+GumboArena *gumbo_arena_of(const void *ptr)
+{
+  return ptr ? block_header(ptr)->arena : NULL;
+}
+
+void *gumbo_malloc(size_t size)
+{
+  GumboArena *arena = gumbo_current_arena;
+  if (arena) {
+    return arena_malloc(arena, size);
+  }
+  GumboBlockHeader *header = gumbo_user_allocator(NULL, GUMBO_HEADER_SIZE + size);
+  header->arena = NULL;
+  header->size = size;
+  return (char *)header + GUMBO_HEADER_SIZE;
+}
+
+void *gumbo_realloc(void *ptr, size_t size)
+{
+  if (!ptr) {
+    return gumbo_malloc(size);
+  }
+  GumboBlockHeader *header = block_header(ptr);
+  if (header->arena) {
+    return arena_realloc(header->arena, ptr, size);
+  }
+  header = gumbo_user_allocator(header, GUMBO_HEADER_SIZE + size);
+  header->size = size;
+  return (char *)header + GUMBO_HEADER_SIZE;
+}
+
+void gumbo_free(void *ptr)
+{
+  // arena blocks are only ever released with their arena
+  if (ptr && !block_header(ptr)->arena) {
+    gumbo_user_free(block_header(ptr));
+  }
+}
+
 // Debug function to trace operation of the parser.  Pass --copts=-DGUMBO_DEBUG
 // to use.
 void gumbo_debug(const char* format, ...) {
@@ -27,6 +27,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "gumbo.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -34,15 +36,21 @@ extern "C" {
 extern void *(* gumbo_user_allocator)(void *, size_t);
 extern void (* gumbo_user_free)(void *);
 
-static inline void *gumbo_malloc(size_t size)
-{
-  return gumbo_user_allocator(NULL, size);
-}
+// Every block handed out by gumbo_malloc/gumbo_realloc remembers the arena it
+// came from (NULL for blocks from gumbo_user_allocator), so it can always be
+// reallocated or freed correctly no matter which arena is current.
+void *gumbo_malloc(size_t size);
+void *gumbo_realloc(void *ptr, size_t size);
+void gumbo_free(void *ptr);
 
-static inline void *gumbo_realloc(void *ptr, size_t size)
-{
-  return gumbo_user_allocator(ptr, size);
-}
+// The arena new blocks are allocated from is a per thread setting.
+// gumbo_arena_enter makes arena (which may be NULL) the current one for the
+// calling thread and returns the previous one to hand to gumbo_arena_leave.
+GumboArena *gumbo_arena_enter(GumboArena *arena);
+void gumbo_arena_leave(GumboArena *previous);
+
+// The arena a block returned by gumbo_malloc was allocated from, or NULL.
+GumboArena *gumbo_arena_of(const void *ptr);
 
 static inline char *gumbo_strdup(const char *str)
 {
@@ -52,11 +60,6 @@ static inline char *gumbo_strdup(const char *str)
   return copy;
 }
 
-static inline void gumbo_free(void *ptr)
-{
-  gumbo_user_free(ptr);
-}
-
 static inline int gumbo_tolower(int c)
 {
   return c | ((c >= 'A' && c <= 'Z') << 5);
@@ -34,6 +34,8 @@
 #include "Misc/TempFolder.h"
 #include "Misc/Utility.h"
 #include "Misc/HTMLSpellCheck.h"
+#include "ResourceObjects/CSSResource.h"
+#include "ResourceObjects/FontResource.h"
 #include "ResourceObjects/HTMLResource.h"
 #include "ResourceObjects/NCXResource.h"
 #include "ResourceObjects/OPFResource.h"
@@ -134,7 +136,10 @@ const QString HTML_COVER_SOURCE =
 Book::Book()
     :
     m_Mainfolder(new FolderKeeper(this)),
-    m_IsModified(false)
+    m_IsModified(false),
+    m_HasObfuscatedFonts(false),
+    m_ObfuscatedFontsGeneration(-1),
+    m_ObfuscatedFontsRevision(-1)
 {
 }
 
@@ -529,7 +534,7 @@ QHash <QString, QList<XhtmlDoc::XMLElement>> Book::GetLinkElements()
 std::tuple<QString, QList<XhtmlDoc::XMLElement>> Book::GetLinkElementsInHTMLFileMapped(HTMLResource *html_resource)
 {
     return std::make_tuple(html_resource->Filename(),
-                      XhtmlDoc::GetTagsInDocument(html_resource->GetText(), "a"));
+                      html_resource->GetLinkElements());
 }
 
 
@@ -553,7 +558,7 @@ QStringList Book::GetStyleUrlsInHTMLFiles()
 std::tuple<QString, QStringList> Book::GetStyleUrlsInHTMLFileMapped(HTMLResource *html_resource)
 {
     return std::make_tuple(html_resource->Filename(),
-                           XhtmlDoc::GetAllDescendantStyleUrls(html_resource->GetText()));
+                           html_resource->GetStyleUrls());
 }
 
 QHash<QString, QStringList> Book::GetIdsInHTMLFiles()
@@ -576,12 +581,12 @@ QHash<QString, QStringList> Book::GetIdsInHTMLFiles()
 std::tuple<QString, QStringList> Book::GetIdsInHTMLFileMapped(HTMLResource *html_resource)
 {
     return std::make_tuple(html_resource->Filename(),
-                           XhtmlDoc::GetAllDescendantIDs(html_resource->GetText()));
+                           html_resource->GetIds());
 }
 
 QStringList Book::GetIdsInHTMLFile(HTMLResource *html_resource)
 {
-    return XhtmlDoc::GetAllDescendantIDs(html_resource->GetText());
+    return html_resource->GetIds();
 }
 
 
@@ -629,7 +634,7 @@ QHash<QString, QStringList> Book::GetHrefsInHTMLFiles()
 std::tuple<QString, QStringList> Book::GetHrefsInHTMLFileMapped(HTMLResource *html_resource)
 {
     return std::make_tuple(html_resource->Filename(),
-                           XhtmlDoc::GetAllDescendantHrefs(html_resource->GetText()));
+                           html_resource->GetHrefs());
 }
 
 QHash<QString, QStringList> Book::GetClassesInHTMLFiles()
@@ -654,7 +659,7 @@ QHash<QString, QStringList> Book::GetClassesInHTMLFiles()
 std::tuple<QString, QStringList> Book::GetClassesInHTMLFileMapped(HTMLResource *html_resource)
 {
     return std::make_tuple(html_resource->Filename(),
-                           XhtmlDoc::GetAllDescendantClasses(html_resource->GetText()));
+                           html_resource->GetClasses());
 }
 
 QStringList Book::GetClassesInHTMLFile(QString filename)
@@ -662,7 +667,7 @@ QStringList Book::GetClassesInHTMLFile(QString filename)
     QList<HTMLResource *> html_resources = m_Mainfolder->GetResourceTypeList<HTMLResource>(true);
     foreach(HTMLResource *html_resource, html_resources) {
         if (html_resource->Filename() == filename) {
-            return XhtmlDoc::GetAllDescendantClasses(html_resource->GetText());
+            return html_resource->GetClasses();
         }
     }
     return QStringList();
@@ -758,26 +763,75 @@ QHash<QString, QStringList> Book::GetHTMLFilesUsingImages()
 std::tuple<QString, QStringList> Book::GetMediaInHTMLFileMapped(HTMLResource *html_resource)
 {
     return std::make_tuple(html_resource->Filename(),
-                           XhtmlDoc::GetAllMediaPathsFromMediaChildren(html_resource->GetText(), 
-                                                                       GIMAGE_TAGS + GVIDEO_TAGS + GAUDIO_TAGS));
+                           html_resource->GetMediaPaths());
 }
 
 std::tuple<QString, QStringList> Book::GetImagesInHTMLFileMapped(HTMLResource *html_resource)
 {
     return std::make_tuple(html_resource->Filename(),
-                           XhtmlDoc::GetAllMediaPathsFromMediaChildren(html_resource->GetText(), GIMAGE_TAGS));
+                           html_resource->GetImagePaths());
 }
 
 std::tuple<QString, QStringList> Book::GetVideoInHTMLFileMapped(HTMLResource *html_resource)
 {
     return std::make_tuple(html_resource->Filename(),
-                      XhtmlDoc::GetAllMediaPathsFromMediaChildren(html_resource->GetText(), GVIDEO_TAGS));
+                      html_resource->GetVideoPaths());
 }
 
 std::tuple<QString, QStringList> Book::GetAudioInHTMLFileMapped(HTMLResource *html_resource)
 {
     return std::make_tuple(html_resource->Filename(),
-                           XhtmlDoc::GetAllMediaPathsFromMediaChildren(html_resource->GetText(), GAUDIO_TAGS));
+                           html_resource->GetAudioPaths());
+}
+
+QList<Resource *> Book::GetResourcesReferencing(const QStringList &filenames)
+{
+    QList<Resource *> resources;
+    foreach(HTMLResource * html_resource, m_Mainfolder->GetResourceTypeList<HTMLResource>(false)) {
+        resources.append(html_resource);
+    }
+    foreach(CSSResource * css_resource, m_Mainfolder->GetResourceTypeList<CSSResource>(false)) {
+        resources.append(css_resource);
+    }
+    QFuture<bool> future = QtConcurrent::mapped(resources, std::bind(ReferencesAnyFileMapped, std::placeholders::_1, filenames.toSet()));
+    QList<Resource *> referencing;
+
+    for (int i = 0; i < future.results().count(); i++) {
+        if (future.resultAt(i)) {
+            referencing.append(resources.at(i));
+        }
+    }
+
+    return referencing;
+}
+
+bool Book::ReferencesAnyFileMapped(Resource *resource, const QSet<QString> &filenames)
+{
+    QStringList references;
+    HTMLResource *html_resource = qobject_cast<HTMLResource *>(resource);
+
+    if (html_resource) {
+        references = html_resource->GetReferences();
+    } else {
+        CSSResource *css_resource = qobject_cast<CSSResource *>(resource);
+
+        if (css_resource) {
+            references = css_resource->GetReferences();
+        }
+    }
+
+    foreach(QString reference, references) {
+        // Compare just the filename, filenames are unique in the book.
+        reference = reference.left(reference.indexOf('#'));
+        reference = reference.left(reference.indexOf('?'));
+        QString filename = reference.mid(reference.lastIndexOf('/') + 1);
+
+        if (filenames.contains(filename) || filenames.contains(Utility::URLDecodePath(filename))) {
+            return true;
+        }
+    }
+
+    return false;
 }
 
 QList<HTMLResource *> Book::GetNonWellFormedHTMLFiles()
@@ -851,12 +905,12 @@ QHash<QString, QStringList> Book::GetStylesheetsInHTMLFiles()
 std::tuple<QString, QStringList> Book::GetStylesheetsInHTMLFileMapped(HTMLResource *html_resource)
 {
     return std::make_tuple(html_resource->Filename(),
-                      XhtmlDoc::GetLinkedStylesheets(html_resource->GetText()));
+                      html_resource->GetLinkedStylesheets());
 }
 
 QStringList Book::GetStylesheetsInHTMLFile(HTMLResource *html_resource)
 {
-    return XhtmlDoc::GetLinkedStylesheets(html_resource->GetText());
+    return html_resource->GetLinkedStylesheets();
 }
 
 
@@ -874,6 +928,8 @@ Resource *Book::MergeResources(QList<Resource *> resources)
 
     QStringList new_bodies;
     QList<QString> merged_filenames;
+    QStringList merged_unencoded_filenames;
+    QList<HTMLResource *> referencing_html_resources;
     {
         GumboInterface gi = GumboInterface(sink_html_resource->GetText());
         new_bodies << gi.get_body_contents();
@@ -896,6 +952,7 @@ Resource *Book::MergeResources(QList<Resource *> resources)
             GumboInterface ngi = GumboInterface(source_html_resource->GetText());
             new_bodies << ngi.get_body_contents();
             merged_filenames.append(Utility::URLEncodePath(source_resource->Filename()));
+            merged_unencoded_filenames.append(source_resource->Filename());
         }
 
         if (failed_resource != NULL) {
@@ -906,6 +963,15 @@ Resource *Book::MergeResources(QList<Resource *> resources)
         QString new_source = gi.perform_body_updates(new_body);
         // Now all fragments have been merged into this sink document, serialize and store it.
         sink_html_resource->SetText(new_source);
+        // Only the files that link to a merged file need their anchors reconciled.
+        // This has to be worked out before the merged files go away.
+        foreach(Resource *resource, GetResourcesReferencing(merged_unencoded_filenames)) {
+            HTMLResource *html_resource = qobject_cast<HTMLResource *>(resource);
+
+            if (html_resource && !resources.contains(resource) && html_resource != sink_html_resource) {
+                referencing_html_resources.append(html_resource);
+            }
+        }
         // Now safe to do the delete
         foreach(Resource *source_resource, resources) {
             // Need to alert FolderKeeper that these are going away to properly update its
@@ -918,8 +984,8 @@ Resource *Book::MergeResources(QList<Resource *> resources)
     qApp->processEvents(QEventLoop::ExcludeUserInputEvents);
     // It is the user's responsibility to ensure that all ids used across the two merged files are unique.
     // Reconcile all references to the files that were merged.
-    QList<HTMLResource *> html_resources = m_Mainfolder->GetResourceTypeList<HTMLResource>(true);
-    AnchorUpdates::UpdateAllAnchors(html_resources, merged_filenames, sink_html_resource);
+    referencing_html_resources.append(sink_html_resource);
+    AnchorUpdates::UpdateAllAnchors(referencing_html_resources, merged_filenames, sink_html_resource);
     SetModified(true);
     return NULL;
 }
@@ -946,18 +1012,28 @@ bool Book::IsModified() const
 
 bool Book::HasObfuscatedFonts() const
 {
-    QList<FontResource *> font_resources = m_Mainfolder->GetResourceTypeList<FontResource>();
+    // Read before the fonts are looked at, so a change made
+    // while we look leaves the cached answer stale.
+    int generation = m_Mainfolder->GetResourcesGeneration();
+    int revision = FontResource::ObfuscationRevision();
+    QMutexLocker locker(&m_ObfuscatedFontsMutex);
 
-    if (font_resources.empty()) {
-        return false;
+    if ((generation == m_ObfuscatedFontsGeneration) && (revision == m_ObfuscatedFontsRevision)) {
+        return m_HasObfuscatedFonts;
     }
 
+    bool has_obfuscated_fonts = false;
+    QList<FontResource *> font_resources = m_Mainfolder->GetResourceTypeList<FontResource>();
     foreach(FontResource *font_resource, font_resources) {
         if (!font_resource->GetObfuscationAlgorithm().isEmpty()) {
-            return true;
+            has_obfuscated_fonts = true;
+            break;
         }
     }
-    return false;
+    m_HasObfuscatedFonts = has_obfuscated_fonts;
+    m_ObfuscatedFontsGeneration = generation;
+    m_ObfuscatedFontsRevision = revision;
+    return has_obfuscated_fonts;
 }
 
 void Book::ResourceUpdatedFromDisk(Resource *resource)
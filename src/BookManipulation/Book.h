@@ -25,6 +25,7 @@
 #define BOOK_H
 
 #include <QtCore/QHash>
+#include <QtCore/QMutex>
 #include <QtCore/QObject>
 #include <QtCore/QUrl>
 #include <QtCore/QVariant>
@@ -244,6 +245,19 @@ public:
     static std::tuple<QString, QStringList> GetVideoInHTMLFileMapped(HTMLResource *html_resource);
     static std::tuple<QString, QStringList> GetAudioInHTMLFileMapped(HTMLResource *html_resource);
 
+    /**
+     * Returns the HTML and CSS resources that reference any of the
+     * given files through an href, src, url() or @import. Each file's
+     * references are cached until its text changes, so after the first
+     * call only the files edited since are parsed again.
+     *
+     * Used to limit renames and merges to the files they can affect.
+     *
+     * @param filenames The (unencoded) filenames of the referenced files.
+     */
+    QList<Resource *> GetResourcesReferencing(const QStringList &filenames);
+    static bool ReferencesAnyFileMapped(Resource *resource, const QSet<QString> &filenames);
+
     QList<HTMLResource *> GetNonWellFormedHTMLFiles();
 
     QHash<QString, int> CountAllLinksInHTML();
@@ -289,6 +303,8 @@ public:
 
     /**
      * Checks for the presence of obfuscated fonts in the book.
+     * The answer is cached until a resource comes or goes
+     * or a font's obfuscation algorithm changes.
      *
      * @return \c true if the book has obfuscated fonts.
      */
@@ -405,6 +421,15 @@ private:
      */
     bool m_IsModified;
 
+    /**
+     * The cached answer of HasObfuscatedFonts() and the resources
+     * generation and font obfuscation revision it was worked out for.
+     */
+    mutable bool m_HasObfuscatedFonts;
+    mutable int m_ObfuscatedFontsGeneration;
+    mutable int m_ObfuscatedFontsRevision;
+    mutable QMutex m_ObfuscatedFontsMutex;
+
 };
 
 #endif // BOOK_H
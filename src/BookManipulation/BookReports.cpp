@@ -21,8 +21,12 @@
 *************************************************************************/
 
 
+#include <functional>
+
 #include <QtCore/QFile>
 #include <QtCore/QHashIterator>
+#include <QtCore/QPair>
+#include <QtConcurrent/QtConcurrent>
 #include <QtGui/QFont>
 #include <QtWidgets/QMessageBox>
 #include <QtWidgets/QApplication>
@@ -34,18 +38,71 @@
 #include "Misc/CSSInfo.h"
 #include "Misc/SettingsStore.h"
 
+typedef QHash<QString, QSharedPointer<const CSSResource::SelectorIndex>> SelectorIndexes;
+
+static QSharedPointer<const CSSResource::SelectorIndex> GetSelectorIndexMapped(CSSResource *css_resource)
+{
+    return css_resource->GetSelectorIndex();
+}
+
+// Finds the selector each class used in the file matches
+// in the stylesheets the file links to
+static QList<BookReports::StyleData *> GetHTMLClassUsageInFile(const SelectorIndexes *selector_indexes, HTMLResource *html_resource)
+{
+    QList<BookReports::StyleData *> html_classes_usage;
+    QString html_filename = html_resource->Filename();
+    // Get the unique list of classes in this file
+    QStringList classes_in_file = html_resource->GetClasses();
+    classes_in_file.removeDuplicates();
+    // Get the linked stylesheets for this file
+    QStringList linked_stylesheets = html_resource->GetLinkedStylesheets();
+    // Look at each class from the HTML file
+    foreach(QString class_name, classes_in_file) {
+        QString element_part = class_name.split(".").at(0);
+        QString class_part = class_name.split(".").at(1);
+        // Save the details for found or not found classes
+        BookReports::StyleData *class_usage = new BookReports::StyleData();
+        class_usage->html_filename = html_filename;
+        class_usage->html_element_name = element_part;
+        class_usage->html_class_name = class_part;
+        // Look in each stylesheet
+        foreach(QString css_filename, linked_stylesheets) {
+            QSharedPointer<const CSSResource::SelectorIndex> selector_index = selector_indexes->value(css_filename);
+
+            if (!selector_index) {
+                continue;
+            }
+
+            const CSSInfo::CSSSelector *selector = selector_index->Find(element_part, class_part);
+
+            // If class matched a selector in a linked stylesheet, we're done
+            if (selector) {
+                class_usage->css_filename = css_filename;
+                class_usage->css_selector_text = selector->groupText;
+                class_usage->css_selector_position = selector->position;
+                class_usage->css_selector_line = selector->line;
+                break;
+            }
+        }
+        html_classes_usage.append(class_usage);
+    }
+    return html_classes_usage;
+}
+
 QList<BookReports::StyleData *> BookReports::GetHTMLClassUsage(QSharedPointer<Book> book, bool show_progress)
 {
     QList<HTMLResource *> html_resources = book->GetFolderKeeper()->GetResourceTypeList<HTMLResource>(false);
     QList<CSSResource *> css_resources = book->GetFolderKeeper()->GetResourceTypeList<CSSResource>(false);
     QList<BookReports::StyleData *> html_classes_usage;
-    // Save each CSS file's text so we don't have to reload it when checking each HTML file
-    QHash<QString, QString> css_text;
-    foreach(CSSResource * css_resource, css_resources) {
-        QString css_filename = "../" + css_resource->GetRelativePathToOEBPS();
+    // Index each stylesheet once so the classes of every HTML file
+    // can be looked up without parsing the stylesheet again
+    QList<QSharedPointer<const CSSResource::SelectorIndex>> indexes = QtConcurrent::blockingMapped(css_resources, GetSelectorIndexMapped);
+    SelectorIndexes selector_indexes;
+    for (int i = 0; i < css_resources.count(); ++i) {
+        QString css_filename = "../" + css_resources.at(i)->GetRelativePathToOEBPS();
 
-        if (!css_text.contains(css_filename)) {
-            css_text[css_filename] = css_resource->GetText();
+        if (!selector_indexes.contains(css_filename)) {
+            selector_indexes[css_filename] = indexes.at(i);
         }
     }
 
@@ -59,47 +116,16 @@ QList<BookReports::StyleData *> BookReports::GetHTMLClassUsage(QSharedPointer<Bo
     }
 
     // Check each file for classes to look for in inline and linked stylesheets
-    foreach(HTMLResource * html_resource, html_resources) {
+    QFuture<QList<BookReports::StyleData *>> future = QtConcurrent::mapped(html_resources,
+            std::bind(GetHTMLClassUsageInFile, &selector_indexes, std::placeholders::_1));
+    for (int i = 0; i < html_resources.count(); ++i) {
+        // Results are collected in file order as they become available
+        html_classes_usage.append(future.resultAt(i));
+
         if (show_progress) {
             progress.setValue(progress_value++);
             qApp->processEvents();
         }
-
-        QString html_filename = html_resource->Filename();
-        // Get the unique list of classes in this file
-        QStringList classes_in_file = book->GetClassesInHTMLFile(html_filename);
-        classes_in_file.removeDuplicates();
-        // Get the linked stylesheets for this file
-        QStringList linked_stylesheets = book->GetStylesheetsInHTMLFile(html_resource);
-        // Look at each class from the HTML file
-        foreach(QString class_name, classes_in_file) {
-            QString found_location;
-            QString selector_text;
-            QString element_part = class_name.split(".").at(0);
-            QString class_part = class_name.split(".").at(1);
-            // Save the details for found or not found classes
-            BookReports::StyleData *class_usage = new BookReports::StyleData();
-            class_usage->html_filename = html_resource->Filename();
-            class_usage->html_element_name = element_part;
-            class_usage->html_class_name = class_part;
-            // Look in each stylesheet
-            foreach(QString css_filename, linked_stylesheets) {
-                if (css_text.contains(css_filename)) {
-                    CSSInfo css_info(css_text[css_filename], true);
-                    CSSInfo::CSSSelector *selector = css_info.getCSSSelectorForElementClass(element_part, class_part);
-
-                    // If class matched a selector in a linked stylesheet, we're done
-                    if (selector && (selector->classNames.count() > 0)) {
-                        class_usage->css_filename = css_filename;
-                        class_usage->css_selector_text = selector->groupText;
-                        class_usage->css_selector_position = selector->position;
-                        class_usage->css_selector_line = selector->line;
-                        break;
-                    }
-                }
-            }
-            html_classes_usage.append(class_usage);
-        }
     }
     return html_classes_usage;
 }
@@ -108,25 +134,31 @@ QList<BookReports::StyleData *> BookReports::GetCSSSelectorUsage(QSharedPointer<
 {
     QList<CSSResource *> css_resources = book->GetFolderKeeper()->GetResourceTypeList<CSSResource>(false);
     QList<BookReports::StyleData *> css_selectors_usage;
+    // The first HTML file using each selector, by stylesheet and selector position
+    QHash<QPair<QString, int>, QString> selector_html_files;
+    foreach(BookReports::StyleData *html_class, html_classes_usage) {
+        if (html_class->css_filename.isEmpty()) {
+            continue;
+        }
+
+        QPair<QString, int> selector_key(html_class->css_filename, html_class->css_selector_position);
+
+        if (!selector_html_files.contains(selector_key)) {
+            selector_html_files.insert(selector_key, html_class->html_filename);
+        }
+    }
     // Now check the CSS files to see if their classes appear in an HTML file
     foreach(CSSResource *css_resource, css_resources) {
-        QString text = css_resource->GetText();
-        CSSInfo css_info(text, true);
-        QList<CSSInfo::CSSSelector *> selectors = css_info.getClassSelectors();
-        foreach(CSSInfo::CSSSelector * selector, selectors) {
-            QString css_filename = "../" + css_resource->GetRelativePathToOEBPS();
+        QString css_filename = "../" + css_resource->GetRelativePathToOEBPS();
+        QSharedPointer<const CSSResource::SelectorIndex> selector_index = css_resource->GetSelectorIndex();
+        foreach(const CSSInfo::CSSSelector &selector, selector_index->class_selectors) {
             // Save the details for found or not found classes
             BookReports::StyleData *selector_usage = new BookReports::StyleData();
             selector_usage->css_filename = css_filename;
-            selector_usage->css_selector_text = selector->groupText;
-            selector_usage->css_selector_position = selector->position;
-            selector_usage->css_selector_line = selector->line;
-            foreach(BookReports::StyleData *html_class, html_classes_usage) {
-                if (css_filename == html_class->css_filename && selector->position == html_class->css_selector_position) {
-                    selector_usage->html_filename = html_class->html_filename;
-                    break;
-                }
-            }
+            selector_usage->css_selector_text = selector.groupText;
+            selector_usage->css_selector_position = selector.position;
+            selector_usage->css_selector_line = selector.line;
+            selector_usage->html_filename = selector_html_files.value(qMakePair(css_filename, selector.position));
             css_selectors_usage.append(selector_usage);
         }
     }
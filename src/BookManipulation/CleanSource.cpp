@@ -33,8 +33,10 @@
 #include "BookManipulation/CleanSource.h"
 #include "BookManipulation/XhtmlDoc.h"
 #include "Misc/HTMLPrettyPrint.h"
+#include "Misc/XMLPrettyPrint.h"
 #include "Misc/GumboInterface.h"
 #include "Misc/SettingsStore.h"
+#include "SourceUpdates/PerformCSSUpdates.h"
 #include "sigil_constants.h"
 #include "sigil_exception.h"
 #include "Misc/Utility.h"
@@ -47,8 +49,7 @@ static const QString HEAD_END = "</\\s*head\\s*>";
 // of provided book XHTML source code
 QString CleanSource::Clean(const QString &source)
 {
-    SettingsStore settings;
-    SettingsStore::CleanLevel level = settings.cleanLevel();
+    SettingsStore::CleanLevel level = SettingsStore::snapshot().clean_level;
     QString newsource = PreprocessSpecialCases(source);
 
     switch (level) {
@@ -125,11 +126,55 @@ QString CleanSource::PrettyPrint(const QString &source)
     return pp.prettyPrint();
 }
 
+// Well-formed xml is pretty printed natively with the very same layout
+// bs4 would produce, only broken xml still needs the recovering parser
 QString CleanSource::ProcessXML(const QString &source)
 {
+    XMLPrettyPrint pp(source);
+    if (pp.isWellFormed()) {
+        return pp.prettyPrint();
+    }
     return XMLPrettyPrintBS4(source);
 }
 
+QString CleanSource::CleanAndUpdateOnLoad(const QString &source,
+                                          const QHash<QString, QString> &html_updates,
+                                          const QHash<QString, QString> &css_updates,
+                                          const QString &currentpath,
+                                          bool clean)
+{
+    if (source.isEmpty()) {
+        return QString();
+    }
+    SettingsStore::CleanLevel level = clean ? SettingsStore::snapshot().clean_level : SettingsStore::CleanLevel_Off;
+    QString newsource = clean ? PreprocessSpecialCases(source) : source;
+    GumboInterface gi = GumboInterface(newsource);
+
+    // A tree parsed with an added doctype can differ from the one the
+    // cleaners would build, so leave those files to the multi-pass route.
+    if (!gi.error_check().isEmpty() || gi.error_check_added_doctype()) {
+        return QString();
+    }
+
+    if (level == SettingsStore::CleanLevel_PrettyPrintGumbo) {
+        newsource = gi.prettyprint_source_updates(html_updates, currentpath);
+    } else {
+        newsource = gi.perform_source_updates(html_updates, currentpath);
+    }
+    if (!css_updates.isEmpty()) {
+        newsource = PerformCSSUpdates(newsource, css_updates)();
+    }
+    newsource = CharToEntity(newsource);
+
+    if (level == SettingsStore::CleanLevel_PrettyPrint) {
+        newsource = PrettyPrint(newsource);
+    }
+    if (clean) {
+        newsource = PrettifyDOCTYPEHeader(newsource);
+    }
+    return newsource;
+}
+
 QString CleanSource::RemoveMetaCharset(const QString &source)
 {
     int head_end = source.indexOf(QRegularExpression(HEAD_END));
@@ -216,9 +261,8 @@ QString CleanSource::PrettifyDOCTYPEHeader(const QString &source)
 
 QString CleanSource::CharToEntity(const QString &source)
 {
-    SettingsStore settings;
     QString new_source = source;
-    QList<std::pair <ushort, QString>> codenames = settings.preserveEntityCodeNames();
+    const QList<std::pair <ushort, QString>> &codenames = SettingsStore::snapshot().preserve_entity_code_names;
     std::pair <ushort, QString> epair;
     foreach(epair, codenames) {
         new_source.replace(QChar(epair.first), epair.second);
@@ -24,6 +24,7 @@
 #ifndef CLEANSOURCE_H
 #define CLEANSOURCE_H
 
+#include <QtCore/QHash>
 #include <QtCore/QList>
 
 #include "ResourceObjects/HTMLResource.h"
@@ -43,6 +44,17 @@ public:
 
     static QString ProcessXML(const QString &source);
 
+    // Single parse version of the load sequence Clean, IsDataWellFormed,
+    // PerformHTMLUpdates, Clean for a book file. The gumbo tree built
+    // for the well-formed check is reused for the updates and the final
+    // serialization. Returns an empty string when the source is not
+    // well-formed and needs to go through the multi-pass route instead.
+    static QString CleanAndUpdateOnLoad(const QString &source,
+                                        const QHash<QString, QString> &html_updates,
+                                        const QHash<QString, QString> &css_updates,
+                                        const QString &currentpath,
+                                        bool clean);
+
     static QString CleanGumbo(const QString &source);
 
     static QString PrettyPrintGumbo(const QString &source);
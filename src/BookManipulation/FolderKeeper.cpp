@@ -25,6 +25,7 @@
 #include <QtCore/QString>
 #include <QtCore/QThread>
 #include <QtCore/QTime>
+#include <QtCore/QVector>
 #include <QtWidgets/QApplication>
 #include <QRegularExpression>
 #include <QRegularExpressionMatch>
@@ -78,6 +79,24 @@ const QStringList STYLE_MIMETYPES = QStringList() << "text/css";
 const QStringList AUDIO_MIMETYPES = QStringList() << "audio/mpeg" << "audio/mp4" << "audio/ogg";
 const QStringList VIDEO_MIMETYPES = QStringList() << "video/mp4" << "video/mp4" << "video/mp4" << "video/ogg" << "video/webm";
 
+// Splits a filename the way GetUniqueFilenameVersion() numbers it.
+// For "Section0001.xhtml" the key is "Section/xhtml" ('/' can't be part
+// of a filename) and the number suffix is "0001".
+static QString FilenameSuffixKey(const QString &filename, QString &number_suffix)
+{
+    QFileInfo info(filename);
+    QString base_name = info.baseName();
+    int prefix_length = base_name.length();
+
+    while (prefix_length > 0 && base_name.at(prefix_length - 1) >= '0' && base_name.at(prefix_length - 1) <= '9') {
+        prefix_length--;
+    }
+
+    number_suffix = base_name.mid(prefix_length);
+    return base_name.left(prefix_length) + "/" + info.completeSuffix();
+}
+
+
 static const QString CONTAINER_XML = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
                                      "<container version=\"1.0\" xmlns=\"urn:oasis:names:tc:opendocument:xmlns:container\">\n"
                                      "    <rootfiles>\n"
@@ -91,6 +110,10 @@ FolderKeeper::FolderKeeper(QObject *parent)
     QObject(parent),
     m_OPF(NULL),
     m_NCX(NULL),
+    m_HTMLResourceCount(0),
+    m_SpineOrderOPFRevision(-1),
+    m_SpineOrderValid(false),
+    m_ResourcesGeneration(0),
     m_FSWatcher(new QFileSystemWatcher()),
     m_FullPathToMainFolder(m_TempFolder.GetPath())
 {
@@ -126,6 +149,25 @@ Resource *FolderKeeper::AddContentFileToFolder(const QString &fullfilepath, bool
         throw(FileDoesNotExist(fullfilepath.toStdString()));
     }
 
+    Resource *resource = CreateResource(fullfilepath, mimetype);
+    QFile::copy(fullfilepath, resource->GetFullPath());
+
+    if (update_opf) {
+        emit ResourceAdded(resource);
+    }
+
+    return resource;
+}
+
+
+Resource *FolderKeeper::AddContentFileWithoutCopy(const QString &fullfilepath, const QString &mimetype)
+{
+    return CreateResource(fullfilepath, mimetype);
+}
+
+
+Resource *FolderKeeper::CreateResource(const QString &fullfilepath, const QString &mimetype)
+{
     QString new_file_path;
     QString normalised_file_path = fullfilepath;
     Resource *resource = NULL;
@@ -188,8 +230,14 @@ Resource *FolderKeeper::AddContentFileToFolder(const QString &fullfilepath, bool
         }
 
         m_Resources[ resource->GetIdentifier() ] = resource;
+        RegisterFilename(resource->Filename(), resource);
+
+        if (resource->Type() == Resource::HTMLResourceType) {
+            m_HTMLResourceCount++;
+        }
+
+        InvalidateResourceViews();
     }
-    QFile::copy(fullfilepath, new_file_path);
 
     if (QThread::currentThread() != QApplication::instance()->thread()) {
         resource->moveToThread(QApplication::instance()->thread());
@@ -199,60 +247,44 @@ Resource *FolderKeeper::AddContentFileToFolder(const QString &fullfilepath, bool
             this,     SLOT(RemoveResource(const Resource *)), Qt::DirectConnection);
     connect(resource, SIGNAL(Renamed(const Resource *, QString)),
             this,     SLOT(ResourceRenamed(const Resource *, QString)), Qt::DirectConnection);
-
-    if (update_opf) {
-        emit ResourceAdded(resource);
-    }
-
     return resource;
 }
 
 
 int FolderKeeper::GetHighestReadingOrder() const
 {
-    int count_of_html_resources = 0;
-    foreach(Resource * resource, m_Resources.values()) {
-        if (resource->Type() == Resource::HTMLResourceType) {
-            ++count_of_html_resources;
-        }
-    }
-    return count_of_html_resources - 1;
+    return m_HTMLResourceCount - 1;
 }
 
 
-QString FolderKeeper::GetUniqueFilenameVersion(const QString &filename) const
+int FolderKeeper::GetResourcesGeneration() const
 {
-    const QStringList &filenames = GetAllFilenames();
+    QMutexLocker locker(&m_AccessMutex);
+    return m_ResourcesGeneration;
+}
+
 
-    if (!filenames.contains(filename)) {
+QString FolderKeeper::GetUniqueFilenameVersion(const QString &filename) const
+{
+    if (!m_ResourcesByFilename.contains(filename)) {
         return filename;
     }
 
     // name_prefix is part of the name without the number suffix.
     // So for "Section0001.xhtml", it is "Section"
-    QString name_prefix = QFileInfo(filename).baseName().remove(QRegularExpression("\\d+$"));
+    QString number_suffix;
+    QString key = FilenameSuffixKey(filename, number_suffix);
+    QString name_prefix = QFileInfo(filename).baseName();
+    name_prefix.chop(number_suffix.length());
     QString extension   = QFileInfo(filename).completeSuffix();
-    // Used to search for the filename number suffixes.
-    QString search_string = QRegularExpression::escape(name_prefix).prepend("^") +
-                            "(\\d*)" +
-                            (!extension.isEmpty() ? ("\\." + QRegularExpression::escape(extension)) : QString()) +
-                            "$";
-    QRegularExpression filename_search(search_string);
+    // The highest number suffix used with this prefix and extension.
     int max_num_length = -1;
     int max_num = -1;
-    foreach(QString existing_file, filenames) {
-        QRegularExpressionMatch match = filename_search.match(existing_file);
-        if (!match.hasMatch()) {
-            continue;
-        }
-
-        bool conversion_successful = false;
-        int number_suffix = match.captured(1).toInt(&conversion_successful);
+    QHash<QString, QMultiMap<int, int> >::const_iterator suffixes = m_FilenameSuffixes.constFind(key);
 
-        if (conversion_successful && number_suffix > max_num) {
-            max_num = number_suffix;
-            max_num_length = match.capturedLength(1);
-        }
+    if (suffixes != m_FilenameSuffixes.constEnd() && !suffixes.value().isEmpty()) {
+        max_num = suffixes.value().lastKey();
+        max_num_length = suffixes.value().value(max_num);
     }
 
     if (max_num == -1) {
@@ -304,12 +336,13 @@ Resource *FolderKeeper::GetResourceByIdentifier(const QString &identifier) const
 
 Resource *FolderKeeper::GetResourceByFilename(const QString &filename) const
 {
-    foreach(Resource *resource, m_Resources.values()) {
-        if (resource->Filename() == filename) {
-            return resource;
-        }
+    Resource *resource = m_ResourcesByFilename.value(filename);
+
+    if (!resource) {
+        throw(ResourceDoesNotExist(filename.toStdString()));
     }
-    throw(ResourceDoesNotExist(filename.toStdString()));
+
+    return resource;
 }
 
 
@@ -361,17 +394,23 @@ QString FolderKeeper::GetFullPathToVideoFolder() const
 
 QStringList FolderKeeper::GetAllFilenames() const
 {
-    QStringList filelist;
-    foreach(Resource *resource, m_Resources.values()) {
-        filelist.append(resource->Filename());
-    }
-    return filelist;
+    return m_ResourcesByFilename.keys();
 }
 
 
 void FolderKeeper::RemoveResource(const Resource *resource)
 {
-    m_Resources.remove(resource->GetIdentifier());
+    {
+        QMutexLocker locker(&m_AccessMutex);
+        m_Resources.remove(resource->GetIdentifier());
+        UnregisterFilename(resource->Filename(), resource);
+
+        if (resource->Type() == Resource::HTMLResourceType) {
+            m_HTMLResourceCount--;
+        }
+
+        InvalidateResourceViews();
+    }
 
     if (m_FSWatcher->files().contains(resource->GetFullPath())) {
         m_FSWatcher->removePath(resource->GetFullPath());
@@ -383,9 +422,145 @@ void FolderKeeper::RemoveResource(const Resource *resource)
 
 void FolderKeeper::ResourceRenamed(const Resource *resource, const QString &old_full_path)
 {
+    {
+        QMutexLocker locker(&m_AccessMutex);
+        UnregisterFilename(QFileInfo(old_full_path).fileName(), resource);
+        RegisterFilename(resource->Filename(), resource);
+        // The spine order is looked up by filename.
+        m_SpineOrderValid = false;
+        m_ResourcesGeneration++;
+    }
     m_OPF->ResourceRenamed(resource, old_full_path);
 }
 
+QList<Resource *> FolderKeeper::GetResourcesOfClass(const QMetaObject *meta_object) const
+{
+    QMutexLocker locker(&m_AccessMutex);
+    QHash<const QMetaObject *, QList<Resource *> >::const_iterator cached = m_ResourcesByClass.constFind(meta_object);
+
+    if (cached != m_ResourcesByClass.constEnd()) {
+        return cached.value();
+    }
+
+    QList<Resource *> resources;
+    foreach(Resource *resource, m_Resources.values()) {
+        if (meta_object->cast(resource)) {
+            resources.append(resource);
+        }
+    }
+    m_ResourcesByClass.insert(meta_object, resources);
+    return resources;
+}
+
+QList<HTMLResource *> FolderKeeper::GetSpineOrderedHTMLResources() const
+{
+    int opf_revision = m_OPF->GetTextRevision();
+    int generation = 0;
+    {
+        QMutexLocker locker(&m_AccessMutex);
+
+        if (m_SpineOrderValid && (m_SpineOrderOPFRevision == opf_revision)) {
+            return m_SpineOrderedHTML;
+        }
+
+        generation = m_ResourcesGeneration;
+    }
+
+    // The OPF is read without holding our lock since
+    // OPF code calls into the FolderKeeper too.
+    QList<HTMLResource *> sorted_htmls = SortHTMLResourcesBySpine(GetResourceTypeList<HTMLResource>(false));
+    QMutexLocker locker(&m_AccessMutex);
+
+    // Only keep the list if no resource came or went in the meantime.
+    if (generation == m_ResourcesGeneration) {
+        m_SpineOrderedHTML = sorted_htmls;
+        m_SpineOrderOPFRevision = opf_revision;
+        m_SpineOrderValid = true;
+    }
+
+    return sorted_htmls;
+}
+
+QList<HTMLResource *> FolderKeeper::SortHTMLResourcesBySpine(const QList<HTMLResource *> &resource_list) const
+{
+    QStringList spine_order_filenames = GetOPF()->GetSpineOrderFilenames();
+    QHash<QString, int> spine_positions;
+
+    // Filenames are unique in the book so every resource goes straight
+    // to its place. If a file is in the spine twice, the first one counts.
+    for (int i = spine_order_filenames.count() - 1; i >= 0; --i) {
+        spine_positions[ spine_order_filenames.at(i) ] = i;
+    }
+
+    QVector<HTMLResource *> in_spine(spine_order_filenames.count(), NULL);
+    QList<HTMLResource *> not_in_spine;
+    foreach(HTMLResource *html_resource, resource_list) {
+        int position = spine_positions.value(html_resource->Filename(), -1);
+
+        if ((position != -1) && !in_spine.at(position)) {
+            in_spine[ position ] = html_resource;
+        } else {
+            not_in_spine.append(html_resource);
+        }
+    }
+    QList<HTMLResource *> sorted_htmls;
+    foreach(HTMLResource *html_resource, in_spine) {
+        if (html_resource) {
+            sorted_htmls.append(html_resource);
+        }
+    }
+    // It's possible that there are certain HTML files in the
+    // given resource list that are not in the spine filenames,
+    // for several reasons. So we make sure we add them to the end
+    // of the sorted list.
+    sorted_htmls.append(not_in_spine);
+    return sorted_htmls;
+}
+
+void FolderKeeper::InvalidateResourceViews()
+{
+    m_ResourcesByClass.clear();
+    m_SpineOrderValid = false;
+    m_ResourcesGeneration++;
+}
+
+void FolderKeeper::RegisterFilename(const QString &filename, const Resource *resource)
+{
+    m_ResourcesByFilename.insert(filename, const_cast<Resource *>(resource));
+    QString number_suffix;
+    QString key = FilenameSuffixKey(filename, number_suffix);
+    bool conversion_successful = false;
+    int number = number_suffix.toInt(&conversion_successful);
+
+    if (conversion_successful) {
+        m_FilenameSuffixes[ key ].insert(number, number_suffix.length());
+    }
+}
+
+void FolderKeeper::UnregisterFilename(const QString &filename, const Resource *resource)
+{
+    m_ResourcesByFilename.remove(filename, const_cast<Resource *>(resource));
+    QString number_suffix;
+    QString key = FilenameSuffixKey(filename, number_suffix);
+    bool conversion_successful = false;
+    int number = number_suffix.toInt(&conversion_successful);
+
+    if (!conversion_successful || !m_FilenameSuffixes.contains(key)) {
+        return;
+    }
+
+    QMultiMap<int, int> &suffixes = m_FilenameSuffixes[ key ];
+    QMultiMap<int, int>::iterator suffix = suffixes.find(number, number_suffix.length());
+
+    if (suffix != suffixes.end()) {
+        suffixes.erase(suffix);
+    }
+
+    if (suffixes.isEmpty()) {
+        m_FilenameSuffixes.remove(key);
+    }
+}
+
 void FolderKeeper::ResourceFileChanged(const QString &path) const
 {
     // The file may have been deleted prior to writing a new version - give it a chance to write.
@@ -487,6 +662,9 @@ void FolderKeeper::CreateInfrastructureFiles()
     m_NCX->SetMainID(m_OPF->GetMainIdentifierValue());
     m_Resources[ m_OPF->GetIdentifier() ] = m_OPF;
     m_Resources[ m_NCX->GetIdentifier() ] = m_NCX;
+    RegisterFilename(m_OPF->Filename(), m_OPF);
+    RegisterFilename(m_NCX->Filename(), m_NCX);
+    InvalidateResourceViews();
     // TODO: change from Resource* to const Resource&
     connect(m_OPF, SIGNAL(Deleted(const Resource *)), this, SLOT(RemoveResource(const Resource *)));
     connect(m_NCX, SIGNAL(Deleted(const Resource *)), this, SLOT(RemoveResource(const Resource *)));
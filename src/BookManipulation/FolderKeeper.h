@@ -27,6 +27,8 @@
 #include <QtCore/QString>
 #include <QtCore/QHash>
 #include <QtCore/QList>
+#include <QtCore/QMap>
+#include <QtCore/QMultiHash>
 #include <QtCore/QMutex>
 #include <QFileSystemWatcher>
 
@@ -87,6 +89,20 @@ public:
                                      bool update_opf = true,
                                      const QString &mimetype = QString());
 
+    /**
+     * Creates the Resource for a content file the same way
+     * AddContentFileToFolder() does, but does not copy the file.
+     * The caller writes the data to the resource's full path itself
+     * (e.g. straight out of the EPUB archive). The OPF is not notified.
+     *
+     * @param fullfilepath The path the file would be added from, only
+     *                     the name and extension are used.
+     * @param mimetype The mimetype for the associated file.
+     * @return The newly created resource.
+     */
+    Resource *AddContentFileWithoutCopy(const QString &fullfilepath,
+                                        const QString &mimetype = QString());
+
     /**
      * Returns the highest reading order number present in the book.
      *
@@ -94,6 +110,15 @@ public:
      */
     int GetHighestReadingOrder() const;
 
+    /**
+     * Returns a number that changes every time a resource
+     * is added, removed or renamed, so callers can tell
+     * when something they worked out from the resources is stale.
+     *
+     * @return The current resources generation.
+     */
+    int GetResourcesGeneration() const;
+
     /**
      * Returns a book-wide unique filename. Given a filename,
      * if a file with the same name already exists, a number suffix
@@ -156,9 +181,7 @@ public:
     /**
      * Returns the resource with the given filename.
      * @note NOTE THAT RESOURCE FILENAMES CAN CHANGE,
-     *       while identifiers don't. Also, retrieving
-     *       resources by identifier is O(1), this is O(n)
-     *       (and a \b very slow O(n) since we query the filesystem).
+     *       while identifiers don't. This is a hash lookup too.
      * @throws ResourceDoesNotExist if the filename is not found.
      *
      * @param filename The filename to search for.
@@ -281,6 +304,16 @@ private:
      */
     void CreateInfrastructureFiles();
 
+    /**
+     * Picks the folder and a unique filename for a content file,
+     * creates the matching Resource object and registers it.
+     *
+     * @param fullfilepath The full path to the file being added.
+     * @param mimetype The mimetype for the associated file.
+     * @return The newly created resource.
+     */
+    Resource *CreateResource(const QString &fullfilepath, const QString &mimetype);
+
     /**
      * Dereferences two pointers and compares the values with "<".
      *
@@ -291,9 +324,54 @@ private:
     template<typename T>
     static bool PointerLessThan(T *first_item, T *second_item);
 
+    /**
+     * Adds a filename to m_ResourcesByFilename and m_FilenameSuffixes.
+     * The caller must hold m_AccessMutex.
+     */
+    void RegisterFilename(const QString &filename, const Resource *resource);
+
+    /**
+     * Removes a filename from m_ResourcesByFilename and m_FilenameSuffixes.
+     * The caller must hold m_AccessMutex.
+     */
+    void UnregisterFilename(const QString &filename, const Resource *resource);
+
     template<typename T>
     QList<T *> ListResourceSort(const QList<T *> &resource_list) const;
 
+    /**
+     * Returns the resources that are (or inherit) the given class.
+     * The lists are built on demand and cached until a resource
+     * is added or removed.
+     *
+     * @param meta_object The static meta object of the class.
+     * @return The resource list.
+     */
+    QList<Resource *> GetResourcesOfClass(const QMetaObject *meta_object) const;
+
+    /**
+     * Returns all the HTML resources in spine order. The list is cached
+     * until an HTML resource is added, removed or renamed, or the OPF changes.
+     *
+     * @return The sorted resource list.
+     */
+    QList<HTMLResource *> GetSpineOrderedHTMLResources() const;
+
+    /**
+     * Sorts HTML resources in spine order. Resources that are
+     * not in the spine are added to the end.
+     *
+     * @param resource_list The resources to sort.
+     * @return The sorted resource list.
+     */
+    QList<HTMLResource *> SortHTMLResourcesBySpine(const QList<HTMLResource *> &resource_list) const;
+
+    /**
+     * Drops the cached resource lists.
+     * The caller must hold m_AccessMutex.
+     */
+    void InvalidateResourceViews();
+
 
     ///////////////////////////////
     // PRIVATE MEMBER VARIABLES
@@ -319,9 +397,45 @@ private:
     QHash<QString, Resource *> m_Resources;
 
     /**
-     * Ensures thread-safe access to the m_Resources hash.
+     * The resources keyed by their filenames.
+     */
+    QMultiHash<QString, Resource *> m_ResourcesByFilename;
+
+    /**
+     * The number suffixes in use for every filename prefix and extension,
+     * so GetUniqueFilenameVersion() doesn't have to look at all the filenames.
+     * The keys are "prefix/extension", the values map each number
+     * suffix to the count of its digits.
+     */
+    QHash<QString, QMultiMap<int, int> > m_FilenameSuffixes;
+
+    /**
+     * The number of HTML resources. @see GetHighestReadingOrder().
+     */
+    int m_HTMLResourceCount;
+
+    /**
+     * The cached resource lists by class. @see GetResourcesOfClass().
+     */
+    mutable QHash<const QMetaObject *, QList<Resource *> > m_ResourcesByClass;
+
+    /**
+     * The cached spine order. @see GetSpineOrderedHTMLResources().
+     */
+    mutable QList<HTMLResource *> m_SpineOrderedHTML;
+    mutable int m_SpineOrderOPFRevision;
+    mutable bool m_SpineOrderValid;
+
+    /**
+     * Bumped every time the cached resource lists are dropped.
+     */
+    int m_ResourcesGeneration;
+
+    /**
+     * Ensures thread-safe access to the m_Resources hash,
+     * the filename registry and the cached resource lists.
      */
-    QMutex m_AccessMutex;
+    mutable QMutex m_AccessMutex;
 
     /**
      * The main temp folder where files are stored.
@@ -353,12 +467,8 @@ template<class T>
 QList<T *> FolderKeeper::GetResourceTypeList(bool should_be_sorted) const
 {
     QList<T *> onetype_resources;
-    foreach(Resource * resource, m_Resources.values()) {
-        T *type_resource = qobject_cast<T *>(resource);
-
-        if (type_resource) {
-            onetype_resources.append(type_resource);
-        }
+    foreach(Resource * resource, GetResourcesOfClass(&T::staticMetaObject)) {
+        onetype_resources.append(static_cast<T *>(resource));
     }
 
     if (should_be_sorted) {
@@ -368,17 +478,25 @@ QList<T *> FolderKeeper::GetResourceTypeList(bool should_be_sorted) const
     return onetype_resources;
 }
 
-template<class T>
-QList<Resource *> FolderKeeper::GetResourceTypeAsGenericList(bool should_be_sorted) const
+// The spine order is cached, @see GetSpineOrderedHTMLResources().
+template<> inline
+QList<HTMLResource *> FolderKeeper::GetResourceTypeList<HTMLResource>(bool should_be_sorted) const
 {
-    QList<Resource *> resources;
-    foreach(Resource * resource, m_Resources.values()) {
-        T *type_resource = qobject_cast<T *>(resource);
+    if (should_be_sorted) {
+        return GetSpineOrderedHTMLResources();
+    }
 
-        if (type_resource) {
-            resources.append(resource);
-        }
+    QList<HTMLResource *> html_resources;
+    foreach(Resource * resource, GetResourcesOfClass(&HTMLResource::staticMetaObject)) {
+        html_resources.append(static_cast<HTMLResource *>(resource));
     }
+    return html_resources;
+}
+
+template<class T>
+QList<Resource *> FolderKeeper::GetResourceTypeAsGenericList(bool should_be_sorted) const
+{
+    QList<Resource *> resources = GetResourcesOfClass(&T::staticMetaObject);
 
     if (should_be_sorted) {
         resources = ListResourceSort(resources);
@@ -402,23 +520,7 @@ QList<T *> FolderKeeper::ListResourceSort(const QList<T *> &resource_list)  cons
 template<> inline
 QList<HTMLResource *> FolderKeeper::ListResourceSort<HTMLResource>(const QList<HTMLResource *> &resource_list) const
 {
-    QStringList spine_order_filenames = GetOPF()->GetSpineOrderFilenames();
-    QList<HTMLResource *> htmls = resource_list;
-    QList<HTMLResource *> sorted_htmls;
-    foreach(const QString & spine_filename, spine_order_filenames) {
-        for (int i = 0; i < htmls.count(); ++i) {
-            if (spine_filename == htmls[ i ]->Filename()) {
-                sorted_htmls.append(htmls.takeAt(i));
-                break;
-            }
-        }
-    }
-    // It's possible that there are certain HTML files in the
-    // given resource list that are not in the spine filenames,
-    // for several reasons. So we make sure we add them to the end
-    // of the sorted list.
-    sorted_htmls.append(htmls);
-    return sorted_htmls;
+    return SortHTMLResourcesBySpine(resource_list);
 }
 
 
@@ -35,36 +35,73 @@
 #include "MiscEditors/IndexEditorModel.h"
 #include "BookManipulation/Index.h"
 #include "MiscEditors/IndexEntries.h"
+#include "Misc/PatternSet.h"
 #include "sigil_constants.h"
 
 const QString SIGIL_INDEX_CLASS = "sigil_index_marker";
 const QString SIGIL_INDEX_ID_PREFIX = "sigil_index_id_";
 
+static QString IndexText(const QString &pattern, const QString &index_entry)
+{
+    if (index_entry.isEmpty()) {
+        // If no index text, use the pattern
+        return pattern;
+    } else if (index_entry.endsWith("/")) {
+        // If index text is a category then append the pattern
+        return index_entry + pattern;
+    }
+
+    // Use the given index text
+    return index_entry;
+}
+
 bool Index::BuildIndex(QList<HTMLResource *> html_resources)
 {
     IndexEntries::instance()->Clear();
+    // Compile the Index Editor patterns once for the whole book
+    QList<IndexEditorModel::indexEntry *> entries = IndexEditorModel::instance()->GetEntries();
+    QStringList patterns;
+    QStringList index_texts;
+    foreach(IndexEditorModel::indexEntry * entry, entries) {
+        patterns.append(entry->pattern);
+        index_texts.append(IndexText(entry->pattern, entry->index_entry));
+    }
+    qDeleteAll(entries);
+    const PatternSet pattern_set(patterns);
     // Display progress dialog
     QProgressDialog progress(QObject::tr("Creating Index..."), QObject::tr("Cancel"), 0, html_resources.count(), QApplication::activeWindow());
     progress.setMinimumDuration(0);
     int progress_value = 0;
     progress.setValue(progress_value);
     qApp->processEvents();
-    // Must do sequentially in order to keep sections in order
-    foreach(HTMLResource * html_resource, html_resources) {
+    QFuture<QList<std::pair<QString, QString>>> future = QtConcurrent::mapped(html_resources,
+            std::bind(AddIndexIDsOneFile, std::placeholders::_1, &pattern_set, &index_texts));
+    // Files are indexed in parallel but their entries must be added
+    // sequentially in order to keep sections in order
+    for (int i = 0; i < html_resources.count(); ++i) {
         // Set progress value and ensure dialog has time to display when doing extensive updates
         if (progress.wasCanceled()) {
+            future.cancel();
+            future.waitForFinished();
             return false;
         }
 
+        const QString filename = html_resources.at(i)->Filename();
+        const QList<std::pair<QString, QString>> index_entries = future.resultAt(i);
+
+        for (int j = 0; j < index_entries.count(); ++j) {
+            IndexEntries::instance()->AddOneEntry(index_entries.at(j).first, filename, index_entries.at(j).second);
+        }
+
         progress.setValue(progress_value++);
         qApp->processEvents();
-        AddIndexIDsOneFile(html_resource);
     }
     return true;
 }
 
-void Index::AddIndexIDsOneFile(HTMLResource *html_resource)
+QList<std::pair<QString, QString>> Index::AddIndexIDsOneFile(HTMLResource *html_resource, const PatternSet *patterns, const QStringList *index_texts)
 {
+    QList<std::pair<QString, QString>> index_entries;
     QWriteLocker locker(&html_resource->GetLock());
     QString source = html_resource->GetText();
     GumboInterface gi = GumboInterface(source);
@@ -114,11 +151,11 @@ void Index::AddIndexIDsOneFile(HTMLResource *html_resource)
         // Use the existing id if there is one, else add one if node contains index item
         attr = gumbo_get_attribute(&node->v.element.attributes, "id");
         if (attr) {
-            CreateIndexEntry(text_node_text, html_resource, index_id_value, is_custom_index_entry, custom_index_value);
+            CreateIndexEntry(text_node_text, patterns, index_texts, index_id_value, is_custom_index_entry, custom_index_value, index_entries);
         } else {
             index_id_value = SIGIL_INDEX_ID_PREFIX + QString::number(index_id_number);
 
-            if (CreateIndexEntry(text_node_text, html_resource, index_id_value, is_custom_index_entry, custom_index_value)) {
+            if (CreateIndexEntry(text_node_text, patterns, index_texts, index_id_value, is_custom_index_entry, custom_index_value, index_entries)) {
                 GumboElement* element = &node->v.element;
                 gumbo_element_set_attribute(element, "id", index_id_value.toUtf8()); 
                 resource_updated = true;
@@ -130,45 +167,27 @@ void Index::AddIndexIDsOneFile(HTMLResource *html_resource)
     if (resource_updated) {
         html_resource->SetText(gi.getxhtml());
     }
+
+    return index_entries;
 }
 
 
-bool Index::CreateIndexEntry(const QString text, HTMLResource *html_resource, QString index_id_value, bool is_custom_index_entry, QString custom_index_value)
+bool Index::CreateIndexEntry(const QString &text, const PatternSet *patterns, const QStringList *index_texts, const QString &index_id_value,
+                             bool is_custom_index_entry, const QString &custom_index_value, QList<std::pair<QString, QString>> &index_entries)
 {
-    bool created_index = false;
-    QList<IndexEditorModel::indexEntry *> entries;
-
     if (is_custom_index_entry) {
-        IndexEditorModel::indexEntry *custom_entry = new IndexEditorModel::indexEntry();
-        custom_entry->pattern = text;
-        custom_entry->index_entry = custom_index_value;
-        entries.append(custom_entry);
-    } else {
-        entries = IndexEditorModel::instance()->GetEntries();
-    }
-
-    foreach(IndexEditorModel::indexEntry * entry, entries) {
-        QString index_pattern = entry->pattern;
-        if (index_pattern.isEmpty()) {
-            continue;
+        // A custom entry uses the node text itself as its pattern
+        if (text.isEmpty() || !text.contains(QRegularExpression(text))) {
+            return false;
         }
 
-        QRegularExpression index_regex(index_pattern);
-
-        if (text.contains(index_regex)) {
-            created_index = true;
-            QString index_entry = entry->index_entry;
-            if (index_entry.isEmpty()) {
-                // If no index text, use the pattern
-                IndexEntries::instance()->AddOneEntry(index_pattern, html_resource->Filename(), index_id_value);
-            } else if (entry->index_entry.endsWith("/")) {
-                // If index text is a category then append the pattern
-                IndexEntries::instance()->AddOneEntry(index_entry + index_pattern, html_resource->Filename(), index_id_value);
-            } else {
-                // Use the given index text
-                IndexEntries::instance()->AddOneEntry(index_entry, html_resource->Filename(), index_id_value);
-            }
-        }
+        index_entries.append(std::make_pair(IndexText(text, custom_index_value), index_id_value));
+        return true;
+    }
+
+    const QList<int> matched = patterns->Match(text);
+    foreach(int i, matched) {
+        index_entries.append(std::make_pair(index_texts->at(i), index_id_value));
     }
-    return created_index;
+    return !matched.isEmpty();
 }
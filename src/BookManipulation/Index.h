@@ -25,7 +25,14 @@
 #ifndef INDEX_H
 #define INDEX_H
 
+#include <utility>
+
+#include <QtCore/QList>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+
 class HTMLResource;
+class PatternSet;
 
 /**
  * Houses the Index process.
@@ -39,9 +46,14 @@ public:
     static bool BuildIndex(QList<HTMLResource *> html_resources);
 
 private:
-    static void AddIndexIDsOneFile(HTMLResource *html_resource);
+    /**
+     * Adds ids to the indexed nodes of one file.
+     * Returns the index text and id of each entry found, in document order.
+     */
+    static QList<std::pair<QString, QString>> AddIndexIDsOneFile(HTMLResource *html_resource, const PatternSet *patterns, const QStringList *index_texts);
 
-    static bool CreateIndexEntry(const QString text, HTMLResource *html_resource, QString index_id_name, bool is_custom_index_entry, QString custom_index_name);
+    static bool CreateIndexEntry(const QString &text, const PatternSet *patterns, const QStringList *index_texts, const QString &index_id_value,
+                                 bool is_custom_index_entry, const QString &custom_index_value, QList<std::pair<QString, QString>> &index_entries);
 };
 
 #endif // INDEX_H
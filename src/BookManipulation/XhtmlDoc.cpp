@@ -178,7 +178,13 @@ QList<XhtmlDoc::XMLElement> XhtmlDoc::GetTagsInDocument(const QString &source, c
 
 QList<QString> XhtmlDoc::GetAllDescendantClasses(const QString & source)
 {
-    GumboInterface gi = GumboInterface(source);
+    GumboInterface gi(source);
+    return GetAllDescendantClasses(gi);
+}
+
+
+QList<QString> XhtmlDoc::GetAllDescendantClasses(GumboInterface & gi)
+{
     QList<GumboNode*> nodes = gi.get_all_nodes_with_attribute(QString("class"));
     QStringList classes;
     foreach(GumboNode * node, nodes) {
@@ -197,14 +203,20 @@ QList<QString> XhtmlDoc::GetAllDescendantClasses(const QString & source)
 
 QList<QString> XhtmlDoc::GetAllDescendantStyleUrls(const QString & source)
 {
-    GumboInterface gi = GumboInterface(source);
+    GumboInterface gi(source);
+    return GetAllDescendantStyleUrls(gi);
+}
+
+
+QList<QString> XhtmlDoc::GetAllDescendantStyleUrls(GumboInterface & gi)
+{
     QList<GumboNode*> nodes = gi.get_all_nodes_with_attribute(QString("style"));
     QStringList styles;
+    QRegularExpression url_search(URL_ATTRIBUTE_SEARCH);
     foreach(GumboNode * node, nodes) {
         GumboAttribute* attr = gumbo_get_attribute(&node->v.element.attributes, "style");
         if (attr) {
             QString style_value = QString::fromUtf8(attr->value);
-            QRegularExpression url_search(URL_ATTRIBUTE_SEARCH);
             QRegularExpressionMatch match = url_search.match(style_value);
             if (match.hasMatch()) {
                 styles.append(match.captured(1));
@@ -217,7 +229,13 @@ QList<QString> XhtmlDoc::GetAllDescendantStyleUrls(const QString & source)
 
 QList<QString> XhtmlDoc::GetAllDescendantIDs(const QString & source)
 {
-    GumboInterface gi = GumboInterface(source);
+    GumboInterface gi(source);
+    return GetAllDescendantIDs(gi);
+}
+
+
+QList<QString> XhtmlDoc::GetAllDescendantIDs(GumboInterface & gi)
+{
     QList<GumboNode*> nodes = gi.get_all_nodes_with_attribute(QString("id"));
     nodes.append(gi.get_all_nodes_with_attribute(QString("name")));
     QStringList IDs;
@@ -238,13 +256,19 @@ QList<QString> XhtmlDoc::GetAllDescendantIDs(const QString & source)
     return IDs;
 }
 
+
 QList<QString> XhtmlDoc::GetAllDescendantHrefs(const QString & source)
 {
-    GumboInterface gi = GumboInterface(source);
+    GumboInterface gi(source);
+    return GetAllDescendantHrefs(gi);
+}
+
+
+QList<QString> XhtmlDoc::GetAllDescendantHrefs(GumboInterface & gi)
+{
     QList<GumboNode*> nodes = gi.get_all_nodes_with_attribute(QString("href"));
     QStringList hrefs;
     foreach(GumboNode * node, nodes) {
-        QString element_name = QString::fromStdString(gi.get_tag_name(node));
         GumboAttribute* attr = gumbo_get_attribute(&node->v.element.attributes, "href");
         if (attr) {
             hrefs.append(QString::fromUtf8(attr->value));
@@ -254,6 +278,46 @@ QList<QString> XhtmlDoc::GetAllDescendantHrefs(const QString & source)
 }
 
 
+QList<QString> XhtmlDoc::GetAllDescendantSrcs(GumboInterface & gi)
+{
+    QList<GumboNode*> nodes = gi.get_all_nodes_with_attribute(QString("src"));
+    QStringList srcs;
+    foreach(GumboNode * node, nodes) {
+        GumboAttribute* attr = gumbo_get_attribute(&node->v.element.attributes, "src");
+        if (attr) {
+            srcs.append(QString::fromUtf8(attr->value));
+        }
+    }
+    return srcs;
+}
+
+
+// Same as GetTagsInDocument() but works on an already parsed tree.
+// The element text includes the text of all child elements.
+QList<XhtmlDoc::XMLElement> XhtmlDoc::GetTagsInDocument(GumboInterface & gi, GumboTag tag)
+{
+    QList<XMLElement> matching_elements;
+    QList<GumboNode*> nodes = gi.get_all_nodes_with_tag(tag);
+    foreach(GumboNode * node, nodes) {
+        XMLElement element;
+        element.name = QString::fromStdString(gi.get_tag_name(node));
+        QHash<QString, QString> attributes = gi.get_attributes_of_node(node);
+        QHashIterator<QString, QString> it(attributes);
+        while (it.hasNext()) {
+            it.next();
+            QString attribute_name = it.key();
+            if (!Utility::IsMixedCase(attribute_name)) {
+                attribute_name = attribute_name.toLower();
+            }
+            element.attributes[ attribute_name ] = it.value();
+        }
+        element.text = GetAllDescendantText(node);
+        matching_elements.append(element);
+    }
+    return matching_elements;
+}
+
+
 XhtmlDoc::WellFormedError XhtmlDoc::WellFormedErrorForSource(const QString &source)
 {
     GumboInterface gi = GumboInterface(source);
@@ -389,6 +453,31 @@ QStringList XhtmlDoc::GetLinkedStylesheets(const QString &source)
 }
 
 
+QStringList XhtmlDoc::GetLinkedStylesheets(GumboInterface & gi)
+{
+    QStringList linked_css_paths;
+    QList<GumboNode*> nodes = gi.get_all_nodes_with_tag(GUMBO_TAG_LINK);
+    foreach(GumboNode * node, nodes) {
+        if (!node->parent || (node->parent->type != GUMBO_NODE_ELEMENT) ||
+            (node->parent->v.element.tag != GUMBO_TAG_HEAD)) {
+            continue;
+        }
+        GumboAttribute* type_attr = gumbo_get_attribute(&node->v.element.attributes, "type");
+        GumboAttribute* rel_attr = gumbo_get_attribute(&node->v.element.attributes, "rel");
+        GumboAttribute* href_attr = gumbo_get_attribute(&node->v.element.attributes, "href");
+        if (!type_attr || !rel_attr || !href_attr) {
+            continue;
+        }
+        QString type = QString::fromUtf8(type_attr->value).toLower();
+        if (((type == "text/css") || (type == "text/x-oeb1-css")) &&
+            (QString::fromUtf8(rel_attr->value).toLower() == "stylesheet")) {
+            linked_css_paths.append(QString::fromUtf8(href_attr->value));
+        }
+    }
+    return linked_css_paths;
+}
+
+
 // Returns a list of all the "visible" text nodes that are descendants
 // of the specified node. "Visible" means we ignore style tags, script tags etc...
 QList<GumboNode *> XhtmlDoc::GetVisibleTextNodes(GumboInterface &gi, GumboNode *node)
@@ -550,7 +639,13 @@ QStringList XhtmlDoc::GetPathsToStyleFiles(const QString &source)
 
 QStringList XhtmlDoc::GetAllMediaPathsFromMediaChildren(const QString & source, QList<GumboTag> tags)
 {
-    GumboInterface gi = GumboInterface(source);
+    GumboInterface gi(source);
+    return GetAllMediaPathsFromMediaChildren(gi, tags);
+}
+
+
+QStringList XhtmlDoc::GetAllMediaPathsFromMediaChildren(GumboInterface & gi, QList<GumboTag> tags)
+{
     QStringList media_paths;
     QList<GumboNode*> nodes = gi.get_all_nodes_with_tags(tags);
     for (int i = 0; i < nodes.count(); ++i) {
@@ -568,6 +663,25 @@ QStringList XhtmlDoc::GetAllMediaPathsFromMediaChildren(const QString & source,
 }
 
 
+// Concatenates the text of all the text descendants of the node.
+QString XhtmlDoc::GetAllDescendantText(GumboNode * node)
+{
+    if ((node->type == GUMBO_NODE_TEXT) || (node->type == GUMBO_NODE_WHITESPACE) ||
+        (node->type == GUMBO_NODE_CDATA)) {
+        return QString::fromUtf8(node->v.text.text);
+    }
+    if ((node->type != GUMBO_NODE_ELEMENT) && (node->type != GUMBO_NODE_TEMPLATE)) {
+        return QString();
+    }
+    QString text;
+    GumboVector* children = &node->v.element.children;
+    for (unsigned int i = 0; i < children->length; ++i) {
+        text.append(GetAllDescendantText(static_cast<GumboNode*>(children->data[i])));
+    }
+    return text;
+}
+
+
 // Accepts a reference to an XML stream reader positioned on an XML element.
 // Returns an XMLElement struct with the data in the stream.
 XhtmlDoc::XMLElement XhtmlDoc::CreateXMLElement(QXmlStreamReader &reader)
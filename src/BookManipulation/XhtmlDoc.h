@@ -71,11 +71,22 @@ public:
 
     // static QList<xc::DOMNode *> GetNodeChildren(const xc::DOMNode &node);
 
+    // Same as above but works on an already parsed document
+    static QList<XMLElement> GetTagsInDocument(GumboInterface &gi, GumboTag tag);
+
     static QList<QString> GetAllDescendantStyleUrls(const QString & source);
     static QList<QString> GetAllDescendantHrefs(const QString & source);
     static QList<QString> GetAllDescendantIDs(const QString & );
     static QList<QString> GetAllDescendantClasses(const QString & source);
 
+    // The same queries against an already parsed document so one parse
+    // can be shared by all of them
+    static QList<QString> GetAllDescendantStyleUrls(GumboInterface &gi);
+    static QList<QString> GetAllDescendantHrefs(GumboInterface &gi);
+    static QList<QString> GetAllDescendantSrcs(GumboInterface &gi);
+    static QList<QString> GetAllDescendantIDs(GumboInterface &gi);
+    static QList<QString> GetAllDescendantClasses(GumboInterface &gi);
+
     struct WellFormedError {
         int line;
         int column;
@@ -116,6 +127,7 @@ public:
 
     // Return a list of all linked CSS stylesheets
     static QStringList GetLinkedStylesheets(const QString &source);
+    static QStringList GetLinkedStylesheets(GumboInterface &gi);
 
     // Returns a list of all the "visible" text nodes that are descendants
     // of the specified node. "Visible" means we ignore style tags, script tags etc...
@@ -137,10 +149,14 @@ public:
     static QStringList GetPathsToStyleFiles(const QString &source);
 
     static QStringList GetAllMediaPathsFromMediaChildren(const QString &source, QList<GumboTag> tags);
+    static QStringList GetAllMediaPathsFromMediaChildren(GumboInterface &gi, QList<GumboTag> tags);
 
 
 private:
 
+    // Concatenates the text of all the text descendants of the node
+    static QString GetAllDescendantText(GumboNode *node);
+
     // Accepts a reference to an XML stream reader positioned on an XML element.
     // Returns an XMLElement struct with the data in the stream.
     static XMLElement CreateXMLElement(QXmlStreamReader &reader);
@@ -20,8 +20,11 @@
 **
 *************************************************************************/
 
+#include <utility>
+
 #include <QtCore/QFile>
 #include <QtCore/QFileInfo>
+#include <QtConcurrent/QtConcurrent>
 #include <QtWidgets/QFileDialog>
 #include <QtGui/QFont>
 #include <QtWidgets/QMessageBox>
@@ -39,6 +42,13 @@
 static const QString SETTINGS_GROUP = "reports";
 static const QString DEFAULT_REPORT_FILE = "HTMLFilesReport.csv";
 
+// Counts all words and misspelled words in one file
+static std::pair<int, int> CountWordsMapped(HTMLResource *html_resource)
+{
+    const QString text = html_resource->GetText();
+    return std::make_pair(HTMLSpellCheck::CountAllWords(text), HTMLSpellCheck::CountMisspelledWords(text));
+}
+
 
 HTMLFilesWidget::HTMLFilesWidget()
     :
@@ -90,7 +100,12 @@ void HTMLFilesWidget::SetupTable(int sort_column, Qt::SortOrder sort_order)
     QHash<QString, QStringList> image_names_hash = m_Book->GetImagesInHTMLFiles();
     QHash<QString, QStringList> video_names_hash = m_Book->GetVideoInHTMLFiles();
     QHash<QString, QStringList> audio_names_hash = m_Book->GetAudioInHTMLFiles();
+    // Spell checking the files is the slow part so it's done on all cores
+    QFuture<std::pair<int, int>> word_counts = QtConcurrent::mapped(m_HTMLResources, CountWordsMapped);
+    word_counts.waitForFinished();
+    int file_index = 0;
     foreach(HTMLResource *html_resource, m_HTMLResources) {
+        const std::pair<int, int> file_word_counts = word_counts.resultAt(file_index++);
         QString filepath = "../" + html_resource->GetRelativePathToOEBPS();
         QString path = html_resource->GetFullPath();
         QString filename = html_resource->Filename();
@@ -108,13 +123,13 @@ void HTMLFilesWidget::SetupTable(int sort_column, Qt::SortOrder sort_order)
         size_item->setText(fsize);
         rowItems << size_item;
         // All words
-        int all_words = HTMLSpellCheck::CountAllWords(html_resource->GetText());
+        int all_words = file_word_counts.first;
         total_all_words += all_words;
         NumericItem *words_item = new NumericItem();
         words_item->setText(QString::number(all_words));
         rowItems << words_item;
         // Misspelled words
-        int misspelled_words = HTMLSpellCheck::CountMisspelledWords(html_resource->GetText());
+        int misspelled_words = file_word_counts.second;
         total_misspelled_words += misspelled_words;
         NumericItem *misspelled_item = new NumericItem();
         misspelled_item->setText(QString::number(misspelled_words));
@@ -20,8 +20,10 @@
 **
 *************************************************************************/
 
-#include <QtCore/QHashIterator>
+#include <functional>
+
 #include <QtCore/QSignalMapper>
+#include <QtConcurrent/QtConcurrent>
 #include <QtGui/QContextMenuEvent>
 #include <QtWidgets/QMessageBox>
 #include <QtWidgets/QPushButton>
@@ -246,13 +248,16 @@ void SpellcheckEditor::CreateModel(int sort_column, Qt::SortOrder sort_order)
     int total_misspelled_words = 0;
     SpellCheck *sc = SpellCheck::instance();
 
-    QHashIterator<QString, int> i(unique_words);
-    while (i.hasNext()) {
-        i.next();
-        QString word = i.key();
+    // Check the words on all cores; results come back in the order of the list.
+    const QStringList words = unique_words.keys();
+    QFuture<bool> spelled = QtConcurrent::mapped(words, std::bind(&SpellCheck::spell, sc, std::placeholders::_1));
+    spelled.waitForFinished();
+
+    for (int i = 0; i < words.count(); ++i) {
+        QString word = words.at(i);
         int count = unique_words.value(word);
 
-        bool misspelled = !sc->spell(word);
+        bool misspelled = !spelled.resultAt(i);
         if (misspelled) {
             total_misspelled_words++;
         }
@@ -23,20 +23,25 @@
 #define NOMINMAX
 #endif
 
+#include <functional>
 #include <string>
 #include <string.h>
 #include <zip.h>
+#include <unzip.h>
 #ifdef _WIN32
 #include <iowin32.h>
 #endif
 
+#include <QtConcurrent/QtConcurrent>
 #include <QtCore/QDateTime>
 #include <QtCore/QDir>
 #include <QtCore/QDirIterator>
 #include <QtCore/QFile>
 #include <QtCore/QFileInfo>
+#include <QtCore/QFuture>
 #include <QtCore/QTemporaryFile>
 #include <QtCore/QTextStream>
+#include <QtCore/QThread>
 
 #include "BookManipulation/CleanSource.h"
 #include "BookManipulation/FolderKeeper.h"
@@ -46,11 +51,16 @@
 #include "Misc/Utility.h"
 #include "Misc/TempFolder.h"
 #include "Misc/FontObfuscation.h"
+#include "Misc/SettingsStore.h"
 #include "ResourceObjects/FontResource.h"
 #include "sigil_constants.h"
 #include "sigil_exception.h"
 
-#define BUFF_SIZE 8192
+#ifndef MAX_PATH
+// Set Max length to 256 because that's the max path size on many systems.
+#define MAX_PATH 256
+#endif
+#define BUFF_SIZE 65536
 
 const QString BODY_START = "<\\s*body[^>]*>";
 const QString BODY_END   = "</\\s*body\\s*>";
@@ -65,6 +75,227 @@ static const QString OEBPS_FOLDER_SUFFIX   = "/OEBPS";
 
 static const char * EPUB_MIME_DATA = "application/epub+zip";
 
+// These are compressed already, deflating them again
+// costs time and gains next to nothing.
+static const QStringList STORED_EXTENSIONS = QStringList() << "jpg" << "jpeg" << "png" << "gif"
+                                             << "woff" << "woff2"
+                                             << "aac" << "m4a" << "mp3" << "oga" << "ogg"
+                                             << "m4v" << "mp4" << "mov" << "ogv" << "webm";
+
+// How many files are compressed ahead of the one being written, per core.
+// Bounds how much compressed data is held in memory.
+static const int FILES_AHEAD_PER_THREAD = 4;
+
+// An entry of the EPUB we are about to overwrite.
+struct PreviousEntry {
+    quint64 pos_in_zip_directory;
+    quint64 num_of_file;
+    qint64 uncompressed_size;
+    uLong crc;
+};
+
+// The data of one archive entry, ready to be written.
+struct CompressedEntry {
+    QString relpath;
+    QByteArray data;
+    qint64 uncompressed_size;
+    uLong crc;
+    bool deflated;
+    bool reuse_previous;
+    bool ok;
+};
+
+
+static unzFile OpenPreviousEpub(const QString &fullfilepath)
+{
+#ifdef Q_OS_WIN32
+    zlib_filefunc64_def ffunc;
+    fill_win32_filefunc64W(&ffunc);
+    return unzOpen2_64(Utility::QStringToStdWString(QDir::toNativeSeparators(fullfilepath)).c_str(), &ffunc);
+#else
+    return unzOpen64(QDir::toNativeSeparators(fullfilepath).toUtf8().constData());
+#endif
+}
+
+
+// Lists the entries of the EPUB that is being overwritten (if it
+// is a readable zip) so files that did not change can be copied
+// over compressed instead of being deflated again.
+static QHash<QString, PreviousEntry> IndexPreviousEpub(unzFile zfile)
+{
+    QHash<QString, PreviousEntry> entries;
+
+    if (zfile == NULL || unzGoToFirstFile(zfile) != UNZ_OK) {
+        return entries;
+    }
+
+    do {
+        char file_name[MAX_PATH] = {0};
+        unz_file_info64 file_info;
+
+        if (unzGetCurrentFileInfo64(zfile, &file_info, file_name, MAX_PATH, NULL, 0, NULL, 0) != UNZ_OK) {
+            continue;
+        }
+
+        // Skip encrypted entries and anything we would not have written.
+        if ((file_info.flag & 1) || (file_info.compression_method != 0 && file_info.compression_method != Z_DEFLATED)) {
+            continue;
+        }
+
+        unz64_file_pos file_pos;
+
+        if (unzGetFilePos64(zfile, &file_pos) != UNZ_OK) {
+            continue;
+        }
+
+        PreviousEntry entry = { file_pos.pos_in_zip_directory, file_pos.num_of_file,
+                                (qint64) file_info.uncompressed_size, file_info.crc };
+        entries[ QString::fromUtf8(file_name) ] = entry;
+    } while (unzGoToNextFile(zfile) == UNZ_OK);
+
+    return entries;
+}
+
+
+// Reads a file and deflates it (without the zlib header, the way it is
+// stored in the zip) unless that wouldn't make it smaller, or the EPUB
+// being overwritten already holds the same data under the same name.
+// Fonts with a mask in font_masks are obfuscated as they are read.
+// Runs on the thread pool.
+static CompressedEntry CompressEntry(const QString &relpath, const QString &fullfolderpath, int level,
+                                     const QHash<QString, QByteArray> *font_masks,
+                                     const QHash<QString, PreviousEntry> *previous_entries)
+{
+    CompressedEntry entry;
+    entry.relpath = relpath;
+    entry.uncompressed_size = 0;
+    entry.crc = crc32(0L, Z_NULL, 0);
+    entry.deflated = false;
+    entry.reuse_previous = false;
+    entry.ok = false;
+    QFile file(fullfolderpath + "/" + relpath);
+
+    if (!file.open(QIODevice::ReadOnly)) {
+        return entry;
+    }
+
+    QByteArray raw = file.readAll();
+    file.close();
+
+    if (font_masks && font_masks->contains(relpath)) {
+        FontObfuscation::ApplyMask(raw, font_masks->value(relpath));
+    }
+
+    entry.uncompressed_size = raw.size();
+    entry.crc = crc32(entry.crc, reinterpret_cast<const Bytef *>(raw.constData()), raw.size());
+
+    if (previous_entries && previous_entries->contains(relpath)) {
+        const PreviousEntry &previous = previous_entries->value(relpath);
+
+        if (previous.uncompressed_size == entry.uncompressed_size && previous.crc == entry.crc) {
+            entry.reuse_previous = true;
+            entry.ok = true;
+            return entry;
+        }
+    }
+
+    if (!raw.isEmpty() && !STORED_EXTENSIONS.contains(QFileInfo(relpath).suffix().toLower())) {
+        z_stream stream;
+        memset(&stream, 0, sizeof(stream));
+
+        if (deflateInit2(&stream, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) == Z_OK) {
+            QByteArray deflated(deflateBound(&stream, raw.size()), Qt::Uninitialized);
+            stream.next_in = reinterpret_cast<Bytef *>(raw.data());
+            stream.avail_in = raw.size();
+            stream.next_out = reinterpret_cast<Bytef *>(deflated.data());
+            stream.avail_out = deflated.size();
+
+            if (deflate(&stream, Z_FINISH) == Z_STREAM_END && stream.total_out < (uLong)raw.size()) {
+                deflated.resize(stream.total_out);
+                entry.data = deflated;
+                entry.deflated = true;
+            }
+
+            deflateEnd(&stream);
+        }
+    }
+
+    if (!entry.deflated) {
+        entry.data = raw;
+    }
+
+    entry.ok = true;
+    return entry;
+}
+
+
+// Writes an entry CompressEntry() prepared to the archive.
+static bool WriteEntry(zipFile zfile, const zip_fileinfo &fileInfo, const CompressedEntry &entry, int level)
+{
+    // The data is compressed already, so the entry is opened raw and
+    // we hand minizip the size and CRC of the uncompressed data at the end.
+    if (zipOpenNewFileInZip4_64(zfile, entry.relpath.toUtf8().constData(), &fileInfo, NULL, 0, NULL, 0, NULL,
+                                entry.deflated ? Z_DEFLATED : 0, entry.deflated ? level : 0, 1,
+                                -MAX_WBITS, 8, Z_DEFAULT_STRATEGY, NULL, 0, 0x0b00, 1<<11,
+                                entry.uncompressed_size >= 0xffffffff ? 1 : 0) != Z_OK) {
+        return false;
+    }
+
+    const char *data = entry.data.constData();
+    qint64 remaining = entry.data.size();
+
+    while (remaining > 0) {
+        unsigned int chunk = (unsigned int) qMin(remaining, (qint64) BUFF_SIZE);
+
+        if (zipWriteInFileInZip(zfile, data, chunk) != Z_OK) {
+            zipCloseFileInZipRaw64(zfile, entry.uncompressed_size, entry.crc);
+            return false;
+        }
+
+        data += chunk;
+        remaining -= chunk;
+    }
+
+    return zipCloseFileInZipRaw64(zfile, entry.uncompressed_size, entry.crc) == Z_OK;
+}
+
+
+// Reads the still compressed data of an unchanged entry from the EPUB
+// being overwritten, so it can be written to the new archive as it is.
+static bool ReadPreviousEntry(unzFile previous_zfile, const PreviousEntry &previous, CompressedEntry &entry)
+{
+    unz64_file_pos file_pos;
+    file_pos.pos_in_zip_directory = previous.pos_in_zip_directory;
+    file_pos.num_of_file = previous.num_of_file;
+    int method = 0;
+    int level = 0;
+
+    if (previous_zfile == NULL ||
+        unzGoToFilePos64(previous_zfile, &file_pos) != UNZ_OK ||
+        unzOpenCurrentFile2(previous_zfile, &method, &level, 1) != UNZ_OK) {
+        return false;
+    }
+
+    QByteArray buff(BUFF_SIZE, Qt::Uninitialized);
+    int read = 0;
+    entry.data.clear();
+
+    while ((read = unzReadCurrentFile(previous_zfile, buff.data(), BUFF_SIZE)) > 0) {
+        entry.data.append(buff.constData(), read);
+    }
+
+    unzCloseCurrentFile(previous_zfile);
+
+    if (read < 0) {
+        return false;
+    }
+
+    entry.deflated = method == Z_DEFLATED;
+    entry.uncompressed_size = previous.uncompressed_size;
+    entry.crc = previous.crc;
+    return true;
+}
+
 
 // Constructor;
 // the first parameter is the location where the book
@@ -97,12 +328,13 @@ void ExportEPUB::WriteBook()
     m_Book->SaveAllResourcesToDisk();
     TempFolder tempfolder;
     CreatePublication(tempfolder.GetPath());
+    QHash<QString, QByteArray> font_masks;
 
     if (m_Book->HasObfuscatedFonts()) {
-        ObfuscateFonts(tempfolder.GetPath());
+        font_masks = GetFontObfuscationMasks();
     }
 
-    SaveFolderAsEpubToLocation(tempfolder.GetPath(), m_FullFilePath);
+    SaveFolderAsEpubToLocation(tempfolder.GetPath(), m_FullFilePath, font_masks);
 }
 
 
@@ -117,9 +349,12 @@ void ExportEPUB::CreatePublication(const QString &fullfolderpath)
     }
 }
 
-void ExportEPUB::SaveFolderAsEpubToLocation(const QString &fullfolderpath, const QString &fullfilepath)
+void ExportEPUB::SaveFolderAsEpubToLocation(const QString &fullfolderpath, const QString &fullfilepath,
+                                            const QHash<QString, QByteArray> &font_masks)
 {
-    QString tempFile = fullfolderpath + "-tmp.epub";
+    // The archive is written next to the real file and then renamed
+    // over it, so the real file is never left half written.
+    QString tempFile = QFileInfo(fullfilepath).absolutePath() + "/.sigil_" + Utility::CreateUUID() + ".epub.tmp";
     QDateTime timeNow = QDateTime::currentDateTime();
     zip_fileinfo fileInfo;
 #ifdef Q_OS_WIN32
@@ -158,6 +393,7 @@ void ExportEPUB::SaveFolderAsEpubToLocation(const QString &fullfolderpath, const
 
     zipCloseFileInZip(zfile);
     // Write all the files in our directory path to the archive.
+    QStringList relpaths;
     QDirIterator it(fullfolderpath, QDir::Files | QDir::NoDotAndDotDot | QDir::Readable | QDir::Hidden, QDirIterator::Subdirectories);
 
     while (it.hasNext()) {
@@ -168,99 +404,73 @@ void ExportEPUB::SaveFolderAsEpubToLocation(const QString &fullfolderpath, const
             relpath = relpath.remove(0, 1);
         }
 
-        // Add the file entry to the archive.
-        // We should check the uncompressed file size. If it's over >= 0xffffffff the last parameter (zip64) should be 1.
-        if (zipOpenNewFileInZip4_64(zfile, relpath.toUtf8().constData(), &fileInfo, NULL, 0, NULL, 0, NULL, Z_DEFLATED, 8, 0, 15, 8, Z_DEFAULT_STRATEGY, NULL, 0, 0x0b00, 1<<11, 0) != Z_OK) {
-            zipClose(zfile, NULL);
-            QFile::remove(tempFile);
-            throw(CannotStoreFile(relpath.toStdString()));
-        }
-
-        // Open the file on disk. We will read this and write what we read into
-        // the archive.
-        QFile dfile(it.filePath());
+        relpaths.append(relpath);
+    }
 
-        if (!dfile.open(QIODevice::ReadOnly)) {
-            zipCloseFileInZip(zfile);
-            zipClose(zfile, NULL);
-            QFile::remove(tempFile);
-            throw(CannotOpenFile(it.fileName().toStdString()));
+    // Files that did not change since the EPUB we are overwriting
+    // was written are copied over from it as they are.
+    unzFile previous_zfile = OpenPreviousEpub(fullfilepath);
+    const QHash<QString, PreviousEntry> previous_entries = IndexPreviousEpub(previous_zfile);
+    // The files are compressed on the thread pool a batch at a time while
+    // the previous batch is written out in order.
+    int level = SettingsStore::snapshot().epub_compression_level;
+    int batch_size = qMax(1, QThread::idealThreadCount()) * FILES_AHEAD_PER_THREAD;
+    std::function<CompressedEntry(const QString &)> compress =
+        std::bind(CompressEntry, std::placeholders::_1, fullfolderpath, level, &font_masks, &previous_entries);
+    QFuture<CompressedEntry> next_batch = QtConcurrent::mapped(relpaths.mid(0, batch_size), compress);
+
+    for (int start = 0; start < relpaths.count(); start += batch_size) {
+        QFuture<CompressedEntry> batch = next_batch;
+
+        if (start + batch_size < relpaths.count()) {
+            next_batch = QtConcurrent::mapped(relpaths.mid(start + batch_size, batch_size), compress);
         }
 
-        // Write the data from the file on disk into the archive.
-        char buff[BUFF_SIZE] = {0};
-        qint64 read = 0;
+        int batch_count = qMin(batch_size, relpaths.count() - start);
 
-        while ((read = dfile.read(buff, BUFF_SIZE)) > 0) {
-            if (zipWriteInFileInZip(zfile, buff, read) != Z_OK) {
-                dfile.close();
-                zipCloseFileInZip(zfile);
-                zipClose(zfile, NULL);
-                QFile::remove(tempFile);
-                throw(CannotStoreFile(relpath.toStdString()));
+        for (int i = 0; i < batch_count; ++i) {
+            CompressedEntry entry = batch.resultAt(i);
+
+            if (entry.reuse_previous &&
+                !ReadPreviousEntry(previous_zfile, previous_entries.value(entry.relpath), entry)) {
+                // The old EPUB let us down, compress the file after all.
+                entry = CompressEntry(entry.relpath, fullfolderpath, level, &font_masks, NULL);
             }
-        }
 
-        dfile.close();
+            if (!entry.ok || !WriteEntry(zfile, fileInfo, entry, level)) {
+                batch.waitForFinished();
+                next_batch.waitForFinished();
 
-        // There was an error reading the file on disk.
-        if (read < 0) {
-            zipCloseFileInZip(zfile);
-            zipClose(zfile, NULL);
-            QFile::remove(tempFile);
-            throw(CannotStoreFile(relpath.toStdString()));
-        }
+                if (previous_zfile != NULL) {
+                    unzClose(previous_zfile);
+                }
 
-        if (zipCloseFileInZip(zfile) != Z_OK) {
-            zipClose(zfile, NULL);
-            QFile::remove(tempFile);
-            throw(CannotStoreFile(relpath.toStdString()));
-        }
-    }
+                zipClose(zfile, NULL);
+                QFile::remove(tempFile);
 
-    zipClose(zfile, NULL);
-    // Overwrite the contents of the real file with the contents from the temp
-    // file we saved the data do. We do this instead of simply copying the file
-    // because a file copy will lose extended attributes such as labels on OS X.
-    QFile temp_epub(tempFile);
+                if (!entry.ok) {
+                    throw(CannotOpenFile(QFileInfo(entry.relpath).fileName().toStdString()));
+                }
 
-    if (!temp_epub.open(QFile::ReadOnly)) {
-        throw(CannotOpenFile(tempFile.toStdString()));
+                throw(CannotStoreFile(entry.relpath.toStdString()));
+            }
+        }
     }
 
-    QFile real_epub(fullfilepath);
-
-    if (!real_epub.open(QFile::WriteOnly | QFile::Truncate)) {
-        temp_epub.close();
-        throw(CannotWriteFile(fullfilepath.toStdString()));
+    // Closed before the new EPUB is moved over it.
+    if (previous_zfile != NULL) {
+        unzClose(previous_zfile);
     }
 
-    // Copy the contents from the temp file to the real file.
-    char buff[BUFF_SIZE] = {0};
-    qint64 read = 0;
-    qint64 written = 0;
-
-    while ((read = temp_epub.read(buff, BUFF_SIZE)) > 0) {
-        written = real_epub.write(buff, read);
-
-        if (written != read) {
-            temp_epub.close();
-            real_epub.close();
-            QFile::remove(tempFile);
-            throw(CannotCopyFile(fullfilepath.toStdString()));
-        }
+    if (zipClose(zfile, NULL) != Z_OK) {
+        QFile::remove(tempFile);
+        throw(CannotStoreFile(tempFile.toStdString()));
     }
 
-    if (read == -1) {
-        temp_epub.close();
-        real_epub.close();
+    if (!Utility::ReplaceFile(tempFile, fullfilepath)) {
         QFile::remove(tempFile);
-        throw(CannotCopyFile(fullfilepath.toStdString()));
+        throw(CannotWriteFile(fullfilepath.toStdString()));
     }
-
-    temp_epub.close();
-    real_epub.close();
-    QFile::remove(tempFile);
 }
 
 
@@ -281,8 +491,9 @@ void ExportEPUB::CreateEncryptionXML(const QString &fullfolderpath)
 }
 
 
-void ExportEPUB::ObfuscateFonts(const QString &fullfolderpath)
+QHash<QString, QByteArray> ExportEPUB::GetFontObfuscationMasks() const
 {
+    QHash<QString, QByteArray> font_masks;
     QString uuid_id = m_Book->GetOPF()->GetUUIDIdentifierValue();
     QString main_id = m_Book->GetPublicationIdentifier();
     QList<FontResource *> font_resources = m_Book->GetFolderKeeper()->GetResourceTypeList<FontResource>();
@@ -293,12 +504,11 @@ void ExportEPUB::ObfuscateFonts(const QString &fullfolderpath)
             continue;
         }
 
-        QString font_path = fullfolderpath + "/" + font_resource->GetRelativePathToRoot();
-
         if (algorithm == ADOBE_FONT_ALGO_ID) {
-            FontObfuscation::ObfuscateFile(font_path, algorithm, uuid_id);
+            font_masks[ font_resource->GetRelativePathToRoot() ] = FontObfuscation::ObfuscationMask(algorithm, uuid_id);
         } else {
-            FontObfuscation::ObfuscateFile(font_path, algorithm, main_id);
+            font_masks[ font_resource->GetRelativePathToRoot() ] = FontObfuscation::ObfuscationMask(algorithm, main_id);
         }
     }
+    return font_masks;
 }
@@ -52,16 +52,20 @@ private:
 
     // Saves the publication in the specified folder
     // to the specified file path as an epub;
-    // the second optional parameter specifies the
-    // mimetype to write to the special "mimetype" file
-    void SaveFolderAsEpubToLocation(const QString &fullfolderpath, const QString &fullfilepath);
+    // files are compressed in parallel and the epub
+    // is renamed over the file path once complete.
+    // The fonts in font_masks are obfuscated on their way
+    // into the epub, the files in the folder are not changed.
+    void SaveFolderAsEpubToLocation(const QString &fullfolderpath, const QString &fullfilepath,
+                                    const QHash<QString, QByteArray> &font_masks);
 
     // Creates the publication's encryption.xml file,
     // if there are any fonts to obfuscate
     void CreateEncryptionXML(const QString &fullfolderpath);
 
-    // Obfuscates the fonts marked for obfuscation
-    void ObfuscateFonts(const QString &fullfolderpath);
+    // Returns the obfuscation masks of the fonts marked
+    // for obfuscation, keyed by their path in the publication
+    QHash<QString, QByteArray> GetFontObfuscationMasks() const;
 
 
     ///////////////////////////////
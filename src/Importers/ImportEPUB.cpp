@@ -69,8 +69,9 @@
 // Set Max length to 256 because that's the max path size on many systems.
 #define MAX_PATH 256
 #endif
-// This is the same read buffer size used by Java and Perl.
-#define BUFF_SIZE 8192
+// Big enough that inflating a large image
+// does not take thousands of tiny writes.
+#define BUFF_SIZE 65536
 
 const QString DUBLIN_CORE_NS             = "http://purl.org/dc/elements/1.1/";
 static const QString OEBPS_MIMETYPE      = "application/oebps-package+xml";
@@ -88,6 +89,97 @@ static const QString CONTAINER_XML       = "<?xml version=\"1.0\" encoding=\"UTF
 
 static QCodePage437Codec *cp437 = 0;
 
+
+static unzFile OpenZipFile(const QString &fullfilepath)
+{
+#ifdef Q_OS_WIN32
+    zlib_filefunc64_def ffunc;
+    fill_win32_filefunc64W(&ffunc);
+    return unzOpen2_64(Utility::QStringToStdWString(QDir::toNativeSeparators(fullfilepath)).c_str(), &ffunc);
+#else
+    return unzOpen64(QDir::toNativeSeparators(fullfilepath).toUtf8().constData());
+#endif
+}
+
+
+// The key a path in the archive is stored under in m_ZipEntries.
+// On case insensitive file systems a manifest href that differs in
+// case from the archive still found the extracted file, so we keep that.
+static QString ZipEntryKey(const QString &path)
+{
+#if defined(Q_OS_WIN32) || defined(Q_OS_MAC)
+    return path.toLower();
+#else
+    return path;
+#endif
+}
+
+
+// The files we need to read before we know where the
+// manifest files go. Everything else is inflated later on
+// straight into the book folder.
+static bool IsContainerFile(const QString &path)
+{
+    return path.startsWith("META-INF/") || QFileInfo(path).suffix().toLower() == "opf";
+}
+
+
+// Inflates the current file of the archive to the file path.
+// If data is not NULL it also gets a copy of the inflated bytes.
+static bool ExtractCurrentFile(unzFile zfile, const QString &file_path, QByteArray *data = NULL)
+{
+    QDir().mkpath(QFileInfo(file_path).absolutePath());
+
+    // Open the file entry in the archive for reading.
+    if (unzOpenCurrentFile(zfile) != UNZ_OK) {
+        return false;
+    }
+
+    // Open the file on disk to write the entry in the archive to.
+    QFile entry(file_path);
+
+    if (!entry.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        unzCloseCurrentFile(zfile);
+        return false;
+    }
+
+    if (data) {
+        unz_file_info64 file_info;
+
+        if (unzGetCurrentFileInfo64(zfile, &file_info, NULL, 0, NULL, 0, NULL, 0) == UNZ_OK) {
+            data->reserve(file_info.uncompressed_size);
+        }
+    }
+
+    // Buffered reading and writing.
+    QByteArray buff(BUFF_SIZE, Qt::Uninitialized);
+    bool written = true;
+    int read = 0;
+
+    while ((read = unzReadCurrentFile(zfile, buff.data(), BUFF_SIZE)) > 0) {
+        if (entry.write(buff.constData(), read) != read) {
+            written = false;
+            break;
+        }
+
+        if (data) {
+            data->append(buff.constData(), read);
+        }
+    }
+
+    entry.close();
+
+    // The file was read but the CRC did not match.
+    // We don't check the read file size vs the uncompressed file size
+    // because if they're different there should be a CRC error.
+    // Read errors are marked by a negative read amount.
+    if (unzCloseCurrentFile(zfile) == UNZ_CRCERROR || read < 0) {
+        return false;
+    }
+
+    return written;
+}
+
 // Constructor;
 // The parameter is the file to be imported
 ImportEPUB::ImportEPUB(const QString &fullfilepath)
@@ -142,8 +234,11 @@ QSharedPointer<Book> ImportEPUB::GetBook()
                 continue;
             }
             // Load the content into the HTMLResource so we can perform a well formed check.
+            // Files inflated from the archive have been decoded already.
             try {
-                hresource->SetText(HTMLEncodingResolver::ReadHTMLFile(hresource->GetFullPath()));
+                if (!hresource->IsLoaded()) {
+                    hresource->SetText(HTMLEncodingResolver::ReadHTMLFile(hresource->GetFullPath()));
+                }
             } catch (...) {
                 if (ss.cleanOn() & CLEANON_OPEN) {
                     non_well_formed << hresource;
@@ -358,13 +453,7 @@ void ImportEPUB::ExtractContainer()
     if (!cp437) {
         cp437 = new QCodePage437Codec();
     }
-#ifdef Q_OS_WIN32
-    zlib_filefunc64_def ffunc;
-    fill_win32_filefunc64W(&ffunc);
-    unzFile zfile = unzOpen2_64(Utility::QStringToStdWString(QDir::toNativeSeparators(m_FullFilePath)).c_str(), &ffunc);
-#else
-    unzFile zfile = unzOpen64(QDir::toNativeSeparators(m_FullFilePath).toUtf8().constData());
-#endif
+    unzFile zfile = OpenZipFile(m_FullFilePath);
 
     if (zfile == NULL) {
         throw (EPUBLoadParseError(QString(QObject::tr("Cannot unzip EPUB: %1")).arg(QDir::toNativeSeparators(m_FullFilePath)).toStdString()));
@@ -389,57 +478,30 @@ void ImportEPUB::ExtractContainer()
 
             // If there is no file name then we can't do anything with it.
             if (!qfile_name.isEmpty()) {
-                // We use the dir object to create the path in the temporary directory.
-                // Unfortunately, we need a dir ojbect to do this as it's not a static function.
-                QDir dir(m_ExtractedFolderPath);
-                // Full file path in the temporary directory.
-                QString file_path = m_ExtractedFolderPath + "/" + qfile_name;
-                QFileInfo qfile_info(file_path);
-
                 // Is this entry a directory?
                 if (file_info.uncompressed_size == 0 && qfile_name.endsWith('/')) {
-                    dir.mkpath(qfile_name);
+                    QDir(m_ExtractedFolderPath).mkpath(qfile_name);
                     continue;
-                } else {
-                    dir.mkpath(qfile_info.path());
-                }
-
-                // Open the file entry in the archive for reading.
-                if (unzOpenCurrentFile(zfile) != UNZ_OK) {
-                    unzClose(zfile);
-                    throw (EPUBLoadParseError(QString(QObject::tr("Cannot extract file: %1")).arg(qfile_name).toStdString()));
                 }
 
-                // Open the file on disk to write the entry in the archive to.
-                QFile entry(file_path);
+                // Remember where the file is so it can be inflated later.
+                unz64_file_pos file_pos;
+                unzGetFilePos64(zfile, &file_pos);
+                ZipEntry entry = { file_pos.pos_in_zip_directory, file_pos.num_of_file };
+                m_ZipEntries[ ZipEntryKey(qfile_name) ] = entry;
 
-                if (!entry.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
-                    unzCloseCurrentFile(zfile);
-                    unzClose(zfile);
-                    throw (EPUBLoadParseError(QString(QObject::tr("Cannot extract file: %1")).arg(qfile_name).toStdString()));
+                if (!cp437_file_name.isEmpty() && cp437_file_name != qfile_name) {
+                    m_ZipEntries.insert(ZipEntryKey(cp437_file_name), entry);
                 }
 
-                // Buffered reading and writing.
-                char buff[BUFF_SIZE] = {0};
-                int read = 0;
-
-                while ((read = unzReadCurrentFile(zfile, buff, BUFF_SIZE)) > 0) {
-                    entry.write(buff, read);
+                if (!IsContainerFile(qfile_name)) {
+                    continue;
                 }
 
-                entry.close();
-
-                // Read errors are marked by a negative read amount.
-                if (read < 0) {
-                    unzCloseCurrentFile(zfile);
-                    unzClose(zfile);
-                    throw (EPUBLoadParseError(QString(QObject::tr("Cannot extract file: %1")).arg(qfile_name).toStdString()));
-                }
+                // Full file path in the temporary directory.
+                QString file_path = m_ExtractedFolderPath + "/" + qfile_name;
 
-                // The file was read but the CRC did not match.
-                // We don't check the read file size vs the uncompressed file size
-                // because if they're different there should be a CRC error.
-                if (unzCloseCurrentFile(zfile) == UNZ_CRCERROR) {
+                if (!ExtractCurrentFile(zfile, file_path)) {
                     unzClose(zfile);
                     throw (EPUBLoadParseError(QString(QObject::tr("Cannot extract file: %1")).arg(qfile_name).toStdString()));
                 }
@@ -460,6 +522,52 @@ void ImportEPUB::ExtractContainer()
     unzClose(zfile);
 }
 
+
+bool ImportEPUB::FindZipEntry(const QString &fullfilepath, ZipEntry &entry) const
+{
+    QString path = QDir::cleanPath(fullfilepath);
+
+    if (!path.startsWith(m_ExtractedFolderPath + "/")) {
+        return false;
+    }
+
+    QString key = ZipEntryKey(path.mid(m_ExtractedFolderPath.length() + 1));
+
+    if (!m_ZipEntries.contains(key)) {
+        return false;
+    }
+
+    entry = m_ZipEntries.value(key);
+    return true;
+}
+
+
+void ImportEPUB::ExtractFileOnDemand(const QString &fullfilepath)
+{
+    ZipEntry entry;
+
+    if (QFile::exists(fullfilepath) || !FindZipEntry(fullfilepath, entry)) {
+        return;
+    }
+
+    unzFile zfile = OpenZipFile(m_FullFilePath);
+
+    if (zfile == NULL) {
+        throw (EPUBLoadParseError(QString(QObject::tr("Cannot unzip EPUB: %1")).arg(QDir::toNativeSeparators(m_FullFilePath)).toStdString()));
+    }
+
+    unz64_file_pos file_pos;
+    file_pos.pos_in_zip_directory = entry.pos_in_zip_directory;
+    file_pos.num_of_file = entry.num_of_file;
+    bool extracted = unzGoToFilePos64(zfile, &file_pos) == UNZ_OK &&
+                     ExtractCurrentFile(zfile, fullfilepath);
+    unzClose(zfile);
+
+    if (!extracted) {
+        throw (EPUBLoadParseError(QString(QObject::tr("Cannot extract file: %1")).arg(QDir::toNativeSeparators(fullfilepath)).toStdString()));
+    }
+}
+
 void ImportEPUB::LocateOPF()
 {
     QString fullpath = m_ExtractedFolderPath + "/META-INF/container.xml";
@@ -513,6 +621,11 @@ void ImportEPUB::LocateOPF()
         throw (EPUBLoadParseError(error.toStdString()));
     }
 
+    // container.xml can point to an OPF that does not use the .opf extension.
+    if (!m_OPFFilePath.isEmpty()) {
+        ExtractFileOnDemand(m_OPFFilePath);
+    }
+
     if (m_OPFFilePath.isEmpty() || !QFile::exists(m_OPFFilePath)) {
         throw (EPUBLoadParseError(QString(QObject::tr("No appropriate OPF file found")).toStdString()));
     }
@@ -653,6 +766,10 @@ void ImportEPUB::LocateOrCreateNCX(const QString &ncx_id_on_spine)
 
     m_NCXFilePath = QFileInfo(m_OPFFilePath).absolutePath() % "/" % ncx_href;
 
+    if (!ncx_href.isEmpty()) {
+        ExtractFileOnDemand(m_NCXFilePath);
+    }
+
     if (ncx_href.isEmpty() || !QFile::exists(m_NCXFilePath)) {
         m_NCXNotInManifest = m_NCXId.isEmpty() || ncx_href.isEmpty();
         m_NCXId.clear();
@@ -725,17 +842,110 @@ QHash<QString, QString> ImportEPUB::LoadFolderStructure()
     }
 
     updates.remove(UPDATE_ERROR_STRING);
+    InflateQueuedFiles();
     return updates;
 }
 
 
+void ImportEPUB::InflateQueuedFiles()
+{
+    if (m_InflateQueue.isEmpty()) {
+        return;
+    }
+
+    // minizip handles can't be shared between threads, so every
+    // worker opens the archive once and pulls files off the queue
+    // until it is empty. Big and small files even out that way.
+    int num_workers = qMax(1, qMin(QThread::idealThreadCount(), m_InflateQueue.count()));
+    QAtomicInt next_job(0);
+    QFutureSynchronizer<QStringList> sync;
+
+    for (int i = 0; i < num_workers; ++i) {
+        sync.addFuture(QtConcurrent::run(this, &ImportEPUB::InflateFiles, &next_job));
+    }
+
+    sync.waitForFinished();
+    m_InflateQueue.clear();
+    QStringList failed;
+    foreach(QFuture<QStringList> future, sync.futures()) {
+        failed.append(future.result());
+    }
+
+    if (!failed.isEmpty()) {
+        throw (EPUBLoadParseError(QString(QObject::tr("Cannot extract file: %1")).arg(failed.first()).toStdString()));
+    }
+}
+
+
+QStringList ImportEPUB::InflateFiles(QAtomicInt *next_job)
+{
+    QStringList failed;
+    unzFile zfile = OpenZipFile(m_FullFilePath);
+    int i = 0;
+
+    while ((i = next_job->fetchAndAddRelaxed(1)) < m_InflateQueue.count()) {
+        const InflateJob &job = m_InflateQueue.at(i);
+
+        if (zfile == NULL) {
+            failed << job.path;
+            continue;
+        }
+
+        // HTML and CSS are decoded from memory right away,
+        // so they don't have to be read back from disk.
+        HTMLResource *html_resource = qobject_cast<HTMLResource *>(job.resource);
+        CSSResource *css_resource = qobject_cast<CSSResource *>(job.resource);
+        QByteArray data;
+        unz64_file_pos file_pos;
+        file_pos.pos_in_zip_directory = job.entry.pos_in_zip_directory;
+        file_pos.num_of_file = job.entry.num_of_file;
+
+        if (unzGoToFilePos64(zfile, &file_pos) != UNZ_OK ||
+            !ExtractCurrentFile(zfile, job.resource->GetFullPath(), (html_resource || css_resource) ? &data : NULL)) {
+            failed << job.path;
+            continue;
+        }
+
+        try {
+            if (html_resource) {
+                html_resource->SetText(HTMLEncodingResolver::DecodeHTML(data));
+            } else if (css_resource) {
+                css_resource->SetText(Utility::DecodeUnicodeText(data));
+            }
+        } catch (...) {
+            // Leave the resource unloaded; it is read from
+            // disk later on and any problem is reported then.
+        }
+    }
+
+    if (zfile != NULL) {
+        unzClose(zfile);
+    }
+
+    return failed;
+}
+
+
 std::tuple<QString, QString> ImportEPUB::LoadOneFile(const QString &path, const QString &mimetype)
 {
     QString fullfilepath = QFileInfo(m_OPFFilePath).absolutePath() + "/" + path;
     QString currentpath = fullfilepath;
     currentpath = currentpath.remove(0,m_ExtractedFolderPath.length()+1);
     try {
-        Resource *resource = m_Book->GetFolderKeeper()->AddContentFileToFolder(fullfilepath, false, mimetype);
+        Resource *resource = NULL;
+        ZipEntry entry;
+
+        if (!QFile::exists(fullfilepath) && FindZipEntry(fullfilepath, entry)) {
+            // Still in the archive, it will be inflated
+            // straight into the book folder.
+            resource = m_Book->GetFolderKeeper()->AddContentFileWithoutCopy(fullfilepath, mimetype);
+            InflateJob job = { currentpath, entry, resource };
+            QMutexLocker locker(&m_InflateQueueMutex);
+            m_InflateQueue.append(job);
+        } else {
+            resource = m_Book->GetFolderKeeper()->AddContentFileToFolder(fullfilepath, false, mimetype);
+        }
+
         if (resource->Type() == Resource::HTMLResourceType) {
             resource->SetCurrentBookRelPath(currentpath);
         }
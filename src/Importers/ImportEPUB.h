@@ -25,7 +25,9 @@
 #define IMPORTEPUB_H
 
 #include <QCoreApplication>
+#include <QtCore/QAtomicInt>
 #include <QtCore/QHash>
+#include <QtCore/QMutex>
 #include <QtCore/QSet>
 #include <QtCore/QStringList>
 
@@ -34,6 +36,7 @@
 
 class HTMLResource;
 class CSSResource;
+class Resource;
 class QXmlStreamReader;
 
 class ImportEPUB : public Importer
@@ -50,12 +53,61 @@ public:
 
 private:
     /**
-     * Extracts the EPUB file to a temporary folder.
-     * The path to the the temp folder with the extracted files
-     * is stored in m_ExtractedFolderPath.
+     * Where a file is in the EPUB archive.
+     * These are the fields of minizip's unz64_file_pos.
+     */
+    struct ZipEntry {
+        quint64 pos_in_zip_directory;
+        quint64 num_of_file;
+    };
+
+    /**
+     * A manifest file that is inflated straight into its resource.
+     */
+    struct InflateJob {
+        QString path;
+        ZipEntry entry;
+        Resource *resource;
+    };
+
+    /**
+     * Indexes the files in the EPUB and extracts the META-INF
+     * folder and any OPF to a temporary folder. The path to the
+     * temp folder with the extracted files is stored in m_ExtractedFolderPath.
+     * The other files are inflated once we know where they go.
      */
     void ExtractContainer();
 
+    /**
+     * Looks up the archive entry of a path in the extracted folder.
+     *
+     * @param fullfilepath The full path to the file in the extracted folder.
+     * @param entry Set to the entry if one is found.
+     * @return \c true if the file is in the archive.
+     */
+    bool FindZipEntry(const QString &fullfilepath, ZipEntry &entry) const;
+
+    /**
+     * Extracts a single file to the temporary folder
+     * if ExtractContainer() did not extract it already.
+     *
+     * @param fullfilepath The full path to the file in the extracted folder.
+     */
+    void ExtractFileOnDemand(const QString &fullfilepath);
+
+    /**
+     * Inflates the files queued by LoadOneFile() in parallel.
+     */
+    void InflateQueuedFiles();
+
+    /**
+     * Inflates queued files until the queue is empty.
+     *
+     * @param next_job The index of the next file to take from the queue.
+     * @return The paths of the files that could not be inflated.
+     */
+    QStringList InflateFiles(QAtomicInt *next_job);
+
     /**
      * Locates the OPF file in the extracted folder.
      * The path to the OPF is then stored in m_OPFFilePath.
@@ -106,7 +158,8 @@ private:
     QHash<QString, QString> LoadFolderStructure();
 
     /**
-     * Loads a single file.
+     * Loads a single file. Files that are still in the archive
+     * get their resource right away and are queued to be inflated.
      *
      * @param path A full path to the file to load.
      * @param mimetype The mimetype of the file to load.
@@ -166,6 +219,17 @@ private:
      */
     QString m_ExtractedFolderPath;
 
+    /**
+     * Every file in the EPUB archive keyed by its path in the archive.
+     */
+    QHash<QString, ZipEntry> m_ZipEntries;
+
+    /**
+     * The manifest files still to be inflated. @see InflateQueuedFiles().
+     */
+    QList<InflateJob> m_InflateQueue;
+    QMutex m_InflateQueueMutex;
+
     /**
      * The full path to the OPF file
      * of the publication.
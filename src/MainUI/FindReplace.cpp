@@ -473,6 +473,7 @@ void FindReplace::clearMessage()
 {
     if (!m_IsSearchGroupRunning) {
         ui.message->clear();
+        ui.message->setToolTip(QString());
         emit ShowMessageRequest("");
     }
 }
@@ -481,6 +482,7 @@ void FindReplace::expireMessage()
 {
     m_timer.stop();
     ui.message->clear();
+    ui.message->setToolTip(QString());
     emit ShowMessageRequest("");
 }
 
@@ -1241,10 +1243,16 @@ void FindReplace::CountAllSearch(QList<SearchEditorModel::searchEntry *> search_
     SetKeyModifiers();
     m_IsSearchGroupRunning = true;
     int count = 0;
-    foreach(SearchEditorModel::searchEntry * search_entry, search_entries) {
-        LoadSearch(search_entry);
-        count += Count();
+
+    if (CanRunSearchGroupInFiles()) {
+        count = CountSearchGroupInFiles(search_entries);
+    } else {
+        foreach(SearchEditorModel::searchEntry * search_entry, search_entries) {
+            LoadSearch(search_entry);
+            count += Count();
+        }
     }
+
     m_IsSearchGroupRunning = false;
 
     if (count == 0) {
@@ -1267,10 +1275,16 @@ void FindReplace::ReplaceAllSearch(QList<SearchEditorModel::searchEntry *> searc
     SetKeyModifiers();
     m_IsSearchGroupRunning = true;
     int count = 0;
-    foreach(SearchEditorModel::searchEntry * search_entry, search_entries) {
-        LoadSearch(search_entry);
-        count += ReplaceAll();
+
+    if (CanRunSearchGroupInFiles()) {
+        count = ReplaceSearchGroupInFiles(search_entries);
+    } else {
+        foreach(SearchEditorModel::searchEntry * search_entry, search_entries) {
+            LoadSearch(search_entry);
+            count += ReplaceAll();
+        }
     }
+
     m_IsSearchGroupRunning = false;
 
     if (count == 0) {
@@ -1284,6 +1298,93 @@ void FindReplace::ReplaceAllSearch(QList<SearchEditorModel::searchEntry *> searc
 }
 
 
+bool FindReplace::CanRunSearchGroupInFiles()
+{
+    // A group can only be run file by file when every search covers
+    // whole files, otherwise the order in which the searches and the
+    // files are visited matters.
+    return !m_SpellCheck &&
+           m_OptionWrap &&
+           !m_LookWhereCurrentFile &&
+           !IsMarkedText() &&
+           (GetLookWhere() == FindReplace::LookWhere_AllHTMLFiles ||
+            GetLookWhere() == FindReplace::LookWhere_SelectedHTMLFiles);
+}
+
+QList<SearchOperations::SearchStep> FindReplace::LoadSearchGroup(QList<SearchEditorModel::searchEntry *> search_entries, QStringList &names)
+{
+    // Load each search in turn so the history and the regex
+    // options are handled exactly like when running them one by one.
+    QList<SearchOperations::SearchStep> steps;
+    foreach(SearchEditorModel::searchEntry * search_entry, search_entries) {
+        LoadSearch(search_entry);
+
+        if (!search_entry || !IsValidFindText()) {
+            continue;
+        }
+
+        SearchOperations::SearchStep step;
+        step.search_regex = GetSearchRegex();
+        step.replacement = ui.cbReplace->lineEdit()->text();
+        steps.append(step);
+        names.append(search_entry->name);
+    }
+    return steps;
+}
+
+int FindReplace::CountSearchGroupInFiles(QList<SearchEditorModel::searchEntry *> search_entries)
+{
+    QStringList names;
+    QList<SearchOperations::SearchStep> steps = LoadSearchGroup(search_entries, names);
+
+    if (steps.isEmpty()) {
+        return 0;
+    }
+
+    SetCodeViewIfNeeded(true);
+    m_MainWindow->GetCurrentContentTab()->SaveTabContent();
+    QList<SearchOperations::StepResult> results = SearchOperations::CountSearchGroupInFiles(steps, GetHTMLFiles());
+    return ShowSearchGroupResults(names, results);
+}
+
+int FindReplace::ReplaceSearchGroupInFiles(QList<SearchEditorModel::searchEntry *> search_entries)
+{
+    QStringList names;
+    QList<SearchOperations::SearchStep> steps = LoadSearchGroup(search_entries, names);
+
+    if (steps.isEmpty()) {
+        return 0;
+    }
+
+    SetCodeViewIfNeeded(true);
+    m_MainWindow->GetCurrentContentTab()->SaveTabContent();
+    QList<SearchOperations::StepResult> results = SearchOperations::ReplaceSearchGroupInFiles(steps, GetHTMLFiles());
+    int count = ShowSearchGroupResults(names, results);
+
+    if (count > 0) {
+        // Signal that the contents have changed and update the view
+        m_MainWindow->GetCurrentBook()->SetModified(true);
+        m_MainWindow->GetCurrentContentTab()->ContentChangedExternally();
+    }
+
+    return count;
+}
+
+int FindReplace::ShowSearchGroupResults(const QStringList &names, const QList<SearchOperations::StepResult> &results)
+{
+    // The totals go in the message, the breakdown per search in its tooltip.
+    int count = 0;
+    QStringList lines;
+
+    for (int i = 0; i < results.count() && i < names.count(); i++) {
+        count += results.at(i).count;
+        lines.append(QString("%1: %2 (%3 ms)").arg(names.at(i)).arg(results.at(i).count).arg(results.at(i).nsecs / 1000000));
+    }
+
+    ui.message->setToolTip(lines.join("\n"));
+    return count;
+}
+
 void FindReplace::SetSearchMode(int search_mode)
 {
     ui.cbSearchMode->setCurrentIndex(0);
@@ -205,6 +205,16 @@ private:
 
     int ReplaceInAllFiles();
 
+    /**
+     * Search groups over whole files are run by SearchOperations in one
+     * pass per file instead of one Count/Replace All per search.
+     */
+    bool CanRunSearchGroupInFiles();
+    QList<SearchOperations::SearchStep> LoadSearchGroup(QList<SearchEditorModel::searchEntry *> search_entries, QStringList &names);
+    int CountSearchGroupInFiles(QList<SearchEditorModel::searchEntry *> search_entries);
+    int ReplaceSearchGroupInFiles(QList<SearchEditorModel::searchEntry *> search_entries);
+    int ShowSearchGroupResults(const QStringList &names, const QList<SearchOperations::StepResult> &results);
+
     bool FindInAllFiles(Searchable::Direction direction);
 
     HTMLResource *GetNextContainingHTMLResource(Searchable::Direction direction);
@@ -315,9 +325,9 @@ bool FindReplace::ResourceContainsCurrentRegex(T *resource)
     // For now, this must hold
     Q_ASSERT(GetLookWhere() == FindReplace::LookWhere_AllHTMLFiles || GetLookWhere() == FindReplace::LookWhere_SelectedHTMLFiles);
     Resource *generic_resource = resource;
-    return SearchOperations::CountInFiles(
+    return SearchOperations::CountInFile(
                GetSearchRegex(),
-               QList<Resource *>() << generic_resource,
+               generic_resource,
                SearchOperations::CodeViewSearch,
                m_SpellCheck) > 0;
 }
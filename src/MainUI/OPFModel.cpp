@@ -330,6 +330,7 @@ bool OPFModel:: RenameResourceList(QList<Resource *> resources, QList<QString> n
     QApplication::setOverrideCursor(Qt::WaitCursor);
     QStringList not_renamed;
     QHash<QString, QString> update;
+    QStringList old_filenames;
     foreach(Resource * resource, resources) {
         const QString &old_bookrelpath = resource->GetRelativePathToRoot();
         QString old_filename = resource->Filename();
@@ -360,10 +361,20 @@ bool OPFModel:: RenameResourceList(QList<Resource *> resources, QList<QString> n
         }
 
         update[ old_bookrelpath ] = "../" + resource->GetRelativePathToOEBPS();
+        old_filenames.append(old_filename);
     }
 
     if (update.count() > 0) {
-        UniversalUpdates::PerformUniversalUpdates(true, m_Book->GetFolderKeeper()->GetResourceList(), update);
+        // Only the files that still reference an old name need rewriting.
+        // Renames stay in the same folder so the renamed files' own links are unaffected.
+        QList<Resource *> resources_to_update = m_Book->GetResourcesReferencing(old_filenames);
+        resources_to_update.append(m_Book->GetOPF());
+
+        if (m_Book->GetNCX()) {
+            resources_to_update.append(m_Book->GetNCX());
+        }
+
+        UniversalUpdates::PerformUniversalUpdates(true, resources_to_update, update);
         emit BookContentModified();
     }
 
@@ -21,6 +21,10 @@
 **
 *************************************************************************/
 
+#include <algorithm>
+
+#include <QtCore/QHash>
+#include <QtCore/QPair>
 #include <QRegularExpression>
 
 #include "Misc/CSSInfo.h"
@@ -28,6 +32,113 @@
 const int TAB_SPACES_WIDTH = 4;
 const QString LINE_MARKER("[SIGIL_NEWLINE]");
 
+// The positions of all line feeds in the text, in order, so
+// the line of any position can be found with a binary search.
+static QVector<int> LineFeedPositions(const QString &text)
+{
+    QVector<int> positions;
+    const QChar *chars = text.constData();
+    const int length = text.length();
+
+    for (int i = 0; i < length; i++) {
+        if (chars[i] == QChar('\n')) {
+            positions.append(i);
+        }
+    }
+
+    return positions;
+}
+
+// The number of line feeds at or before the position
+static int LineFeedsUpTo(const QVector<int> &line_feeds, int pos)
+{
+    return std::upper_bound(line_feeds.constBegin(), line_feeds.constEnd(), pos) - line_feeds.constBegin();
+}
+
+// Whitespace as matched by \s
+static bool IsSpaceChar(QChar c)
+{
+    ushort u = c.unicode();
+    return u == ' ' || u == '\t' || u == '\n' || u == '\r' || u == '\f' || u == '\v';
+}
+
+static bool IsNameChar(QChar c)
+{
+    ushort u = c.unicode();
+    return (u >= 'A' && u <= 'Z') || (u >= 'a' && u <= 'z') || (u >= '0' && u <= '9') ||
+           u == '_' || u == '-' || u == '.' || u == ':';
+}
+
+// Splits a single selector (no commas) into the element and class
+// names it mentions. Attribute selectors and ids are dropped, and
+// combinators and other punctuation separate the compound parts.
+static void ParseSelectorNames(const QString &selector_text, QStringList &element_names, QStringList &class_names)
+{
+    // First drop the attribute selectors. Everything from a "[" up to
+    // the next "]" goes; a "[" without a closing "]" is left alone.
+    QString text;
+    text.reserve(selector_text.length());
+    int pos = 0;
+
+    while (pos < selector_text.length()) {
+        int open_bracket = selector_text.indexOf(QChar('['), pos);
+        int close_bracket = open_bracket < 0 ? -1 : selector_text.indexOf(QChar(']'), open_bracket + 1);
+
+        if (close_bracket < 0) {
+            text.append(selector_text.midRef(pos));
+            break;
+        }
+
+        text.append(selector_text.midRef(pos, open_bracket - pos));
+        pos = close_bracket + 1;
+    }
+
+    // Then split what's left into compound parts, dropping any "#id".
+    QString part;
+    const int length = text.length();
+    int i = 0;
+
+    while (i <= length) {
+        QChar c = i < length ? text.at(i) : QChar(' ');
+
+        if (c == QChar('#') && i + 1 < length && !IsSpaceChar(text.at(i + 1)) && text.at(i + 1) != QChar('.')) {
+            i++;
+
+            while (i < length && !IsSpaceChar(text.at(i)) && text.at(i) != QChar('.')) {
+                i++;
+            }
+
+            continue;
+        }
+
+        if (IsNameChar(c)) {
+            part.append(c);
+            i++;
+            continue;
+        }
+
+        if (!part.isEmpty()) {
+            if (part.contains(QChar('.'))) {
+                QStringList parts = part.split('.');
+
+                if (!parts.at(0).isEmpty()) {
+                    element_names.append(parts.at(0));
+                }
+
+                for (int j = 1; j < parts.length(); j++) {
+                    class_names.append(parts.at(j));
+                }
+            } else {
+                element_names.append(part);
+            }
+
+            part.clear();
+        }
+
+        i++;
+    }
+}
+
 CSSInfo::CSSInfo(const QString &text, bool isCSSFile)
     : m_OriginalText(text),
       m_IsCSSFile(isCSSFile)
@@ -40,12 +151,20 @@ CSSInfo::CSSInfo(const QString &text, bool isCSSFile)
         int style_end = -1;
         int offset = 0;
 
+        QVector<int> line_feeds = LineFeedPositions(text);
+
         while (findInlineStyleBlock(text, offset, style_start, style_end)) {
-            int line = text.left(style_start).count(QChar('\n'));
+            int line = LineFeedsUpTo(line_feeds, style_start - 1);
             parseCSSSelectors(text.mid(style_start, style_end - style_start), line, style_start);
             offset = style_end;
         }
     }
+
+    m_CSSSelectors.reserve(m_SelectorStorage.count());
+
+    for (int i = 0; i < m_SelectorStorage.count(); i++) {
+        m_CSSSelectors.append(&m_SelectorStorage[i]);
+    }
 }
 
 QList<CSSInfo::CSSSelector *> CSSInfo::getClassSelectors(const QString filterClassName)
@@ -198,14 +317,20 @@ QString CSSInfo::getReformattedCSSText(bool multipleLineFormat)
 QString CSSInfo::removeMatchingSelectors(QList<CSSSelector *> cssSelectors)
 {
     // First try to find a CSS selector currently parsed that matches each of the selectors supplied.
+    QHash<QPair<int, QString>, CSSSelector *> selectors_by_line;
+    foreach(CSSSelector * match_selector, m_CSSSelectors) {
+        QPair<int, QString> key(match_selector->line, match_selector->groupText);
+
+        if (!selectors_by_line.contains(key)) {
+            selectors_by_line.insert(key, match_selector);
+        }
+    }
     QList<CSSSelector *> remove_selectors;
     foreach(CSSSelector * css_selector, cssSelectors) {
-        foreach(CSSSelector * match_selector, m_CSSSelectors) {
-            if ((match_selector->line == css_selector->line) &&
-                (match_selector->groupText == css_selector->groupText)) {
-                remove_selectors.append(match_selector);
-                break;
-            }
+        CSSSelector *match_selector = selectors_by_line.value(qMakePair(css_selector->line, css_selector->groupText));
+
+        if (match_selector) {
+            remove_selectors.append(match_selector);
         }
     }
 
@@ -359,10 +484,8 @@ bool CSSInfo::findInlineStyleBlock(const QString &text, const int &offset, int &
 
 void CSSInfo::parseCSSSelectors(const QString &text, const int &offsetLines, const int &offsetPos)
 {
-    QRegularExpression strip_attributes_regex("\\[[^\\]]*\\]");
-    QRegularExpression strip_ids_regex("#[^\\s\\.]+");
-    QRegularExpression strip_non_name_chars_regex("[^A-Za-z0-9_\\-\\.:]+");
     QString search_text = replaceBlockComments(text);
+    QVector<int> line_feeds = LineFeedPositions(search_text);
     // CSS selectors can be in a myriad of formats... the class based selectors could be:
     //    .c1 / e1.c1 / e1.c1.c2 / e1[class~=c1] / e1#id1.c1 / e1.c1#id1 / .c1, .c2 / ...
     // Then the element based selectors could be:
@@ -411,43 +534,22 @@ void CSSInfo::parseCSSSelectors(const QString &text, const int &offsetLines, con
             pos++;
         }
 
-        int line = search_text.left(pos + 1).count(QChar('\n')) + 1;
+        int line = LineFeedsUpTo(line_feeds, pos) + 1;
         QString selector_text = search_text.mid(pos, open_brace_pos - pos).trimmed();
         // Handle case of a selector group containing multiple declarations
         QStringList matches = selector_text.split(QChar(','), QString::SkipEmptyParts);
         foreach(QString match, matches) {
-            CSSSelector *selector = new CSSSelector();
-            selector->originalText = selector_text;
-            selector->groupText = match.trimmed();
-            selector->position = pos + offsetPos;
-            selector->line = line + offsetLines;
-            selector->isGroup = matches.length() > 1;
-            selector->openingBracePos = open_brace_pos + offsetPos;
-            selector->closingBracePos = close_brace_pos + offsetPos;
+            m_SelectorStorage.append(CSSSelector());
+            CSSSelector &selector = m_SelectorStorage.last();
+            selector.originalText = selector_text;
+            selector.groupText = match.trimmed();
+            selector.position = pos + offsetPos;
+            selector.line = line + offsetLines;
+            selector.isGroup = matches.length() > 1;
+            selector.openingBracePos = open_brace_pos + offsetPos;
+            selector.closingBracePos = close_brace_pos + offsetPos;
             // Need to parse our selector text to determine what sort of selector it contains.
-            // First strip out any attributes and then identifiers
-            match.replace(strip_attributes_regex, "");
-            match.replace(strip_ids_regex, "");
-            // Also replace any other characters like > or + not of interest
-            match.replace(strip_non_name_chars_regex, QChar(' '));
-            // Now break it down into the element components
-            QStringList elements = match.trimmed().split(QChar(' '), QString::SkipEmptyParts);
-            foreach(QString element, elements) {
-                if (element.contains(QChar('.'))) {
-                    QStringList parts = element.split('.');
-
-                    if (!parts.at(0).isEmpty()) {
-                        selector->elementNames.append(parts.at(0));
-                    }
-
-                    for (int i = 1; i < parts.length(); i++) {
-                        selector->classNames.append(parts.at(i));
-                    }
-                } else {
-                    selector->elementNames.append(element);
-                }
-            }
-            m_CSSSelectors.append(selector);
+            ParseSelectorNames(match, selector.elementNames, selector.classNames);
         }
         pos = open_brace_pos + 1;
     }
@@ -459,35 +561,33 @@ QString CSSInfo::replaceBlockComments(const QString &text)
     // However we must be careful to replace with spaces/keep line feeds
     // so that do not corrupt the position information used by the parser.
     QString new_text(text);
-    QRegularExpression comment_search("/\\*.*\\*/", QRegularExpression::InvertedGreedinessOption|QRegularExpression::DotMatchesEverythingOption);
     int start = 0;
-    int comment_index;
 
     while (true) {
-        int comment_len = 0;
-        comment_index = -1;
-        QRegularExpressionMatch match = comment_search.match(new_text, start);
-        if (match.hasMatch()) {
-            comment_index = match.capturedStart();
-            comment_len = match.capturedLength();
-        }
+        int comment_index = new_text.indexOf("/*", start);
 
         if (comment_index < 0) {
             break;
         }
 
-        QString match_text = new_text.mid(comment_index, comment_len);
-        match_text.replace(QRegularExpression("[^\r\n]"), QChar(' '));
-        new_text.remove(comment_index, match_text.length());
-        new_text.insert(comment_index, match_text);
-        // Prepare for the next comment.
-        start = comment_index + comment_len;
+        int comment_end = new_text.indexOf("*/", comment_index + 2);
 
-        if (start >= new_text.length() - 2) {
+        if (comment_end < 0) {
             break;
         }
+
+        comment_end += 2;
+        QChar *chars = new_text.data();
+
+        for (int i = comment_index; i < comment_end; i++) {
+            if (chars[i] != QChar('\r') && chars[i] != QChar('\n')) {
+                chars[i] = QChar(' ');
+            }
+        }
+
+        // Prepare for the next comment.
+        start = comment_end;
     }
 
     return new_text;
 }
-
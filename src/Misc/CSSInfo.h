@@ -27,6 +27,7 @@
 
 #include <QtCore/QObject>
 #include <QtCore/QStringList>
+#include <QtCore/QVector>
 
 class QStringList;
 
@@ -102,6 +103,12 @@ private:
     void parseCSSSelectors(const QString &text, const int &offsetLines, const int &offsetPos);
     QString replaceBlockComments(const QString &text);
 
+    /**
+     * The parsed selectors, stored by value in one block.
+     * m_CSSSelectors points into it and is only filled once
+     * parsing is done and the storage can no longer move.
+     */
+    QVector<CSSSelector> m_SelectorStorage;
     QList<CSSSelector *> m_CSSSelectors;
     QString m_OriginalText;
     bool m_IsCSSFile;
@@ -55,45 +55,16 @@ QByteArray AdobeKeyFromIdentifier(const QString &identifier)
 }
 
 
-void IdpfObfuscate(const QString &filepath, const QString &identifier)
+QByteArray RepeatKey(const QByteArray &key, int num_bytes)
 {
-    QFile file(filepath);
-
-    if (!file.open(QFile::ReadWrite)) {
-        return;
-    }
-
-    QByteArray contents = file.readAll();
-    QByteArray key = IdpfKeyFromIdentifier(identifier);
-    int key_size   = key.size();
+    QByteArray mask(num_bytes, Qt::Uninitialized);
+    int key_size = key.size();
 
-    for (int i = 0; (i < IDPF_METHOD_NUM_BYTES) && (i < contents.size()); ++i) {
-        contents[ i ] = contents[ i ] ^ key[ i % key_size ];
+    for (int i = 0; i < num_bytes; ++i) {
+        mask[ i ] = key[ i % key_size ];
     }
 
-    file.seek(0);
-    file.write(contents);
-}
-
-
-void AdobeObfuscate(const QString &filepath, const QString &identifier)
-{
-    QFile file(filepath);
-
-    if (!file.open(QFile::ReadWrite)) {
-        return;
-    }
-
-    QByteArray contents = file.readAll();
-    QByteArray key = AdobeKeyFromIdentifier(identifier);
-    int key_size   = key.size();
-
-    for (int i = 0; (i < ADOBE_METHOD_NUM_BYTES) && (i < contents.size()); ++i) {
-        contents[ i ] = contents[ i ] ^ key[ i % key_size ];
-    }
-
-    file.seek(0);
-    file.write(contents);
+    return mask;
 }
 
 };
@@ -110,14 +81,52 @@ void FontObfuscation::ObfuscateFile(const QString &filepath,
         throw(FontObfuscationError(msg));
     }
 
+    QByteArray mask = ObfuscationMask(algorithm, identifier);
+    QFile file(filepath);
+
+    if (!file.open(QFile::ReadWrite)) {
+        return;
+    }
+
+    // The rest of the font is not touched by either method.
+    QByteArray header = file.read(mask.size());
+    ApplyMask(header, mask);
+    file.seek(0);
+    file.write(header);
+}
+
+
+QByteArray FontObfuscation::ObfuscationMask(const QString &algorithm,
+                                            const QString &identifier)
+{
+    QByteArray key;
+    int num_bytes = 0;
+
     if (algorithm == ADOBE_FONT_ALGO_ID) {
-        AdobeObfuscate(filepath, identifier);
+        key = AdobeKeyFromIdentifier(identifier);
+        num_bytes = ADOBE_METHOD_NUM_BYTES;
     } else if (algorithm == IDPF_FONT_ALGO_ID) {
-        IdpfObfuscate(filepath, identifier);
-    } else {
-        std::string msg = filepath.toStdString() + ": " + algorithm.toStdString() + ": " + identifier.toStdString();
+        key = IdpfKeyFromIdentifier(identifier);
+        num_bytes = IDPF_METHOD_NUM_BYTES;
+    }
+
+    // An identifier Adobe's method can't make a key from ends up here too.
+    if (key.isEmpty() || identifier.isEmpty()) {
+        std::string msg = algorithm.toStdString() + ": " + identifier.toStdString();
         throw(FontObfuscationError(msg));
     }
+
+    return RepeatKey(key, num_bytes);
 }
 
 
+void FontObfuscation::ApplyMask(QByteArray &data, const QByteArray &mask)
+{
+    int num_bytes = qMin(data.size(), mask.size());
+    char *bytes = data.data();
+    const char *mask_bytes = mask.constData();
+
+    for (int i = 0; i < num_bytes; ++i) {
+        bytes[ i ] ^= mask_bytes[ i ];
+    }
+}
@@ -23,13 +23,25 @@
 #ifndef FONTOBFUSCATION_H
 #define FONTOBFUSCATION_H
 
+class QByteArray;
 class QString;
 
 namespace FontObfuscation
 {
+// Obfuscates (or deobfuscates) the font file in place.
+// Only the start of the file that the algorithm covers is rewritten.
 void ObfuscateFile(const QString &filepath,
                    const QString &algorithm,
                    const QString &identifier);
+
+// Returns the bytes the start of a font is XORed with
+// to obfuscate (or deobfuscate) it.
+QByteArray ObfuscationMask(const QString &algorithm,
+                           const QString &identifier);
+
+// XORs the start of the font data with a mask
+// returned by ObfuscationMask().
+void ApplyMask(QByteArray &data, const QByteArray &mask);
 }
 
 #endif // FONTOBFUSCATION_H
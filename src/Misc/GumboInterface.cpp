@@ -80,7 +80,7 @@ static const QChar POUND_SIGN    = QChar::fromLatin1('#');
 static const QChar FORWARD_SLASH = QChar::fromLatin1('/');
 static const std::string SRC = std::string("src");
 static const std::string HREF = std::string("href");
-static QHash<QString,QString> EmptyHash = QHash<QString,QString>();
+static const std::string XML_DECLARATION = std::string("<?xml version=\"1.0\" encoding=\"utf-8\"?>\n");
 
 // These need to match the GumboAttributeNamespaceEnum sequence
 static const char * attribute_nsprefixes[4] = { "", "xlink:", "xml:", "xmlns:" };
@@ -98,11 +98,13 @@ static const char * attribute_nsprefixes[4] = { "", "xlink:", "xml:", "xmlns:" }
 GumboInterface::GumboInterface(const QString &source)
         : m_source(source),
           m_output(NULL),
-          m_sourceupdates(EmptyHash),
+          m_arena(NULL),
+          m_sourceupdates(QHash<QString,QString>()),
           m_newcsslinks(""),
           m_currentdir(""),
           m_utf8src(""),
-          m_newbody("")
+          m_newbody(""),
+          m_addeddoctype(false)
 {
 }
 
@@ -114,6 +116,11 @@ GumboInterface::~GumboInterface()
         m_output = NULL;
         m_utf8src = "";
     }
+    // the whole tree was allocated from the arena so this releases it at once
+    if (m_arena != NULL) {
+        gumbo_arena_destroy(m_arena);
+        m_arena = NULL;
+    }
 }
 
 
@@ -130,6 +137,8 @@ void GumboInterface::parse()
         GumboOptions myoptions = kGumboDefaultOptions;
         myoptions.use_xhtml_rules = true;
         myoptions.tab_stop = 4;
+        m_arena = gumbo_arena_create(0);
+        myoptions.arena = m_arena;
         m_output = gumbo_parse_with_options(&myoptions, m_utf8src.data(), m_utf8src.length());
     }
 }
@@ -142,8 +151,9 @@ QString GumboInterface::repair()
         if (m_output == NULL) {
             parse();
         }
-        std::string utf8out = serialize(m_output->document);
-        result =  "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n" + QString::fromStdString(utf8out);
+        std::string utf8out = start_output();
+        serialize(m_output->document, utf8out);
+        result = QString::fromStdString(utf8out);
     }
     return result;
 }
@@ -156,8 +166,9 @@ QString GumboInterface::getxhtml()
         if (m_output == NULL) {
             parse();
         }
-        std::string utf8out = serialize(m_output->document);
-        result =  "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n" + QString::fromStdString(utf8out);
+        std::string utf8out = start_output();
+        serialize(m_output->document, utf8out);
+        result = QString::fromStdString(utf8out);
     }
     return result;
 }
@@ -171,8 +182,9 @@ QString GumboInterface::prettyprint(QString indent_chars)
             parse();
         }
         std::string ind = indent_chars.toStdString();
-        std::string utf8out = prettyprint(m_output->document, 0, ind);
-        result =  "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n" + QString::fromStdString(utf8out);
+        std::string utf8out = start_output();
+        prettyprint(m_output->document, 0, ind, utf8out);
+        result = QString::fromStdString(utf8out);
     }
     return result;
 }
@@ -201,8 +213,28 @@ QString GumboInterface::perform_source_updates(const QHash<QString, QString>& up
             parse();
         }
         enum UpdateTypes doupdates = SourceUpdates;
-        std::string utf8out = serialize(m_output->document, doupdates);
-        result =  "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n" + QString::fromStdString(utf8out);
+        std::string utf8out = start_output();
+        serialize(m_output->document, utf8out, doupdates);
+        result = QString::fromStdString(utf8out);
+    }
+    return result;
+}
+
+
+QString GumboInterface::prettyprint_source_updates(const QHash<QString, QString>& updates, const QString& my_current_book_relpath, QString indent_chars)
+{
+    m_sourceupdates = updates;
+    m_currentdir = QFileInfo(my_current_book_relpath).dir().path();
+    QString result = "";
+    if (!m_source.isEmpty()) {
+        if (m_output == NULL) {
+            parse();
+        }
+        enum UpdateTypes doupdates = SourceUpdates;
+        std::string ind = indent_chars.toStdString();
+        std::string utf8out = start_output();
+        prettyprint(m_output->document, 0, ind, utf8out, doupdates);
+        result = QString::fromStdString(utf8out);
     }
     return result;
 }
@@ -217,8 +249,9 @@ QString GumboInterface::perform_link_updates(const QString& newcsslinks)
             parse();
         }
         enum UpdateTypes doupdates = LinkUpdates;
-        std::string utf8out = serialize(m_output->document, doupdates);
-        result =  "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n" + QString::fromStdString(utf8out);
+        std::string utf8out = start_output();
+        serialize(m_output->document, utf8out, doupdates);
+        result = QString::fromStdString(utf8out);
     }
     return result;
 }
@@ -247,7 +280,9 @@ QString GumboInterface::get_body_contents()
         return QString();
     }
     enum UpdateTypes doupdates = NoUpdates;
-    std::string results = serialize_contents(nodes.at(0), doupdates);
+    std::string results;
+    results.reserve(m_utf8src.length());
+    serialize_contents(nodes.at(0), results, doupdates);
     return QString::fromStdString(results);
 }
 
@@ -388,13 +423,20 @@ QString GumboInterface::perform_body_updates(const QString & new_body)
     }
     m_newbody = new_body.toStdString();
     enum UpdateTypes doupdates = BodyUpdates;
-    std::string utf8out = serialize_contents(m_output->document, doupdates);
-    result =  "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n" + QString::fromStdString(utf8out);
+    std::string utf8out = start_output(m_newbody.length());
+    serialize_contents(m_output->document, utf8out, doupdates);
+    result = QString::fromStdString(utf8out);
     m_newbody= "";
     return result;
 }
     
 
+bool GumboInterface::error_check_added_doctype()
+{
+    return m_addeddoctype;
+}
+
+
 QList<GumboWellFormedError> GumboInterface::error_check()
 {
     QList<GumboWellFormedError> errlist;
@@ -418,7 +460,10 @@ QList<GumboWellFormedError> GumboInterface::error_check()
         if ((m_utf8src.compare(0,9,"<!DOCTYPE") != 0) && (m_utf8src.compare(0,9,"<!doctype") != 0)) {
             m_utf8src.insert(0,"<!DOCTYPE html>\n");
             line_offset--;
+            m_addeddoctype = true;
         }
+        m_arena = gumbo_arena_create(0);
+        myoptions.arena = m_arena;
         m_output = gumbo_parse_with_options(&myoptions, m_utf8src.data(), m_utf8src.length());
     }
     const GumboVector* errors  = &m_output->errors;
@@ -589,24 +634,6 @@ bool GumboInterface::in_set(std::unordered_set<std::string> &s, std::string &key
 }
 
 
-void GumboInterface::rtrim(std::string &s) 
-{
-    s.erase(s.find_last_not_of(" \n\r\t\v\f")+1);
-}
-
-
-void GumboInterface::ltrim(std::string &s)
-{
-    s.erase(0,s.find_first_not_of(" \n\r\t\v\f"));
-}
-
-
-void GumboInterface::ltrimnewlines(std::string &s)
-{
-    s.erase(0,s.find_first_not_of("\n\r"));
-}
-
-
 // delete everything up to and including the newline
 void GumboInterface::newlinetrim(std::string &s)
 {
@@ -617,18 +644,6 @@ void GumboInterface::newlinetrim(std::string &s)
 }
 
 
-void GumboInterface::replace_all(std::string &s, const char * s1, const char * s2)
-{
-    std::string t1(s1);
-    size_t len = t1.length();
-    size_t pos = s.find(t1);
-    while (pos != std::string::npos) {
-      s.replace(pos, len, s2);
-      pos = s.find(t1, pos + len);
-    }
-}
-
-
 std::string GumboInterface::update_attribute_value(std::string attvalue)
 {
     std::string result = attvalue; 
@@ -651,26 +666,38 @@ std::string GumboInterface::update_attribute_value(std::string attvalue)
 }
 
 
-std::string GumboInterface::substitute_xml_entities_into_text(const std::string &text)
+// escape the xml special characters of text in one pass while appending it
+// quote is the attribute value delimiter to escape as well (if any)
+void GumboInterface::append_escaped(const char *text, std::string &out, char quote)
 {
-    std::string result = text;
-    // replacing & must come first 
-    replace_all(result, "&", "&amp;");
-    replace_all(result, "<", "&lt;");
-    replace_all(result, ">", "&gt;");
-    return result;
+    const char *run = text;
+    const char *p = text;
+    for (; *p; ++p) {
+        const char *entity;
+        switch (*p) {
+            case '&':  entity = "&amp;";  break;
+            case '<':  entity = "&lt;";   break;
+            case '>':  entity = "&gt;";   break;
+            case '"':  entity = "&quot;"; if (quote != '"')  continue; break;
+            case '\'': entity = "&apos;"; if (quote != '\'') continue; break;
+            default: continue;
+        }
+        out.append(run, p - run);
+        out.append(entity);
+        run = p + 1;
+    }
+    out.append(run, p - run);
 }
 
 
-std::string GumboInterface::substitute_xml_entities_into_attributes(char quote, const std::string &text)
+// the serializers all append to one output buffer that starts with
+// the xml declaration and is sized to hold the whole document
+std::string GumboInterface::start_output(size_t extra)
 {
-    std::string result = substitute_xml_entities_into_text(text);
-    if (quote == '"') {
-        replace_all(result,"\"","&quot;");
-    } else if (quote == '\'') {
-        replace_all(result,"'","&apos;");
-    }
-    return result;
+    std::string out;
+    out.reserve(XML_DECLARATION.length() + m_utf8src.length() + m_utf8src.length() / 4 + extra);
+    out.append(XML_DECLARATION);
+    return out;
 }
 
 
@@ -749,55 +776,66 @@ std::string GumboInterface::get_attribute_name(GumboAttribute * at)
 }
 
 
-std::string GumboInterface::build_attributes(GumboAttribute * at, bool no_entities, bool runupdates)
+void GumboInterface::build_attributes(GumboAttribute * at, bool no_entities, bool runupdates, std::string &out)
 {
-    std::string atts = " ";
-    std::string name = get_attribute_name(at);
+    out.append(" ");
+    out.append(get_attribute_name(at));
     std::string local_name = at->name;
-    atts.append(name);
-    std::string attvalue = at->value;
+    const char * attvalue = at->value;
+    std::string updated_value;
 
     if (runupdates && (local_name == HREF || local_name == SRC)) {
-        attvalue = update_attribute_value(attvalue);
+        updated_value = update_attribute_value(attvalue);
+        attvalue = updated_value.c_str();
     }
 
     // we handle empty attribute values like so: alt=""
     char quote = '"';
-    std::string qs="\"";
+    const char * qs = "\"";
 
-    if ( (!attvalue.empty())   || 
+    if ( (attvalue[0] != '\0')   || 
          (at->original_value.data[0] == '"') || 
          (at->original_value.data[0] == '\'') ) {
 
       // determine original quote character used if it exists
       quote = at->original_value.data[0];
-      if (quote == '\'') qs = std::string("'");
-      if (quote == '"') qs = std::string("\"");
+      if (quote == '\'') qs = "'";
+      if (quote == '"') qs = "\"";
     }
 
-    atts.append("=");
-    atts.append(qs);
+    out.append("=");
+    out.append(qs);
     if (no_entities) {
-        atts.append(attvalue);
+        out.append(attvalue);
+    } else {
+        append_escaped(attvalue, out, quote);
+    }
+    out.append(qs);
+}
+
+
+// erase any trailing whitespace appended to out since position start
+void GumboInterface::rtrim_from(std::string &out, size_t start)
+{
+    size_t last = out.find_last_not_of(" \n\r\t\v\f");
+    if ((last == std::string::npos) || (last < start)) {
+        out.erase(start);
     } else {
-        atts.append(substitute_xml_entities_into_attributes(quote, attvalue));
+        out.erase(last + 1);
     }
-    atts.append(qs);
-    return atts;
 }
 
 
 // serialize children of a node
 // may be invoked recursively
 
-std::string GumboInterface::serialize_contents(GumboNode* node, enum UpdateTypes doupdates) {
-    std::string contents        = "";
+void GumboInterface::serialize_contents(GumboNode* node, std::string &out, enum UpdateTypes doupdates) {
     std::string tagname         = get_tag_name(node);
     bool no_entity_substitution = in_set(no_entity_sub, tagname);
     bool keep_whitespace        = in_set(preserve_whitespace, tagname);
     bool is_inline              = in_set(nonbreaking_inline, tagname);
 
-    // build up result for each child, recursively if need be
+    // append the result for each child, recursively if need be
     GumboVector* children = &node->v.element.children;
 
     bool inject_newline = false;
@@ -808,17 +846,17 @@ std::string GumboInterface::serialize_contents(GumboNode* node, enum UpdateTypes
         if (child->type == GUMBO_NODE_TEXT) {
             inject_newline = false;
             if (no_entity_substitution) {
-                contents.append(std::string(child->v.text.text));
+                out.append(child->v.text.text);
             } else {
-                contents.append(substitute_xml_entities_into_text(std::string(child->v.text.text)));
+                append_escaped(child->v.text.text, out);
             }
 
         } else if (child->type == GUMBO_NODE_ELEMENT || child->type == GUMBO_NODE_TEMPLATE) {
-            contents.append(serialize(child, doupdates));
+            serialize(child, out, doupdates);
             inject_newline = false;
             std::string childname = get_tag_name(child);
             if (!is_inline && !keep_whitespace && !in_set(nonbreaking_inline,childname)) {
-                contents.append("\n");
+                out.append("\n");
                 inject_newline = true;
             }
 
@@ -829,15 +867,19 @@ std::string GumboInterface::serialize_contents(GumboNode* node, enum UpdateTypes
                 newlinetrim(wspace);
                 inject_newline = false;
             }
-            contents.append(wspace);
+            out.append(wspace);
             inject_newline = false;
 
         } else if (child->type == GUMBO_NODE_CDATA) {
-            contents.append("<![CDATA[" + std::string(child->v.text.text) + "]]>");
+            out.append("<![CDATA[");
+            out.append(child->v.text.text);
+            out.append("]]>");
             inject_newline = false;
 
         } else if (child->type == GUMBO_NODE_COMMENT) {
-            contents.append("<!--" + std::string(child->v.text.text) + "-->");
+            out.append("<!--");
+            out.append(child->v.text.text);
+            out.append("-->");
  
         } else {
             fprintf(stderr, "unknown element of type: %d\n", child->type); 
@@ -845,94 +887,82 @@ std::string GumboInterface::serialize_contents(GumboNode* node, enum UpdateTypes
         }
 
     }
-
-    return contents;
 }
 
 
 // serialize a GumboNode back to html/xhtml
 // may be invoked recursively
 
-std::string GumboInterface::serialize(GumboNode* node, enum UpdateTypes doupdates) {
+void GumboInterface::serialize(GumboNode* node, std::string &out, enum UpdateTypes doupdates) {
     // special case the document node
     if (node->type == GUMBO_NODE_DOCUMENT) {
-        std::string results = build_doctype(node);
-        results.append(serialize_contents(node, doupdates));
-        return results;
+        out.append(build_doctype(node));
+        serialize_contents(node, out, doupdates);
+        return;
     }
 
-    std::string close = "";
-    std::string closeTag = "";
-    std::string atts = "";
     std::string tagname            = get_tag_name(node);
     bool need_special_handling     = in_set(special_handling, tagname);
     bool is_empty_tag              = in_set(empty_tags, tagname);
     bool no_entity_substitution    = in_set(no_entity_sub, tagname);
-    bool is_inline                 = in_set(nonbreaking_inline, tagname);
     bool is_href_src_tag           = in_set(href_src_tags, tagname);
 
+    if ((doupdates & LinkUpdates) && (tagname == "link") && 
+        (node->parent->type == GUMBO_NODE_ELEMENT) && 
+        (node->parent->v.element.tag == GUMBO_TAG_HEAD)) {
+      return;
+    }
+
+    out.append("<" + tagname);
+
     // build attr string  
     const GumboVector * attribs = &node->v.element.attributes;
     for (int i=0; i< attribs->length; ++i) {
         GumboAttribute* at = static_cast<GumboAttribute*>(attribs->data[i]);
-        atts.append(build_attributes(at, no_entity_substitution, ((doupdates & SourceUpdates) && is_href_src_tag) ));
+        build_attributes(at, no_entity_substitution, ((doupdates & SourceUpdates) && is_href_src_tag), out);
     }
 
     // determine closing tag type
-    if (is_empty_tag) {
-        close = "/";
-    } else {
-        closeTag = "</" + tagname + ">";
-    }
+    out.append(is_empty_tag ? "/>" : ">");
 
-    std::string contents;
+    if (need_special_handling) out.append("\n");
+
+    size_t contents_start = out.length();
 
     if ((tagname == "body") && (doupdates & BodyUpdates)) {
-        contents = m_newbody;
+        out.append(m_newbody);
     } else {
         // serialize your contents
-        contents = serialize_contents(node, doupdates);
+        serialize_contents(node, out, doupdates);
     }
 
     if (need_special_handling) {
-        ltrimnewlines(contents);
-        rtrim(contents);
-        contents.append("\n");
+        // strip newlines before and whitespace after the contents
+        size_t first = out.find_first_not_of("\n\r", contents_start);
+        out.erase(contents_start, first == std::string::npos ? std::string::npos : first - contents_start);
+        rtrim_from(out, contents_start);
+        out.append("\n");
     }
 
-    // build results
-    std::string results;
-
-    if ((doupdates & LinkUpdates) && (tagname == "link") && 
-        (node->parent->type == GUMBO_NODE_ELEMENT) && 
-        (node->parent->v.element.tag == GUMBO_TAG_HEAD)) {
-      return "";
-    }
-
-    results.append("<"+tagname+atts+close+">");
-    if (need_special_handling) results.append("\n");
-    results.append(contents);
-
     if ((doupdates & LinkUpdates) && (tagname == "head")) {
-        results.append(m_newcsslinks);
+        out.append(m_newcsslinks);
     }
 
-    results.append(closeTag);
-    if (need_special_handling) results.append("\n");
-    return results;
+    if (!is_empty_tag) {
+        out.append("</" + tagname + ">");
+    }
+    if (need_special_handling) out.append("\n");
 }
 
 
 
-std::string GumboInterface::prettyprint_contents(GumboNode* node, int lvl, const std::string indent_chars) 
+void GumboInterface::prettyprint_contents(GumboNode* node, int lvl, const std::string &indent_chars, std::string &out, enum UpdateTypes doupdates) 
 {
-    std::string contents        = "";
     std::string tagname         = get_tag_name(node);
     bool no_entity_substitution = in_set(no_entity_sub, tagname);
     bool keep_whitespace        = in_set(preserve_whitespace, tagname);
     bool is_inline              = in_set(nonbreaking_inline, tagname);
     bool is_structural          = in_set(structural_tags, tagname);
-    bool pp_okay                = !is_inline && !keep_whitespace;
     char c                      = indent_chars.at(0);
     int  n                      = indent_chars.length(); 
 
@@ -943,148 +973,141 @@ std::string GumboInterface::prettyprint_contents(GumboNode* node, int lvl, const
         GumboNode* child = static_cast<GumboNode*> (children->data[i]);
 
         if (child->type == GUMBO_NODE_TEXT) {
-            std::string val;
-
-            if (no_entity_substitution) {
-                val = std::string(child->v.text.text);
-            } else {
-                val = substitute_xml_entities_into_text(std::string(child->v.text.text));
-            }
+            const char * val = child->v.text.text;
 
             // if first child of a structual element is text, indent it properly
             if ((i==0) && is_structural) {
-              std::string indent_space = std::string((lvl-1)*n,c);
-              contents.append(indent_space);
-              ltrim(val);
+              out.append((lvl-1)*n, c);
+              val += strspn(val, " \n\r\t\v\f");
+            }
+
+            if (no_entity_substitution) {
+                out.append(val);
+            } else {
+                append_escaped(val, out);
             }
-            contents.append(val);
 
         } else if (child->type == GUMBO_NODE_ELEMENT || child->type == GUMBO_NODE_TEMPLATE) {
 
-            std::string val = prettyprint(child, lvl, indent_chars);
-            contents.append(val);
+            prettyprint(child, lvl, indent_chars, out, doupdates);
 
         } else if (child->type == GUMBO_NODE_WHITESPACE) {
 
             if (keep_whitespace || is_inline) {
-                std::string wspace = std::string(child->v.text.text);
-                contents.append(wspace);
+                out.append(child->v.text.text);
             }
 
         } else if (child->type == GUMBO_NODE_CDATA) {
-            contents.append("<![CDATA[" + std::string(child->v.text.text) + "]]>");
+            out.append("<![CDATA[");
+            out.append(child->v.text.text);
+            out.append("]]>");
 
         } else if (child->type == GUMBO_NODE_COMMENT) {
-            contents.append("<!--" + std::string(child->v.text.text) + "-->");
+            out.append("<!--");
+            out.append(child->v.text.text);
+            out.append("-->");
  
         } else {
             fprintf(stderr, "unknown element of type: %d\n", child->type); 
         }
 
     }
-
-    return contents;
 }
 
 
 // prettyprint a GumboNode back to html/xhtml
 // may be invoked recursively
 
-std::string GumboInterface::prettyprint(GumboNode* node, int lvl, const std::string indent_chars)
+void GumboInterface::prettyprint(GumboNode* node, int lvl, const std::string &indent_chars, std::string &out, enum UpdateTypes doupdates)
 {
 
     // special case the document node
     if (node->type == GUMBO_NODE_DOCUMENT) {
-      std::string results = build_doctype(node);
-      results.append(prettyprint_contents(node,lvl+1,indent_chars));
-      return results;
+      out.append(build_doctype(node));
+      prettyprint_contents(node,lvl+1,indent_chars,out,doupdates);
+      return;
     }
 
-    std::string close              = "";
-    std::string closeTag           = "";
-    std::string atts               = "";
     std::string tagname            = get_tag_name(node);
     std::string parentname         = get_tag_name(node->parent);
     bool in_head                   = (parentname == "head");
-    bool need_special_handling     = in_set(special_handling, tagname);
     bool is_empty_tag              = in_set(empty_tags, tagname);
     bool no_entity_substitution    = in_set(no_entity_sub, tagname);
     bool keep_whitespace           = in_set(preserve_whitespace, tagname);
     bool is_inline                 = in_set(nonbreaking_inline, tagname) && !in_set(structural_tags, parentname);
     bool is_structural             = in_set(structural_tags, tagname);
     bool pp_okay                   = !is_inline && !keep_whitespace;
+    bool is_href_src_tag           = in_set(href_src_tags, tagname);
     char c                         = indent_chars.at(0);
     int  n                         = indent_chars.length(); 
+    int  indent_len                = (lvl-1)*n;
+
+    if (!is_inline) {
+      out.append(indent_len, c);
+    }
+
+    out.append("<" + tagname);
 
     // build attr string
     const GumboVector * attribs = &node->v.element.attributes;
     for (int i=0; i< attribs->length; ++i) {
         GumboAttribute* at = static_cast<GumboAttribute*>(attribs->data[i]);
-        atts.append(build_attributes(at, no_entity_substitution));
+        build_attributes(at, no_entity_substitution, ((doupdates & SourceUpdates) && is_href_src_tag), out);
     }
 
     // determine closing tag type
-    if (is_empty_tag) {
-        close = "/";
-    } else {
-        closeTag = "</" + tagname + ">";
-    }
+    out.append(is_empty_tag ? "/>" : ">");
 
-    std::string indent_space = std::string((lvl-1)*n,c);
-    std::string contents;
+    // the newline after a structural open tag is only wanted if it ends up
+    // having contents, so add it now and take it back again if not
+    bool newline_after_open = pp_okay && is_structural;
+    if (newline_after_open) {
+        out.append("\n");
+    }
+    size_t contents_start = out.length();
 
     // prettyprint your contents
     if (is_structural && tagname != "html") {
-        contents = prettyprint_contents(node, lvl+1, indent_chars);
+        prettyprint_contents(node, lvl+1, indent_chars, out, doupdates);
     } else {
-        contents = prettyprint_contents(node, lvl, indent_chars);
+        prettyprint_contents(node, lvl, indent_chars, out, doupdates);
     }
 
     if (is_structural) {
-        rtrim(contents);
-        if (!contents.empty()) contents.append("\n");
+        rtrim_from(out, contents_start);
+        if (out.length() > contents_start) out.append("\n");
     }
 
-    char last_char = ' ';
-    if (!contents.empty()) {
-        last_char = contents.at(contents.length()-1);
-    } 
-
-    // build results
-    std::string results;
-
-    if (!is_inline) {
-      results.append(indent_space);
-    }
-
-    results.append("<"+tagname+atts+close+">");
-
-    if (pp_okay && is_structural && !contents.empty()) {
-        results.append("\n");
+    bool has_contents = out.length() > contents_start;
+    if (newline_after_open && !has_contents) {
+        out.erase(contents_start - 1);
     }
 
-    results.append(contents);
+    char last_char = ' ';
+    if (has_contents) {
+        last_char = out.at(out.length()-1);
+    } 
 
-    if (pp_okay && (last_char != '\n') && !contents.empty() && is_structural) {
-        results.append("\n");
+    if (pp_okay && (last_char != '\n') && has_contents && is_structural) {
+        out.append("\n");
     }
 
     // handle any indent before structural close tags
-    if (!is_inline && is_structural && !closeTag.empty() && !contents.empty()) {
-        results.append(indent_space);
+    if (!is_inline && is_structural && !is_empty_tag && has_contents) {
+        out.append(indent_len, c);
     }
 
-    results.append(closeTag);
+    if (!is_empty_tag) {
+        out.append("</" + tagname + ">");
+    }
 
     if (pp_okay) {
         if (!in_head  && tagname != "html") {
-            results.append("\n\n");
+            out.append("\n\n");
         } else {
-            results.append("\n");
+            out.append("\n");
         }
     }
-
-    return results;
 }
 
 
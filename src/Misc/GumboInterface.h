@@ -70,6 +70,7 @@ public:
 
     // routines for updating while serializing (see SourceUpdates and AnchorUpdates
     QString perform_source_updates(const QHash<QString, QString> &updates, const QString & my_current_book_relpath);
+    QString prettyprint_source_updates(const QHash<QString, QString> &updates, const QString & my_current_book_relpath, QString indent_chars="  ");
     QString perform_link_updates(const QString & newlinks);
     QString get_body_contents();
     QString perform_body_updates(const QString & new_body);
@@ -90,6 +91,10 @@ public:
     // routine to check if well-formed
     QList<GumboWellFormedError> error_check();
 
+    // true if error_check() had to add a doctype before parsing, in which
+    // case the tree it left behind should not be serialized
+    bool error_check_added_doctype();
+
 private:
 
     enum UpdateTypes {
@@ -107,47 +112,43 @@ private:
 
     QList<GumboNode*> get_nodes_with_tags(GumboNode* node, const QList<GumboTag> & tags);
 
-    std::string serialize(GumboNode* node, enum UpdateTypes doupdates = NoUpdates);
+    void serialize(GumboNode* node, std::string &out, enum UpdateTypes doupdates = NoUpdates);
+
+    void serialize_contents(GumboNode* node, std::string &out, enum UpdateTypes doupdates = NoUpdates);
 
-    std::string serialize_contents(GumboNode* node, enum UpdateTypes doupdates = NoUpdates);
+    void prettyprint(GumboNode* node, int lvl, const std::string &indent_chars, std::string &out, enum UpdateTypes doupdates = NoUpdates);
 
-    std::string prettyprint(GumboNode* node, int lvl, const std::string indent_chars);
+    void prettyprint_contents(GumboNode* node, int lvl, const std::string &indent_chars, std::string &out, enum UpdateTypes doupdates = NoUpdates);
 
-    std::string prettyprint_contents(GumboNode* node, int lvl, const std::string indent_chars);
+    std::string start_output(size_t extra = 0);
 
     std::string build_doctype(GumboNode *node);
 
     std::string get_attribute_name(GumboAttribute * at);
 
-    std::string build_attributes(GumboAttribute * at, bool no_entities, bool runupdates = false);
+    void build_attributes(GumboAttribute * at, bool no_entities, bool runupdates, std::string &out);
 
     std::string update_attribute_value(std::string href);
 
-    std::string substitute_xml_entities_into_text(const std::string &text);
-
-    std::string substitute_xml_entities_into_attributes(char quote, const std::string &text);
+    void append_escaped(const char *text, std::string &out, char quote = '\0');
 
     bool in_set(std::unordered_set<std::string> &s, std::string &key);
 
-    void rtrim(std::string &s);
-
-    void ltrim(std::string &s);
-
-    void ltrimnewlines(std::string &s);
+    void rtrim_from(std::string &out, size_t start);
 
     void newlinetrim(std::string &s);
 
-    void replace_all(std::string &s, const char * s1, const char * s2);
-
     // QString fix_self_closing_tags(const QString & source);
 
     QString                   m_source;
     GumboOutput*              m_output;
+    GumboArena*               m_arena;
     std::string               m_utf8src;
-    QHash<QString, QString> & m_sourceupdates;
+    QHash<QString, QString>   m_sourceupdates;
     std::string               m_newcsslinks;
     QString                   m_currentdir;
     std::string               m_newbody;
+    bool                      m_addeddoctype;
     
 };
 
@@ -23,6 +23,7 @@
 #include <string>
 
 #include <QtCore/QFile>
+#include <QtCore/QtGlobal>
 #include <QtCore/QString>
 #include <QtCore/QTextCodec>
 #include <QRegularExpression>
@@ -32,12 +33,119 @@
 #include "sigil_constants.h"
 #include "sigil_exception.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SIGIL_UTF8_SSE2
+#endif
+
 
 const QString ENCODING_ATTRIBUTE   = "encoding\\s*=\\s*(?:\"|')([^\"']+)(?:\"|')";
 const QString CHARSET_ATTRIBUTE    = "charset\\s*=\\s*(?:\"|')([^\"']+)(?:\"|')";
 const QString STANDALONE_ATTRIBUTE = "standalone\\s*=\\s*(?:\"|')([^\"']+)(?:\"|')";
 const QString VERSION_ATTRIBUTE    = "version\\s*=\\s*(?:\"|')([^\"']+)(?:\"|')";
 
+// Only this many characters at the start of a file are searched for an encoding.
+const int ENCODING_SEARCH_CHARS = 1024;
+// A UTF-8 character is at most 4 bytes, so this many bytes always hold the characters above.
+const int ENCODING_SEARCH_BYTES = 4 * ENCODING_SEARCH_CHARS;
+
+// Plain text is validated this many bytes at a time.
+const int PLAIN_TEXT_BLOCK_SIZE = 16;
+
+
+static QRegularExpression CompiledRegEx(const QString &pattern)
+{
+    QRegularExpression regex(pattern);
+    regex.optimize();
+    return regex;
+}
+
+
+static inline bool IsPlainTextByte(unsigned char byte)
+{
+    return byte == 0x09 ||
+           byte == 0x0A ||
+           byte == 0x0D ||
+           (0x20 <= byte && byte <= 0x7E);
+}
+
+
+// Returns true if the block contains nothing but tabs,
+// line endings and printable ASCII.
+static inline bool IsPlainTextBlock(const unsigned char *bytes)
+{
+#ifdef SIGIL_UTF8_SSE2
+    const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes));
+    // Compared as signed chars, every byte from 0x80 up is also below 0x20
+    __m128i rejected = _mm_cmplt_epi8(block, _mm_set1_epi8(0x20));
+    const __m128i whitespace = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8(0x09)),
+                                                         _mm_cmpeq_epi8(block, _mm_set1_epi8(0x0A))),
+                                            _mm_cmpeq_epi8(block, _mm_set1_epi8(0x0D)));
+    rejected = _mm_andnot_si128(whitespace, rejected);
+    rejected = _mm_or_si128(rejected, _mm_cmpeq_epi8(block, _mm_set1_epi8(0x7F)));
+    return _mm_movemask_epi8(rejected) == 0;
+#else
+    for (int i = 0; i < PLAIN_TEXT_BLOCK_SIZE; ++i) {
+        if (!IsPlainTextByte(bytes[i])) {
+            return false;
+        }
+    }
+
+    return true;
+#endif
+}
+
+
+// Returns the length of the valid UTF-8 sequence starting at bytes,
+// or 0 if there is none. Bytes past the end of the data are read as 0.
+static inline int Utf8SequenceLength(const unsigned char *bytes, int available)
+{
+    const unsigned char byte0 = bytes[0];
+    const unsigned char byte1 = available > 1 ? bytes[1] : 0;
+    const unsigned char byte2 = available > 2 ? bytes[2] : 0;
+    const unsigned char byte3 = available > 3 ? bytes[3] : 0;
+
+    // ASCII
+    if (IsPlainTextByte(byte0)) {
+        return 1;
+    }
+    // non-overlong 2-byte
+    else if ((0xC2 <= byte0 && byte0 <= 0xDF) &&
+             (0x80 <= byte1 && byte1 <= 0xBF)
+            ) {
+        return 2;
+    } else if ((byte0 == 0xE0                       &&              // excluding overlongs
+                (0xA0 <= byte1 && byte1 <= 0xBF) &&
+                (0x80 <= byte2 && byte2 <= 0xBF)) ||
+               (((0xE1 <= byte0 && byte0 <= 0xEC) ||               // straight 3-byte
+                 byte0 == 0xEE                       ||
+                 byte0 == 0xEF) &&
+                (0x80 <= byte1 && byte1 <= 0xBF) &&
+                (0x80 <= byte2 && byte2 <= 0xBF)) ||
+               (byte0 == 0xED                       &&              // excluding surrogates
+                (0x80 <= byte1 && byte1 <= 0x9F) &&
+                (0x80 <= byte2 && byte2 <= 0xBF))
+              ) {
+        return 3;
+    } else if ((byte0 == 0xF0                       &&              // planes 1-3
+                (0x90 <= byte1 && byte1 <= 0xBF) &&
+                (0x80 <= byte2 && byte2 <= 0xBF) &&
+                (0x80 <= byte3 && byte3 <= 0xBF)) ||
+               ((0xF1 <= byte0 && byte0 <= 0xF3) &&              // planes 4-15
+                (0x80 <= byte1 && byte1 <= 0xBF) &&
+                (0x80 <= byte2 && byte2 <= 0xBF) &&
+                (0x80 <= byte3 && byte3 <= 0xBF)) ||
+               (byte0 == 0xF4                       &&            // plane 16
+                (0x80 <= byte1 && byte1 <= 0x8F) &&
+                (0x80 <= byte2 && byte2 <= 0xBF) &&
+                (0x80 <= byte3 && byte3 <= 0xBF))
+              ) {
+        return 4;
+    }
+
+    return 0;
+}
+
 
 // Accepts a full path to an HTML file.
 // Reads the file, detects the encoding
@@ -52,13 +160,22 @@ QString HTMLEncodingResolver::ReadHTMLFile(const QString &fullfilepath)
         throw (CannotOpenFile(msg));
     }
 
-    QByteArray data = file.readAll();
+    return DecodeHTML(file.readAll());
+}
+
+
+// Accepts the raw bytes of an HTML file,
+// detects the encoding and returns the
+// text converted to Unicode.
+QString HTMLEncodingResolver::DecodeHTML(QByteArray data)
+{
+    const bool is_valid_utf8 = IsValidUtf8(data);
 
-    if (IsValidUtf8(data)) {
+    if (is_valid_utf8) {
         data.replace("\xC2\xA0", "&#160;");
     }
 
-    return Utility::ConvertLineEndings(GetCodecForHTML(data)->toUnicode(data));
+    return Utility::ConvertLineEndings(GetCodecForHTML(data, is_valid_utf8)->toUnicode(data));
 }
 
 
@@ -66,8 +183,10 @@ QString HTMLEncodingResolver::ReadHTMLFile(const QString &fullfilepath)
 // if no encoding is detected, the default codec for this locale is returned.
 // We use this function because Qt's QTextCodec::codecForHtml() function
 // leaves a *lot* to be desired.
-const QTextCodec *HTMLEncodingResolver::GetCodecForHTML(const QByteArray &raw_text)
+const QTextCodec *HTMLEncodingResolver::GetCodecForHTML(const QByteArray &raw_text, bool is_valid_utf8)
 {
+    static const QRegularExpression enc_re = CompiledRegEx(ENCODING_ATTRIBUTE);
+    static const QRegularExpression char_re = CompiledRegEx(CHARSET_ATTRIBUTE);
     unsigned char c1;
     unsigned char c2;
     unsigned char c3;
@@ -102,10 +221,10 @@ const QTextCodec *HTMLEncodingResolver::GetCodecForHTML(const QByteArray &raw_te
     }
 
     // Try to find an ecoding specified in the file itself.
-    text = Utility::Substring(0, 1024, raw_text);
+    // Only the start of the file is decoded to search it.
+    text = QString::fromUtf8(raw_text.constData(), qMin(raw_text.size(), ENCODING_SEARCH_BYTES)).left(ENCODING_SEARCH_CHARS);
 
     // Check if the xml encoding attribute is set.
-    QRegularExpression enc_re(ENCODING_ATTRIBUTE);
     QRegularExpressionMatch enc_mo = enc_re.match(text);
     if (enc_mo.hasMatch()) {
         codec = QTextCodec::codecForName(enc_mo.captured(1).toLatin1().toUpper());
@@ -115,7 +234,6 @@ const QTextCodec *HTMLEncodingResolver::GetCodecForHTML(const QByteArray &raw_te
     }
 
     // Check if the charset is set in the head.
-    QRegularExpression char_re(CHARSET_ATTRIBUTE);
     QRegularExpressionMatch char_mo = char_re.match(text);
     if (char_mo.hasMatch()) {
         codec = QTextCodec::codecForName(char_mo.captured(1).toLatin1().toUpper());
@@ -125,13 +243,12 @@ const QTextCodec *HTMLEncodingResolver::GetCodecForHTML(const QByteArray &raw_te
     }
 
     // See if all characters within this document are utf-8.
-    if (IsValidUtf8(raw_text)) {
+    if (is_valid_utf8) {
         return QTextCodec::codecForName("UTF-8");
     }
 
     // Finally, let Qt guess and if it doesn't know it will return the codec
     // for the current locale.
-    text = raw_text;
     return QTextCodec::codecForHtml(raw_text, QTextCodec::codecForLocale());
 }
 
@@ -153,59 +270,31 @@ bool HTMLEncodingResolver::IsValidUtf8(const QByteArray &string)
         return false;
     }
 
+    const unsigned char *bytes = reinterpret_cast<const unsigned char *>(string.constData());
+    const int size = string.size();
     int index = 0;
 
-    while (index < string.size()) {
-        QByteArray dword = string.mid(index, 4);
+    while (index < size) {
+        // Most of a book is markup and plain text, so skip over that a block at a time
+        const int block_end = index + PLAIN_TEXT_BLOCK_SIZE;
 
-        if (dword.size() < 4) {
-            dword = dword.leftJustified(4, '\0');
+        if (block_end <= size && IsPlainTextBlock(bytes + index)) {
+            index = block_end;
+            continue;
         }
 
-        const unsigned char *bytes = (const unsigned char *) dword.constData();
+        // Otherwise check each sequence up to the end of the block;
+        // the last one may run past it.
+        const int sequence_end = qMin(block_end, size);
 
-        // ASCII
-        if (bytes[0] == 0x09 ||
-            bytes[0] == 0x0A ||
-            bytes[0] == 0x0D ||
-            (0x20 <= bytes[0] && bytes[0] <= 0x7E)
-           ) {
-            index += 1;
-        }
-        // non-overlong 2-byte
-        else if ((0xC2 <= bytes[0] && bytes[0] <= 0xDF) &&
-                 (0x80 <= bytes[1] && bytes[1] <= 0xBF)
-                ) {
-            index += 2;
-        } else if ((bytes[0] == 0xE0                         &&              // excluding overlongs
-                    (0xA0 <= bytes[1] && bytes[1] <= 0xBF) &&
-                    (0x80 <= bytes[2] && bytes[2] <= 0xBF)) ||
-                   (((0xE1 <= bytes[0] && bytes[0] <= 0xEC) ||               // straight 3-byte
-                     bytes[0] == 0xEE                         ||
-                     bytes[0] == 0xEF) &&
-                    (0x80 <= bytes[1] && bytes[1] <= 0xBF)   &&
-                    (0x80 <= bytes[2] && bytes[2] <= 0xBF)) ||
-                   (bytes[0] == 0xED                         &&              // excluding surrogates
-                    (0x80 <= bytes[1] && bytes[1] <= 0x9F) &&
-                    (0x80 <= bytes[2] && bytes[2] <= 0xBF))
-                  ) {
-            index += 3;
-        } else if ((bytes[0] == 0xF0                         &&              // planes 1-3
-                    (0x90 <= bytes[1] && bytes[1] <= 0xBF) &&
-                    (0x80 <= bytes[2] && bytes[2] <= 0xBF) &&
-                    (0x80 <= bytes[3] && bytes[3] <= 0xBF)) ||
-                   ((0xF1 <= bytes[0] && bytes[0] <= 0xF3) &&              // planes 4-15
-                    (0x80 <= bytes[1] && bytes[1] <= 0xBF) &&
-                    (0x80 <= bytes[2] && bytes[2] <= 0xBF) &&
-                    (0x80 <= bytes[3] && bytes[3] <= 0xBF)) ||
-                   (bytes[0] == 0xF4                         &&            // plane 16
-                    (0x80 <= bytes[1] && bytes[1] <= 0x8F) &&
-                    (0x80 <= bytes[2] && bytes[2] <= 0xBF) &&
-                    (0x80 <= bytes[3] && bytes[3] <= 0xBF))
-                  ) {
-            index += 4;
-        } else {
-            return false;
+        while (index < sequence_end) {
+            const int length = Utf8SequenceLength(bytes + index, size - index);
+
+            if (!length) {
+                return false;
+            }
+
+            index += length;
         }
     }
 
@@ -23,6 +23,7 @@
 #ifndef HTMLEncodingResolver_H
 #define HTMLEncodingResolver_H
 
+class QByteArray;
 class QString;
 
 class HTMLEncodingResolver
@@ -35,17 +36,24 @@ public:
     // and returns the text converted to Unicode.
     static QString ReadHTMLFile(const QString &fullfilepath);
 
+    // Accepts the raw bytes of an HTML file,
+    // detects the encoding and returns the
+    // text converted to Unicode.
+    static QString DecodeHTML(QByteArray data);
+
 private:
 
     // Accepts an HTML stream and tries to determine its encoding;
     // if no encoding is detected, the default codec for this locale is returned.
     // We use this function because Qt's QTextCodec::codecForHtml() function
     // leaves a *lot* to be desired.
-    static const QTextCodec *GetCodecForHTML(const QByteArray &raw_text);
+    // is_valid_utf8 is the result of IsValidUtf8() for the same stream.
+    static const QTextCodec *GetCodecForHTML(const QByteArray &raw_text, bool is_valid_utf8);
 
     // This function goes through the entire byte array
     // and tries to see whether this is a valid UTF-8 sequence.
     // If it's valid, this is probably a UTF-8 string.
+    // Runs of plain ASCII are checked a block at a time (with SSE2 where available).
     static bool IsValidUtf8(const QByteArray &string);
 };
 
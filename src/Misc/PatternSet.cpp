@@ -0,0 +1,185 @@
+/************************************************************************
+**
+**  Copyright (C) 2026 agent <agent@local>
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#include <algorithm>
+
+#include <QtCore/QQueue>
+#include <QtCore/QSet>
+
+#include "Misc/PatternSet.h"
+
+// Characters that give a pattern a meaning other than the plain text
+static const QString REGEX_SYNTAX_CHARS = "\\^$.|?*+()[]{}";
+
+PatternSet::PatternSet(const QStringList &patterns)
+{
+    State root;
+    root.fail = 0;
+    root.output = -1;
+    m_States.append(root);
+
+    for (int i = 0; i < patterns.count(); ++i) {
+        const QString &pattern = patterns.at(i);
+
+        if (pattern.isEmpty()) {
+            continue;
+        }
+
+        if (IsLiteral(pattern)) {
+            AddWord(pattern, i);
+        } else {
+            QRegularExpression regex(pattern);
+
+            if (regex.isValid()) {
+                regex.optimize();
+                m_Regexes.append(qMakePair(i, regex));
+            }
+        }
+    }
+
+    BuildFailLinks();
+}
+
+
+QList<int> PatternSet::Match(const QString &text) const
+{
+    QList<int> matched;
+
+    if (m_States.count() > 1) {
+        // A word ending state reports every shorter word along its fail links,
+        // so once a state has been reported its whole chain has been too.
+        QSet<int> reported;
+        int state = 0;
+        const QChar *chars = text.constData();
+        const int length = text.length();
+
+        for (int i = 0; i < length; ++i) {
+            const ushort ch = chars[i].unicode();
+
+            forever {
+                const QHash<ushort, int> &next = m_States.at(state).next;
+                QHash<ushort, int>::const_iterator found = next.constFind(ch);
+
+                if (found != next.constEnd()) {
+                    state = found.value();
+                    break;
+                }
+
+                if (state == 0) {
+                    break;
+                }
+
+                state = m_States.at(state).fail;
+            }
+
+            for (int output = m_States.at(state).output; output != -1 && !reported.contains(output);
+                 output = m_States.at(m_States.at(output).fail).output) {
+                reported.insert(output);
+                matched.append(m_States.at(output).words);
+            }
+        }
+    }
+
+    for (int i = 0; i < m_Regexes.count(); ++i) {
+        if (m_Regexes.at(i).second.match(text).hasMatch()) {
+            matched.append(m_Regexes.at(i).first);
+        }
+    }
+
+    std::sort(matched.begin(), matched.end());
+    return matched;
+}
+
+
+void PatternSet::AddWord(const QString &word, int pattern_index)
+{
+    int state = 0;
+    foreach(QChar c, word) {
+        const ushort ch = c.unicode();
+        int next_state = m_States.at(state).next.value(ch, -1);
+
+        if (next_state == -1) {
+            State new_state;
+            new_state.fail = 0;
+            new_state.output = -1;
+            next_state = m_States.count();
+            m_States.append(new_state);
+            m_States[state].next.insert(ch, next_state);
+        }
+
+        state = next_state;
+    }
+    m_States[state].words.append(pattern_index);
+}
+
+
+void PatternSet::BuildFailLinks()
+{
+    // Breadth first, so the fail state of every state is final before its children are linked
+    QQueue<int> queue;
+    queue.enqueue(0);
+
+    while (!queue.isEmpty()) {
+        const int state = queue.dequeue();
+        QHashIterator<ushort, int> child_iter(m_States.at(state).next);
+
+        while (child_iter.hasNext()) {
+            child_iter.next();
+            const ushort ch = child_iter.key();
+            const int child = child_iter.value();
+            int fail = 0;
+
+            if (state != 0) {
+                int candidate = m_States.at(state).fail;
+
+                forever {
+                    const int next_state = m_States.at(candidate).next.value(ch, -1);
+
+                    if (next_state != -1) {
+                        fail = next_state;
+                        break;
+                    }
+
+                    if (candidate == 0) {
+                        break;
+                    }
+
+                    candidate = m_States.at(candidate).fail;
+                }
+            }
+
+            m_States[child].fail = fail;
+            m_States[child].output = m_States.at(child).words.isEmpty() ? m_States.at(fail).output : child;
+            queue.enqueue(child);
+        }
+    }
+}
+
+
+bool PatternSet::IsLiteral(const QString &pattern)
+{
+    foreach(QChar c, pattern) {
+        if (REGEX_SYNTAX_CHARS.contains(c)) {
+            return false;
+        }
+    }
+    return true;
+}
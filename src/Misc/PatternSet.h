@@ -0,0 +1,76 @@
+/************************************************************************
+**
+**  Copyright (C) 2026 agent <agent@local>
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#pragma once
+#ifndef PATTERNSET_H
+#define PATTERNSET_H
+
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QPair>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+#include <QtCore/QVector>
+#include <QRegularExpression>
+
+/**
+ * A set of regular expression patterns compiled once and matched
+ * together against many texts.
+ *
+ * Patterns without regex syntax are plain words and are all found in
+ * a single pass with an Aho-Corasick automaton. The remaining patterns
+ * are compiled and optimized once and then tried one after another.
+ * Matching is read only, so one set can be shared between threads.
+ */
+class PatternSet
+{
+
+public:
+    PatternSet(const QStringList &patterns);
+
+    /**
+     * Returns the indexes of the patterns that occur in the text,
+     * in the order the patterns were given.
+     * Empty and invalid patterns never match.
+     */
+    QList<int> Match(const QString &text) const;
+
+private:
+    struct State {
+        QHash<ushort, int> next;
+        int fail;
+        // The nearest state along the fail links (this one included) that ends a word, or -1
+        int output;
+        QList<int> words;
+    };
+
+    void AddWord(const QString &word, int pattern_index);
+
+    void BuildFailLinks();
+
+    static bool IsLiteral(const QString &pattern);
+
+    QVector<State> m_States;
+
+    QList<QPair<int, QRegularExpression>> m_Regexes;
+};
+
+#endif // PATTERNSET_H
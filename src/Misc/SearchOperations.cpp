@@ -22,15 +22,16 @@
 #include <signal.h>
 
 #include <QtCore/QtCore>
+#include <QtConcurrent/QtConcurrent>
 #include <QtWidgets/QApplication>
 #include <QtWidgets/QProgressDialog>
 
 #include "BookManipulation/CleanSource.h"
 #include "Misc/SearchOperations.h"
-#include "Misc/SettingsStore.h"
 #include "Misc/Utility.h"
 #include "PCRE/PCRECache.h"
 #include "Misc/HTMLSpellCheck.h"
+#include "Misc/SpellCheck.h"
 #include "ResourceObjects/HTMLResource.h"
 #include "ResourceObjects/TextResource.h"
 #include "ViewEditors/Searchable.h"
@@ -43,16 +44,18 @@ int SearchOperations::CountInFiles(const QString &search_regex,
 {
     QProgressDialog progress(QObject::tr("Counting occurrences.."), 0, 0, resources.count(), Utility::GetMainWindow());
     progress.setMinimumDuration(PROGRESS_BAR_MINIMUM_DURATION);
-    int progress_value = 0;
-    progress.setValue(progress_value);
-    // Count sequentially in order to see if occassional crashes are due to threading
-    int count = 0;
-    foreach(Resource * resource, resources) {
-        progress.setValue(progress_value++);
-        qApp->processEvents();
-        count += CountInFile(search_regex, resource, search_type, check_spelling);
+    progress.setValue(0);
+
+    if (check_spelling) {
+        // Create the spellchecker here rather than on the first worker thread to use it.
+        SpellCheck::instance();
     }
-    return count;
+
+    QFuture<int> future = QtConcurrent::mappedReduced(resources,
+                          std::bind(CountInFile, search_regex, std::placeholders::_1, search_type, check_spelling),
+                          Accumulate);
+    WaitWithProgress(future, progress);
+    return future.result();
 }
 
 
@@ -63,16 +66,40 @@ int SearchOperations::ReplaceInAllFIles(const QString &search_regex,
 {
     QProgressDialog progress(QObject::tr("Replacing search term..."), 0, 0, resources.count(), Utility::GetMainWindow());
     progress.setMinimumDuration(PROGRESS_BAR_MINIMUM_DURATION);
-    int progress_value = 0;
-    progress.setValue(progress_value);
-    // Replace sequentially in order to see if occassional crashes are due to threading
-    int count = 0;
-    foreach(Resource * resource, resources) {
-        progress.setValue(progress_value++);
-        qApp->processEvents();
-        count += ReplaceInFile(search_regex, replacement, resource, search_type);
-    }
-    return count;
+    progress.setValue(0);
+    QFuture<int> future = QtConcurrent::mappedReduced(resources,
+                          std::bind(ReplaceInFile, search_regex, replacement, std::placeholders::_1, search_type),
+                          Accumulate);
+    WaitWithProgress(future, progress);
+    return future.result();
+}
+
+
+QList<SearchOperations::StepResult> SearchOperations::CountSearchGroupInFiles(const QList<SearchStep> &steps,
+        QList<Resource *> resources)
+{
+    QProgressDialog progress(QObject::tr("Counting occurrences.."), 0, 0, resources.count(), Utility::GetMainWindow());
+    progress.setMinimumDuration(PROGRESS_BAR_MINIMUM_DURATION);
+    progress.setValue(0);
+    QFuture<QList<StepResult>> future = QtConcurrent::mappedReduced(resources,
+                                        std::bind(CountSearchGroupInFile, steps, std::placeholders::_1),
+                                        AccumulateStepResults);
+    WaitWithProgress(future, progress);
+    return future.result();
+}
+
+
+QList<SearchOperations::StepResult> SearchOperations::ReplaceSearchGroupInFiles(const QList<SearchStep> &steps,
+        QList<Resource *> resources)
+{
+    QProgressDialog progress(QObject::tr("Replacing search term..."), 0, 0, resources.count(), Utility::GetMainWindow());
+    progress.setMinimumDuration(PROGRESS_BAR_MINIMUM_DURATION);
+    progress.setValue(0);
+    QFuture<QList<StepResult>> future = QtConcurrent::mappedReduced(resources,
+                                        std::bind(ReplaceSearchGroupInFile, steps, std::placeholders::_1),
+                                        AccumulateStepResults);
+    WaitWithProgress(future, progress);
+    return future.result();
 }
 
 
@@ -106,12 +133,11 @@ int SearchOperations::CountInHTMLFile(const QString &search_regex,
                                       bool check_spelling)
 {
     if (search_type == SearchOperations::CodeViewSearch) {
-        const QString &text = html_resource->GetText();
-
         if (check_spelling) {
+            const QString &text = html_resource->GetText();
             return HTMLSpellCheck::CountMisspelledWords(text, 0, text.count(), search_regex);
         } else {
-            return PCRECache::instance()->getObject(search_regex)->getEveryMatchInfo(text).count();
+            return html_resource->GetMatchIndex(search_regex).count();
         }
     }
 
@@ -154,14 +180,21 @@ int SearchOperations::ReplaceHTMLInFile(const QString &search_regex,
                                         HTMLResource *html_resource,
                                         SearchType search_type)
 {
-    SettingsStore ss;
-
     if (search_type == SearchOperations::CodeViewSearch) {
+        const QList<SPCRE::MatchInfo> match_index = html_resource->GetMatchIndex(search_regex);
+
+        if (match_index.isEmpty()) {
+            return 0;
+        }
+
         int count;
         QString new_text;
-        QString text = html_resource->GetText();
-        std::tie(new_text, count) = PerformGlobalReplace(text, search_regex, replacement);
-        html_resource->SetText(new_text);
+        std::tie(new_text, count) = PerformGlobalReplace(html_resource->GetText(), match_index, search_regex, replacement);
+
+        if (count > 0) {
+            html_resource->SetText(new_text);
+        }
+
         return count;
     }
 
@@ -179,25 +212,98 @@ int SearchOperations::ReplaceTextInFile(const QString &search_regex,
 }
 
 
+QList<SearchOperations::StepResult> SearchOperations::CountSearchGroupInFile(const QList<SearchStep> &steps,
+        Resource *resource)
+{
+    QList<StepResult> results;
+    QReadLocker locker(&resource->GetLock());
+    HTMLResource *html_resource = qobject_cast<HTMLResource *>(resource);
+
+    if (!html_resource) {
+        return results;
+    }
+
+    const QString text = html_resource->GetText();
+    QElapsedTimer timer;
+    foreach(const SearchStep & step, steps) {
+        StepResult result;
+        timer.start();
+        result.count = PCRECache::instance()->getObject(step.search_regex)->getEveryMatchInfo(text).count();
+        result.nsecs = timer.nsecsElapsed();
+        results.append(result);
+    }
+    return results;
+}
+
+
+QList<SearchOperations::StepResult> SearchOperations::ReplaceSearchGroupInFile(const QList<SearchStep> &steps,
+        Resource *resource)
+{
+    QList<StepResult> results;
+    QWriteLocker locker(&resource->GetLock());
+    HTMLResource *html_resource = qobject_cast<HTMLResource *>(resource);
+
+    if (!html_resource) {
+        return results;
+    }
+
+    QString text = html_resource->GetText();
+    bool changed = false;
+    QElapsedTimer timer;
+    foreach(const SearchStep & step, steps) {
+        StepResult result;
+        timer.start();
+        QList<SPCRE::MatchInfo> match_index = PCRECache::instance()->getObject(step.search_regex)->getEveryMatchInfo(text);
+
+        if (!match_index.isEmpty()) {
+            QString new_text;
+            std::tie(new_text, result.count) = PerformGlobalReplace(text, match_index, step.search_regex, step.replacement);
+
+            if (result.count > 0) {
+                text = new_text;
+                changed = true;
+            }
+        }
+
+        result.nsecs = timer.nsecsElapsed();
+        results.append(result);
+    }
+
+    if (changed) {
+        html_resource->SetText(text);
+    }
+
+    return results;
+}
+
+
 std::tuple<QString, int> SearchOperations::PerformGlobalReplace(const QString &text,
+        const QList<SPCRE::MatchInfo> &match_index,
         const QString &search_regex,
         const QString &replacement)
 {
-    QString new_text = text;
+    // Build the new text front to back in a single buffer instead of
+    // splicing every replacement into a copy of the old text.
+    QString new_text;
+    new_text.reserve(text.length());
     int count = 0;
+    int last_end = 0;
     SPCRE *spcre = PCRECache::instance()->getObject(search_regex);
-    QList<SPCRE::MatchInfo> match_info = spcre->getEveryMatchInfo(text);
-
-    for (int i =  match_info.count() - 1; i >= 0; i--) {
-        QString match_segement = Utility::Substring(match_info.at(i).offset.first, match_info.at(i).offset.second, new_text);
+    foreach(const SPCRE::MatchInfo & match, match_index) {
+        QString match_segement = Utility::Substring(match.offset.first, match.offset.second, text);
         QString replacement_text;
+        new_text.append(text.midRef(last_end, match.offset.first - last_end));
 
-        if (spcre->replaceText(match_segement, match_info.at(i).capture_groups_offsets, replacement, replacement_text)) {
-            new_text.replace(match_info.at(i).offset.first, match_info.at(i).offset.second - match_info.at(i).offset.first, replacement_text);
+        if (spcre->replaceText(match_segement, match.capture_groups_offsets, replacement, replacement_text)) {
+            new_text.append(replacement_text);
             count++;
+        } else {
+            new_text.append(match_segement);
         }
-    }
 
+        last_end = match.offset.second;
+    }
+    new_text.append(text.midRef(last_end));
     return std::make_tuple(new_text, count);
 }
 
@@ -232,3 +338,33 @@ void SearchOperations::Accumulate(int &first, const int &second)
 {
     first += second;
 }
+
+
+void SearchOperations::AccumulateStepResults(QList<StepResult> &first, const QList<StepResult> &second)
+{
+    // Files that were skipped have no results at all.
+    if (first.isEmpty()) {
+        first = second;
+        return;
+    }
+
+    for (int i = 0; i < second.count(); i++) {
+        first[i].count += second.at(i).count;
+        first[i].nsecs += second.at(i).nsecs;
+    }
+}
+
+
+void SearchOperations::WaitWithProgress(const QFuture<void> &future, QProgressDialog &progress)
+{
+    // Keep the GUI responsive while the pool works through the files.
+    QFutureWatcher<void> watcher;
+    QEventLoop loop;
+    QObject::connect(&watcher, SIGNAL(progressValueChanged(int)), &progress, SLOT(setValue(int)));
+    QObject::connect(&watcher, SIGNAL(finished()), &loop, SLOT(quit()));
+    watcher.setFuture(future);
+
+    if (!future.isFinished()) {
+        loop.exec(QEventLoop::ExcludeUserInputEvents);
+    }
+}
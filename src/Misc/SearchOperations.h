@@ -23,6 +23,11 @@
 #ifndef SEARCHOPERATIONS_H
 #define SEARCHOPERATIONS_H
 
+#include <QtCore/QFuture>
+
+#include "PCRE/SPCRE.h"
+
+class QProgressDialog;
 class Resource;
 class TextResource;
 class HTMLResource;
@@ -37,8 +42,28 @@ public:
         CodeViewSearch
     };
 
+    /**
+     * One search of a search group.
+     */
+    struct SearchStep {
+        QString search_regex;
+        QString replacement;
+    };
+
+    /**
+     * What one search of a search group did over all the files.
+     * The time is the sum over the files, not wall clock time.
+     */
+    struct StepResult {
+        int count;
+        qint64 nsecs;
+
+        StepResult() : count(0), nsecs(0) {}
+    };
+
     /**
      * Returns the number of matching occurrences.
+     * The files are searched in parallel.
      *
      * @param search_regex The regex to match with.
      * @return The number of matching occurrences.
@@ -49,18 +74,48 @@ public:
                             bool check_spelling = false);
 
 
+    /**
+     * Replaces every match in the files, in parallel. Each file
+     * is rewritten under its own write lock.
+     *
+     * @return The number of performed replacements.
+     */
     static int ReplaceInAllFIles(const QString &search_regex,
                                  const QString &replacement,
                                  QList<Resource *> resources,
                                  SearchType search_type);
 
-private:
+    /**
+     * Counts the matches of every search of a group. Each file is
+     * read once and searched for all the regexes, files in parallel.
+     *
+     * @return The result of each step, in the order of the steps.
+     */
+    static QList<StepResult> CountSearchGroupInFiles(const QList<SearchStep> &steps,
+                                                     QList<Resource *> resources);
+
+    /**
+     * Runs the replacements of a search group over the files. Each file
+     * is read once, every step is applied in order to the text in memory
+     * and the result is written back once, files in parallel. The outcome
+     * is the same as running Replace All for each step in turn.
+     *
+     * @return The result of each step, in the order of the steps.
+     */
+    static QList<StepResult> ReplaceSearchGroupInFiles(const QList<SearchStep> &steps,
+                                                       QList<Resource *> resources);
 
+    /**
+     * Returns the number of matching occurrences in one file.
+     * Reuses the file's match index when the text hasn't changed.
+     */
     static int CountInFile(const QString &search_regex,
                            Resource *resource,
                            SearchType search_type,
                            bool check_spelling);
 
+private:
+
 
     static int CountInHTMLFile(const QString &search_regex,
                                HTMLResource *html_resource,
@@ -86,6 +141,7 @@ private:
                                  TextResource *text_resource);
 
     static std::tuple<QString, int> PerformGlobalReplace(const QString &text,
+            const QList<SPCRE::MatchInfo> &match_index,
             const QString &search_regex,
             const QString &replacement);
 
@@ -93,7 +149,17 @@ private:
             const QString &search_regex,
             const QString &replacement);
 
+    static QList<StepResult> CountSearchGroupInFile(const QList<SearchStep> &steps,
+                                                    Resource *resource);
+
+    static QList<StepResult> ReplaceSearchGroupInFile(const QList<SearchStep> &steps,
+                                                      Resource *resource);
+
     static void Accumulate(int &first, const int &second);
+
+    static void AccumulateStepResults(QList<StepResult> &first, const QList<StepResult> &second);
+
+    static void WaitWithProgress(const QFuture<void> &future, QProgressDialog &progress);
 };
 
 #endif // SEARCHOPERATIONS_H
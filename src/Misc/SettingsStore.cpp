@@ -20,7 +20,9 @@
 **
 *************************************************************************/
 
+#include <QtCore/QAtomicPointer>
 #include <QtCore/QLocale>
+#include <QtCore/QMutex>
 #include <QtCore/QCoreApplication>
 #include <QtCore/QStandardPaths>
 #include <QFile>
@@ -45,6 +47,7 @@ static QString KEY_DEFAULT_USER_DICTIONARY = SETTINGS_GROUP + "/" + "user_dictio
 static QString KEY_ENABLED_USER_DICTIONARIES = SETTINGS_GROUP + "/" + "enabled_user_dictionaries";
 static QString KEY_CLEAN_LEVEL = SETTINGS_GROUP + "/" + "clean_level";
 static QString KEY_CLEAN_ON = SETTINGS_GROUP + "/" + "clean_on";
+static QString KEY_EPUB_COMPRESSION_LEVEL = SETTINGS_GROUP + "/" + "epub_compression_level";
 static QString KEY_PRESERVE_ENTITY_NAMES = SETTINGS_GROUP + "/" + "preserve_entity_names";
 static QString KEY_PRESERVE_ENTITY_CODES = SETTINGS_GROUP + "/" + "preserve_entity_codes";
 
@@ -84,6 +87,11 @@ static QString KEY_CODE_VIEW_XHTML_HTML_COMMENT_COLOR = SETTINGS_GROUP + "/" + "
 static QString KEY_SPECIAL_CHARACTER_FONT_FAMILY = SETTINGS_GROUP + "/" + "special_character_font_family";
 static QString KEY_SPECIAL_CHARACTER_FONT_SIZE = SETTINGS_GROUP + "/" + "special_character_font_size";
 
+// Snapshots that have been replaced are never freed since a reader
+// may still hold on to one. They only change from the preferences.
+static QAtomicPointer<const SettingsStore::Snapshot> g_Snapshot;
+static QMutex g_SnapshotMutex;
+
 
 SettingsStore::SettingsStore()
     : QSettings(QStandardPaths::writableLocation(QStandardPaths::DataLocation) + "/sigil.ini", QSettings::IniFormat)
@@ -95,6 +103,31 @@ SettingsStore::SettingsStore(QString filename)
 {
 }
 
+const SettingsStore::Snapshot &SettingsStore::snapshot()
+{
+    const Snapshot *current = g_Snapshot.loadAcquire();
+
+    if (!current) {
+        SettingsStore settings;
+        settings.publishSnapshot();
+        current = g_Snapshot.loadAcquire();
+    }
+
+    return *current;
+}
+
+void SettingsStore::publishSnapshot()
+{
+    QMutexLocker locker(&g_SnapshotMutex);
+    Snapshot *snapshot = new Snapshot();
+    snapshot->clean_level = cleanLevel();
+    snapshot->clean_on = cleanOn();
+    snapshot->spell_check = spellCheck();
+    snapshot->epub_compression_level = epubCompressionLevel();
+    snapshot->preserve_entity_code_names = preserveEntityCodeNames();
+    g_Snapshot.storeRelease(snapshot);
+}
+
 QString SettingsStore::uiLanguage()
 {
     clearSettingsGroup();
@@ -190,6 +223,12 @@ int SettingsStore::cleanOn()
     return value(KEY_CLEAN_ON, (CLEANON_OPEN | CLEANON_SAVE)).toInt();
 }
 
+int SettingsStore::epubCompressionLevel()
+{
+    clearSettingsGroup();
+    return qBound(1, value(KEY_EPUB_COMPRESSION_LEVEL, 8).toInt(), 9);
+}
+
 QList <std::pair <ushort, QString>>  SettingsStore::preserveEntityCodeNames()
 {
     clearSettingsGroup();
@@ -336,6 +375,7 @@ void SettingsStore::setSpellCheck(bool enabled)
 {
     clearSettingsGroup();
     setValue(KEY_SPELL_CHECK, enabled);
+    publishSnapshot();
 }
 
 void SettingsStore::setDefaultUserDictionary(const QString &name)
@@ -354,12 +394,21 @@ void SettingsStore::setCleanLevel(SettingsStore::CleanLevel level)
 {
     clearSettingsGroup();
     setValue(KEY_CLEAN_LEVEL, level);
+    publishSnapshot();
 }
 
 void SettingsStore::setCleanOn(int on)
 {
     clearSettingsGroup();
     setValue(KEY_CLEAN_ON, on);
+    publishSnapshot();
+}
+
+void SettingsStore::setEpubCompressionLevel(int level)
+{
+    clearSettingsGroup();
+    setValue(KEY_EPUB_COMPRESSION_LEVEL, level);
+    publishSnapshot();
 }
 
 void SettingsStore::setPreserveEntityCodeNames(const QList<std::pair <ushort, QString>> codenames)
@@ -374,6 +423,7 @@ void SettingsStore::setPreserveEntityCodeNames(const QList<std::pair <ushort, QS
     }
     setValue(KEY_PRESERVE_ENTITY_NAMES, names);
     setValue(KEY_PRESERVE_ENTITY_CODES, codes);
+    publishSnapshot();
 }
 
 void SettingsStore::setPluginEnginePaths(const QHash <QString, QString> &enginepaths)
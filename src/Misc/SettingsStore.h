@@ -25,6 +25,7 @@
 #define SETTINGSSTORE_H
 
 #include <QColor>
+#include <QtCore/QList>
 #include <QtCore/QSettings>
 #include <QtCore/QString>
 #include <utility>
@@ -56,6 +57,29 @@ public:
         CleanLevel_Gumbo             = 200
     };
 
+    /**
+     * The settings that are read while loading, cleaning and
+     * highlighting, captured at one point in time.
+     */
+    struct Snapshot {
+        SettingsStore::CleanLevel clean_level;
+        int clean_on;
+        bool spell_check;
+        int epub_compression_level;
+        QList<std::pair <ushort, QString>> preserve_entity_code_names;
+    };
+
+    /**
+     * The current settings snapshot. Reading it takes no locks and
+     * does not touch the settings file, so it can be used from worker
+     * threads and code that runs once per file or per text block.
+     * The setters for these settings publish a new snapshot; a
+     * returned reference stays valid for the life of the application.
+     *
+     * @return The current snapshot.
+     */
+    static const Snapshot &snapshot();
+
     /**
      * The langauge to use for the user interface
      *
@@ -129,6 +153,14 @@ public:
 
     int cleanOn();
 
+    /**
+     * The zlib compression level (1-9) files are
+     * deflated with when an EPUB is saved.
+     *
+     * @return The compression level.
+     */
+    int epubCompressionLevel();
+
     /**
      * All appearance settings related to BookView.
      */
@@ -279,6 +311,8 @@ public slots:
 
     void setCleanOn(int on);
 
+    void setEpubCompressionLevel(int level);
+
     /**
      * Set the default font settings to use for rendering Book View/Preview
      */
@@ -293,6 +327,12 @@ public slots:
     void setSpecialCharacterAppearance(const SpecialCharacterAppearance &special_character_appearance);
 
 private:
+    /**
+     * Builds a snapshot from the stored settings and makes it
+     * the one returned by snapshot().
+     */
+    void publishSnapshot();
+
     /**
      * Ensures there is not an open settings group which will cause the settings
      * this class implements to be set in the wrong place.
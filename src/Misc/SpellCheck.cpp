@@ -28,6 +28,7 @@
 #include <QtCore/QIODevice>
 #include <QtCore/QTextCodec>
 #include <QtCore/QTextStream>
+#include <QtCore/QThread>
 #include <QtCore/QUrl>
 #include <QtWidgets/QApplication>
 #include <QtCore/QStandardPaths>
@@ -41,6 +42,10 @@
 # include <stdlib.h>
 #endif
 
+// Verdicts are dropped once there are this many
+// so the cache can't grow without bound.
+static const int MAX_CACHED_VERDICTS = 200000;
+
 SpellCheck *SpellCheck::m_instance = 0;
 
 SpellCheck *SpellCheck::instance()
@@ -55,7 +60,9 @@ SpellCheck *SpellCheck::instance()
 SpellCheck::SpellCheck() :
     m_hunspell(0),
     m_codec(0),
-    m_wordchars("")
+    m_wordchars(""),
+    m_revision(0),
+    m_hunspellCount(0)
 {
     // There is a considerable lag involved in loading the Spellcheck dictionaries
     QApplication::setOverrideCursor(Qt::WaitCursor);
@@ -85,10 +92,7 @@ SpellCheck::SpellCheck() :
 
 SpellCheck::~SpellCheck()
 {
-    if (m_hunspell) {
-        delete m_hunspell;
-        m_hunspell = 0;
-    }
+    deleteHunspells();
 
     if (m_instance) {
         delete m_instance;
@@ -116,71 +120,123 @@ QStringList SpellCheck::dictionaries()
 
 QString SpellCheck::currentDictionary() const
 {
+    QReadLocker locker(&m_lock);
     return m_dictionaryName;
 }
 
 bool SpellCheck::spell(const QString &word)
 {
+    QReadLocker locker(&m_lock);
+
     if (!m_hunspell) {
         return true;
     }
 
-    return m_hunspell->spell(m_codec->fromUnicode(Utility::getSpellingSafeText(word)).constData()) != 0;
+    {
+        QReadLocker verdicts_locker(&m_verdictsLock);
+        QHash<QString, bool>::const_iterator verdict = m_verdicts.constFind(word);
+
+        if (verdict != m_verdicts.constEnd()) {
+            return verdict.value();
+        }
+    }
+
+    QByteArray encoded_word = m_codec->fromUnicode(Utility::getSpellingSafeText(word));
+    Hunspell *hunspell = acquireHunspell();
+    bool correct = hunspell->spell(encoded_word.constData()) != 0;
+    releaseHunspell(hunspell);
+
+    QWriteLocker verdicts_locker(&m_verdictsLock);
+
+    if (m_verdicts.count() >= MAX_CACHED_VERDICTS) {
+        m_verdicts.clear();
+    }
+
+    m_verdicts.insert(word, correct);
+    return correct;
 }
 
 QStringList SpellCheck::suggest(const QString &word)
 {
+    QReadLocker locker(&m_lock);
+
     if (!m_hunspell) {
         return QStringList();
     }
 
     QStringList suggestions;
     char **suggestedWords;
-    int count = m_hunspell->suggest(&suggestedWords, m_codec->fromUnicode(Utility::getSpellingSafeText(word)).constData());
+    Hunspell *hunspell = acquireHunspell();
+    int count = hunspell->suggest(&suggestedWords, m_codec->fromUnicode(Utility::getSpellingSafeText(word)).constData());
 
     for (int i = 0; i < count; ++i) {
         suggestions << m_codec->toUnicode(suggestedWords[i]);
     }
 
-    m_hunspell->free_list(&suggestedWords, count);
+    hunspell->free_list(&suggestedWords, count);
+    releaseHunspell(hunspell);
     return suggestions;
 }
 
 void SpellCheck::clearIgnoredWords()
 {
-    m_ignoredWords.clear();
+    {
+        QWriteLocker locker(&m_lock);
+        m_ignoredWords.clear();
+    }
     reloadDictionary();
 }
 
 void SpellCheck::ignoreWord(const QString &word)
 {
-    ignoreWordInDictionary(word);
+    QWriteLocker locker(&m_lock);
+    addWord(word);
 
     m_ignoredWords.append(word);
 }
 
 void SpellCheck::ignoreWordInDictionary(const QString &word)
+{
+    QWriteLocker locker(&m_lock);
+    addWord(word);
+}
+
+void SpellCheck::addWord(const QString &word)
 {
     if (!m_hunspell) {
         return;
     }
 
-    m_hunspell->add(m_codec->fromUnicode(Utility::getSpellingSafeText(word)).constData());
+    m_revision.ref();
+    QByteArray encoded_word = m_codec->fromUnicode(Utility::getSpellingSafeText(word));
+    foreach(Hunspell *hunspell, m_hunspells) {
+        hunspell->add(encoded_word.constData());
+    }
+    m_addedWords.append(word);
+
+    QWriteLocker verdicts_locker(&m_verdictsLock);
+    m_verdicts.clear();
 }
 
 void SpellCheck::setDictionary(const QString &name, bool forceReplace)
 {
+    QWriteLocker locker(&m_lock);
+
     // See if we are already using a hunspell object for this language.
     if (!forceReplace && m_dictionaryName == name && m_hunspell) {
         return;
     }
 
-    // Delete the current hunspell object.
-    if (m_hunspell) {
-        delete m_hunspell;
-        m_hunspell = 0;
+    m_revision.ref();
+    {
+        QWriteLocker verdicts_locker(&m_verdictsLock);
+        m_verdicts.clear();
     }
 
+    // Delete the current hunspell objects.
+    deleteHunspells();
+    m_addedWords.clear();
+
     // Save the dictionary name for use later.
     m_dictionaryName = name;
 
@@ -190,16 +246,14 @@ void SpellCheck::setDictionary(const QString &name, bool forceReplace)
     }
 
     // Dictionary files to use.
-    QString aff = QString("%1%2.aff").arg(m_dictionaries.value(name)).arg(name);
-    QString dic = QString("%1%2.dic").arg(m_dictionaries.value(name)).arg(name);
-    QString hyph_dic = QString("%1hyph_%2.dic").arg(m_dictionaries.value(name)).arg(name);
+    m_affFile = QString("%1%2.aff").arg(m_dictionaries.value(name)).arg(name);
+    m_dicFile = QString("%1%2.dic").arg(m_dictionaries.value(name)).arg(name);
+    m_hyphDicFile = QString("%1hyph_%2.dic").arg(m_dictionaries.value(name)).arg(name);
     // Create a new hunspell object.
-    m_hunspell = new Hunspell(aff.toLocal8Bit().constData(), dic.toLocal8Bit().constData());
-
-    // Load the hyphenation dictionary if it exists.
-    if (QFile::exists(hyph_dic)) {
-        m_hunspell->add_dic(hyph_dic.toLocal8Bit().constData());
-    }
+    m_hunspell = createHunspell();
+    m_hunspells.append(m_hunspell);
+    m_idleHunspells.append(m_hunspell);
+    m_hunspellCount = 1;
 
     // Get the encoding for the text in the dictionary.
     m_codec = QTextCodec::codecForName(m_hunspell->get_dic_encoding());
@@ -213,18 +267,79 @@ void SpellCheck::setDictionary(const QString &name, bool forceReplace)
 
     // Load in the words from the user dictionaries.
     foreach(QString word, allUserDictionaryWords()) {
-        ignoreWordInDictionary(word);
+        addWord(word);
     }
 
     // Reload the words in the "Ignored" dictionary.
     foreach(QString word, m_ignoredWords) {
-        ignoreWordInDictionary(word);
+        addWord(word);
     }
 }
 
+Hunspell *SpellCheck::createHunspell() const
+{
+    Hunspell *hunspell = new Hunspell(m_affFile.toLocal8Bit().constData(), m_dicFile.toLocal8Bit().constData());
+
+    // Load the hyphenation dictionary if it exists.
+    if (QFile::exists(m_hyphDicFile)) {
+        hunspell->add_dic(m_hyphDicFile.toLocal8Bit().constData());
+    }
+
+    // The first instance is created before the codec is known
+    // but nothing has been added to the dictionary by then.
+    foreach(QString word, m_addedWords) {
+        hunspell->add(m_codec->fromUnicode(Utility::getSpellingSafeText(word)).constData());
+    }
+
+    return hunspell;
+}
+
+Hunspell *SpellCheck::acquireHunspell()
+{
+    QMutexLocker locker(&m_poolMutex);
+
+    while (m_idleHunspells.isEmpty()) {
+        if (m_hunspellCount < QThread::idealThreadCount()) {
+            // Loading a dictionary takes a while so other
+            // threads can keep using the pool meanwhile.
+            m_hunspellCount++;
+            locker.unlock();
+            Hunspell *hunspell = createHunspell();
+            locker.relock();
+            m_hunspells.append(hunspell);
+            return hunspell;
+        }
+
+        m_hunspellReleased.wait(&m_poolMutex);
+    }
+
+    return m_idleHunspells.takeLast();
+}
+
+void SpellCheck::releaseHunspell(Hunspell *hunspell)
+{
+    QMutexLocker locker(&m_poolMutex);
+    m_idleHunspells.append(hunspell);
+    m_hunspellReleased.wakeOne();
+}
+
+void SpellCheck::deleteHunspells()
+{
+    qDeleteAll(m_hunspells);
+    m_hunspells.clear();
+    m_idleHunspells.clear();
+    m_hunspellCount = 0;
+    m_hunspell = 0;
+}
+
+int SpellCheck::revision() const
+{
+    return m_revision.load();
+}
 
 QString SpellCheck::getWordChars()
 {
+    QReadLocker locker(&m_lock);
     return m_wordchars;
 }
 
@@ -232,7 +347,7 @@ QString SpellCheck::getWordChars()
 
 void SpellCheck::reloadDictionary()
 {
-    setDictionary(m_dictionaryName, true);
+    setDictionary(currentDictionary(), true);
 }
 
 void SpellCheck::addToUserDictionary(const QString &word, QString dict_name)
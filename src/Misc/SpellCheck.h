@@ -23,9 +23,13 @@
 #ifndef SPELLCHECK_H
 #define SPELLCHECK_H
 
+#include <QtCore/QAtomicInt>
 #include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QReadWriteLock>
 #include <QtCore/QString>
 #include <QtCore/QStringList>
+#include <QtCore/QWaitCondition>
 
 class Hunspell;
 class QStringList;
@@ -33,6 +37,10 @@ class QTextCodec;
 
 /**
  * Singleton.
+ *
+ * Words can be checked from several threads at once. Each check
+ * borrows one of a small pool of hunspell instances, and verdicts
+ * are cached per word until the accepted words change.
  */
 class SpellCheck
 {
@@ -68,9 +76,35 @@ public:
 
     void loadDictionaryNames();
 
+    /**
+     * Changes whenever the words considered correct may have
+     * changed, so results of earlier checks can be thrown away.
+     */
+    int revision() const;
+
 private:
     SpellCheck();
 
+    /**
+     * Creates a hunspell instance for the current dictionary
+     * that also accepts all the words added to it.
+     */
+    Hunspell *createHunspell() const;
+
+    /**
+     * Borrows a hunspell instance from the pool, creating one
+     * if all are in use and there are fewer than cores.
+     */
+    Hunspell *acquireHunspell();
+    void releaseHunspell(Hunspell *hunspell);
+    void deleteHunspells();
+
+    /**
+     * Adds a word to every hunspell instance. The caller must
+     * hold the write lock.
+     */
+    void addWord(const QString &word);
+
     Hunspell *m_hunspell;
     QTextCodec *m_codec;
     QString m_wordchars;
@@ -78,6 +112,25 @@ private:
     //
     QHash<QString, QString> m_dictionaries;
     QStringList m_ignoredWords;
+    QAtomicInt m_revision;
+
+    // Guards the dictionary and the words added to it.
+    // Checks hold it for reading, changes for writing.
+    mutable QReadWriteLock m_lock;
+
+    QString m_affFile;
+    QString m_dicFile;
+    QString m_hyphDicFile;
+    QStringList m_addedWords;
+
+    QList<Hunspell *> m_hunspells;
+    QList<Hunspell *> m_idleHunspells;
+    int m_hunspellCount;
+    QMutex m_poolMutex;
+    QWaitCondition m_hunspellReleased;
+
+    QHash<QString, bool> m_verdicts;
+    QReadWriteLock m_verdictsLock;
 
     static SpellCheck *m_instance;
 };
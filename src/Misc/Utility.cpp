@@ -50,6 +50,11 @@
 #include <QFile>
 #include <QFileInfo>
 
+// Q_OS_MAC is only defined once a Qt header is in.
+#ifdef Q_OS_MAC
+#include <copyfile.h>
+#endif
+
 #include "sigil_exception.h"
 #include "Misc/QCodePage437Codec.h"
 
@@ -319,6 +324,30 @@ bool Utility::RenameFile(const QString &oldfilepath, const QString &newfilepath)
 }
 
 
+bool Utility::ReplaceFile(const QString &sourcefilepath, const QString &destfilepath)
+{
+    if (!QFileInfo(sourcefilepath).exists()) {
+        return false;
+    }
+
+    if (QFileInfo(destfilepath).exists()) {
+        QFile::setPermissions(sourcefilepath, QFile::permissions(destfilepath));
+#if defined(Q_OS_MAC)
+        // Things like Finder labels are stored as extended attributes.
+        copyfile(destfilepath.toUtf8().data(), sourcefilepath.toUtf8().data(), NULL, COPYFILE_XATTR);
+#endif
+    }
+
+#if defined(Q_OS_WIN32)
+    return MoveFileExW(Utility::QStringToStdWString(QDir::toNativeSeparators(sourcefilepath)).data(),
+                       Utility::QStringToStdWString(QDir::toNativeSeparators(destfilepath)).data(),
+                       MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    return rename(sourcefilepath.toUtf8().data(), destfilepath.toUtf8().data()) == 0;
+#endif
+}
+
+
 QString Utility::GetTemporaryFileNameWithExtension(const QString &extension)
 {
     return QDir::temp().absolutePath() + "/sigil_" + Utility::CreateUUID() + extension;
@@ -394,6 +423,17 @@ QString Utility::ReadUnicodeTextFile(const QString &fullfilepath)
 }
 
 
+// Decodes text that has already been read into memory
+// the same way ReadUnicodeTextFile() decodes a file
+QString Utility::DecodeUnicodeText(const QByteArray &data)
+{
+    QTextStream in(data);
+    in.setCodec("UTF-8");
+    in.setAutoDetectUnicode(true);
+    return ConvertLineEndings(in.readAll());
+}
+
+
 // Writes the provided text variable to the specified
 // file; if the file exists, it is truncated
 void Utility::WriteUnicodeTextFile(const QString &text, const QString &fullfilepath)
@@ -86,6 +86,11 @@ public:
 
     static bool RenameFile(const QString &oldfilepath, const QString &newfilepath);
 
+    // Moves the file over the destination in one step, so the
+    // destination is never left half written. Permissions (and
+    // extended attributes on OS X) of the old destination are kept
+    static bool ReplaceFile(const QString &sourcefilepath, const QString &destfilepath);
+
     // Returns path to a random filename with the specified extension in
     // the systems TEMP directory. The caller has responsibility for
     // creating a file at this location and removing it afterwards.
@@ -107,6 +112,10 @@ public:
     // be read, an error dialog is shown and an empty string returned
     static QString ReadUnicodeTextFile(const QString &fullfilepath);
 
+    // Decodes text that has already been read into memory
+    // the same way ReadUnicodeTextFile() decodes a file
+    static QString DecodeUnicodeText(const QByteArray &data);
+
     // Writes the provided text variable to the specified
     // file; if the file exists, it is truncated
     static void WriteUnicodeTextFile(const QString &text, const QString &fullfilepath);
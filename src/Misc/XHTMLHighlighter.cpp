@@ -19,7 +19,9 @@
 **
 *************************************************************************/
 
+#include <QtCore/QElapsedTimer>
 #include <QRegularExpressionMatch>
+#include <QtGui/QTextDocument>
 
 #include "Misc/SpellCheck.h"
 #include "Misc/Utility.h"
@@ -50,13 +52,56 @@ static const QString ATTRIBUTE_NAME         = "[\\w:-]+";
 static const QString ENTITY_BEGIN           = "&(?=[^\\s;]+;)";
 static const QString ENTITY_END             = ";";
 
+// How long the queued spell checks may keep
+// the event loop busy before yielding
+static const int SPELLING_SLICE_MSECS = 10;
+
+
+// The misspelled words of a block, kept with the block so they survive
+// rehighlighting. They are valid while the block text and the spell
+// check revision match the ones they were found for.
+class SpellingData : public QTextBlockUserData
+{
+public:
+    uint text_hash;
+    int spelling_revision;
+    QList<HTMLSpellCheck::MisspelledWord> words;
+};
+
+
+static QRegularExpression CompiledRegEx(const QString &pattern)
+{
+    QRegularExpression regex(pattern);
+    regex.optimize();
+    return regex;
+}
+
 
 // Constructor
 XHTMLHighlighter::XHTMLHighlighter(bool checkSpelling, QObject *parent)
     : QSyntaxHighlighter(parent),
-      m_checkSpelling(checkSpelling)
+      m_checkSpelling(checkSpelling),
+      m_FirstVisibleBlock(0)
 
 {
+    // Compiled once and shared by every highlighter;
+    // in the same order as the Rule enum
+    static const QRegularExpression patterns[Rule_Count] = {
+        CompiledRegEx(DOCTYPE_BEGIN),
+        CompiledRegEx(HTML_ELEMENT_BEGIN),
+        CompiledRegEx(HTML_ELEMENT_NAME),
+        CompiledRegEx(HTML_ELEMENT_END),
+        CompiledRegEx(HTML_COMMENT_BEGIN),
+        CompiledRegEx(HTML_COMMENT_END),
+        CompiledRegEx(CSS_BEGIN),
+        CompiledRegEx(CSS_END),
+        CompiledRegEx(CSS_COMMENT_BEGIN),
+        CompiledRegEx(CSS_COMMENT_END),
+        CompiledRegEx(ATTRIBUTE_NAME),
+        CompiledRegEx(ATTRIBUTE_VALUE),
+        CompiledRegEx(ENTITY_BEGIN),
+        CompiledRegEx(ENTITY_END)
+    };
     SettingsStore settings;
     m_codeViewAppearance = settings.codeViewAppearance();
     QTextCharFormat html_format;
@@ -75,46 +120,42 @@ XHTMLHighlighter::XHTMLHighlighter(bool checkSpelling, QObject *parent)
     attribute_name_format .setForeground(m_codeViewAppearance.xhtml_attribute_name_color);
     attribute_value_format.setForeground(m_codeViewAppearance.xhtml_attribute_value_color);
     entity_format         .setForeground(m_codeViewAppearance.xhtml_entity_color);
-    HighlightingRule rule;
-    rule.pattern = QRegularExpression(DOCTYPE_BEGIN);
-    rule.format  = doctype_format;
-    m_Rules[ "DOCTYPE_BEGIN" ] = rule;
-    rule.pattern = QRegularExpression(HTML_ELEMENT_BEGIN);
-    rule.format  = html_format;
-    m_Rules[ "HTML_ELEMENT_BEGIN" ] = rule;
-    rule.pattern = QRegularExpression(HTML_ELEMENT_END);
-    rule.format  = html_format;
-    m_Rules[ "HTML_ELEMENT_END" ] = rule;
-    rule.pattern = QRegularExpression(HTML_COMMENT_BEGIN);
-    rule.format  = html_comment_format;
-    m_Rules[ "HTML_COMMENT_BEGIN" ] = rule;
-    rule.pattern = QRegularExpression(HTML_COMMENT_END);
-    rule.format  = html_comment_format;
-    m_Rules[ "HTML_COMMENT_END" ] = rule;
-    rule.pattern = QRegularExpression(CSS_BEGIN);
-    rule.format  = css_format;
-    m_Rules[ "CSS_BEGIN" ] = rule;
-    rule.pattern = QRegularExpression(CSS_END);
-    rule.format  = css_format;
-    m_Rules[ "CSS_END" ] = rule;
-    rule.pattern = QRegularExpression(CSS_COMMENT_BEGIN);
-    rule.format  = css_comment_format;
-    m_Rules[ "CSS_COMMENT_BEGIN" ] = rule;
-    rule.pattern = QRegularExpression(CSS_COMMENT_END);
-    rule.format  = css_comment_format;
-    m_Rules[ "CSS_COMMENT_END" ] = rule;
-    rule.pattern = QRegularExpression(ATTRIBUTE_NAME);
-    rule.format  = attribute_name_format;
-    m_Rules[ "ATTRIBUTE_NAME" ] = rule;
-    rule.pattern = QRegularExpression(ATTRIBUTE_VALUE);
-    rule.format  = attribute_value_format;
-    m_Rules[ "ATTRIBUTE_VALUE" ] = rule;
-    rule.pattern = QRegularExpression(ENTITY_BEGIN);
-    rule.format  = entity_format;
-    m_Rules[ "ENTITY_BEGIN" ] = rule;
-    rule.pattern = QRegularExpression(ENTITY_END);
-    rule.format  = entity_format;
-    m_Rules[ "ENTITY_END" ] = rule;
+    const QTextCharFormat formats[Rule_Count] = {
+        doctype_format,
+        html_format,
+        html_format,
+        html_format,
+        html_comment_format,
+        html_comment_format,
+        css_format,
+        css_format,
+        css_comment_format,
+        css_comment_format,
+        attribute_name_format,
+        attribute_value_format,
+        entity_format,
+        entity_format
+    };
+
+    for (int i = 0; i < Rule_Count; ++i) {
+        m_Rules[i].pattern = patterns[i];
+        m_Rules[i].format  = formats[i];
+    }
+
+    m_SpellingFormat.setUnderlineColor(m_codeViewAppearance.spelling_underline_color);
+    // QTextCharFormat::SpellCheckUnderline has issues with Qt 5. It only displays
+    // at some zoom levels and often doesn't display at all. So we're using wave
+    // underline since it's good enough for most people.
+    m_SpellingFormat.setUnderlineStyle(QTextCharFormat::WaveUnderline);
+    m_SpellingTimer.setSingleShot(true);
+    m_SpellingTimer.setInterval(0);
+    connect(&m_SpellingTimer, SIGNAL(timeout()), this, SLOT(CheckQueuedSpelling()));
+}
+
+
+void XHTMLHighlighter::SetFirstVisibleBlock(int block_number)
+{
+    m_FirstVisibleBlock = block_number;
 }
 
 
@@ -123,6 +164,17 @@ XHTMLHighlighter::XHTMLHighlighter(bool checkSpelling, QObject *parent)
 // a block (line of text) needs to be repainted
 void XHTMLHighlighter::highlightBlock(const QString &text)
 {
+    // The order of the nodes is important
+    // because some states format text over previous states!
+    static const Node nodes[] = {
+        { State_Entity,      Rule_EntityBegin,      Rule_EntityEnd      },
+        { State_CSS,         Rule_CSSBegin,         Rule_CSSEnd         },
+        { State_HTML,        Rule_HTMLElementBegin, Rule_HTMLElementEnd },
+        { State_CSSComment,  Rule_CSSCommentBegin,  Rule_CSSCommentEnd  },
+        { State_HTMLComment, Rule_HTMLCommentBegin, Rule_HTMLCommentEnd },
+        { State_DOCTYPE,     Rule_DOCTYPEBegin,     Rule_HTMLElementEnd }
+    };
+
     // By default, all block states are -1;
     // in our implementation regular text is state == 1
     if (previousBlockState() == -1) {
@@ -137,79 +189,16 @@ void XHTMLHighlighter::highlightBlock(const QString &text)
         return;
     }
 
-    SettingsStore settings;
-    m_enableSpellCheck = settings.spellCheck();
+    m_enableSpellCheck = SettingsStore::snapshot().spell_check;
 
-    // Run spell check over the text.
+    // Underline misspellings. The spell check itself runs
+    // in CheckQueuedSpelling so typing isn't slowed down by it.
     if (m_enableSpellCheck && m_checkSpelling) {
-        CheckSpelling(text);
+        ApplySpelling(text);
     }
 
-    // The order of these operations is important
-    // because some states format text over previous states!
-    HighlightLine(text, State_Entity);
-    HighlightLine(text, State_CSS);
-    HighlightLine(text, State_HTML);
-    HighlightLine(text, State_CSSComment);
-    HighlightLine(text, State_HTMLComment);
-    HighlightLine(text, State_DOCTYPE);
-}
-
-
-// Returns the regex that matches the left bracket of a state
-QRegularExpression XHTMLHighlighter::GetLeftBracketRegEx(int state) const
-{
-    QRegularExpression empty;
-
-    switch (state) {
-        case State_Entity:
-            return m_Rules.value("ENTITY_BEGIN").pattern;
-
-        case State_HTML:
-            return m_Rules.value("HTML_ELEMENT_BEGIN").pattern;
-
-        case State_HTMLComment:
-            return m_Rules.value("HTML_COMMENT_BEGIN").pattern;
-
-        case State_CSS:
-            return m_Rules.value("CSS_BEGIN").pattern;
-
-        case State_CSSComment:
-            return m_Rules.value("CSS_COMMENT_BEGIN").pattern;
-
-        case State_DOCTYPE:
-            return m_Rules.value("DOCTYPE_BEGIN").pattern;
-
-        default:
-            return empty;
-    }
-}
-
-
-// Returns the regex that matches the right bracket of a state
-QRegularExpression XHTMLHighlighter::GetRightBracketRegEx(int state) const
-{
-    QRegularExpression empty;
-
-    switch (state) {
-        case State_Entity:
-            return m_Rules.value("ENTITY_END").pattern;
-
-        case State_DOCTYPE:
-        case State_HTML:
-            return m_Rules.value("HTML_ELEMENT_END").pattern;
-
-        case State_HTMLComment:
-            return m_Rules.value("HTML_COMMENT_END").pattern;
-
-        case State_CSS:
-            return m_Rules.value("CSS_END").pattern;
-
-        case State_CSSComment:
-            return m_Rules.value("CSS_COMMENT_END").pattern;
-
-        default:
-            return empty;
+    for (unsigned int i = 0; i < sizeof(nodes) / sizeof(nodes[0]); ++i) {
+        HighlightLine(text, nodes[i]);
     }
 }
 
@@ -257,23 +246,21 @@ void XHTMLHighlighter::FormatBody(const QString &text, int state, int index, int
 {
     if (state == State_HTML) {
         // First paint everything the color of the brackets
-        setFormat(index, length, m_Rules.value("HTML_ELEMENT_BEGIN").format);
-        QRegularExpression name  = m_Rules.value("ATTRIBUTE_NAME").pattern;
-        QRegularExpression value = m_Rules.value("ATTRIBUTE_VALUE").pattern;
+        setFormat(index, length, m_Rules[Rule_HTMLElementBegin].format);
+        const QRegularExpression &name  = m_Rules[Rule_AttributeName].pattern;
+        const QRegularExpression &value = m_Rules[Rule_AttributeValue].pattern;
         // Used to move over the line
         int main_index = index;
 
         // We skip over the left bracket (if it's present)
-        QRegularExpression bracket(HTML_ELEMENT_BEGIN);
-        QRegularExpressionMatch bracket_match = bracket.match(text, main_index);
+        QRegularExpressionMatch bracket_match = m_Rules[Rule_HTMLElementBegin].pattern.match(text, main_index);
         if (bracket_match.hasMatch() && bracket_match.capturedStart() == main_index) {
             main_index += bracket_match.capturedLength();
         }
 
         // We skip over the element name (if it's present)
         // because we want it to be the same color as the brackets
-        QRegularExpression elem_name(HTML_ELEMENT_NAME);
-        QRegularExpressionMatch elem_name_match = elem_name.match(text, main_index);
+        QRegularExpressionMatch elem_name_match = m_Rules[Rule_HTMLElementName].pattern.match(text, main_index);
         if (elem_name_match.hasMatch() && elem_name_match.capturedStart() == main_index) {
             main_index += elem_name_match.capturedLength();
         }
@@ -301,8 +288,8 @@ void XHTMLHighlighter::FormatBody(const QString &text, int state, int index, int
             if (((name_index  != -1) && (name_index  < index + length)) ||
                 ((value_index != -1) && (value_index < index + length))) {
                 // ... otherwise format the found sections
-                setFormat(name_index,  name_len,  m_Rules.value("ATTRIBUTE_NAME").format);
-                setFormat(value_index, value_len, m_Rules.value("ATTRIBUTE_VALUE").format);
+                setFormat(name_index,  name_len,  m_Rules[Rule_AttributeName].format);
+                setFormat(value_index, value_len, m_Rules[Rule_AttributeValue].format);
             } else {
                 break;
             }
@@ -315,26 +302,27 @@ void XHTMLHighlighter::FormatBody(const QString &text, int state, int index, int
             }
         }
     } else if (state == State_HTMLComment) {
-        setFormat(index, length, m_Rules.value("HTML_COMMENT_BEGIN").format);
+        setFormat(index, length, m_Rules[Rule_HTMLCommentBegin].format);
     } else if (state == State_CSS) {
-        setFormat(index, length, m_Rules.value("CSS_BEGIN").format);
+        setFormat(index, length, m_Rules[Rule_CSSBegin].format);
     } else if (state == State_CSSComment) {
-        setFormat(index, length, m_Rules.value("CSS_COMMENT_BEGIN").format);
+        setFormat(index, length, m_Rules[Rule_CSSCommentBegin].format);
     } else if (state == State_Entity) {
-        setFormat(index, length, m_Rules.value("ENTITY_BEGIN").format);
+        setFormat(index, length, m_Rules[Rule_EntityBegin].format);
     } else if (state == State_DOCTYPE) {
-        setFormat(index, length, m_Rules.value("DOCTYPE_BEGIN").format);
+        setFormat(index, length, m_Rules[Rule_DOCTYPEBegin].format);
     }
 }
 
 
-// Highlights the current line according to the state requested;
-// check to see if the node of type "state" is present;
+// Highlights the current line for the requested node;
+// check to see if the node is present;
 // if it is, the node is formatted
-void XHTMLHighlighter::HighlightLine(const QString &text, int state)
+void XHTMLHighlighter::HighlightLine(const QString &text, const Node &node)
 {
-    QRegularExpression left_bracket_regex  = GetLeftBracketRegEx(state);
-    QRegularExpression right_bracket_regex = GetRightBracketRegEx(state);
+    const int state = node.state;
+    const QRegularExpression &left_bracket_regex  = m_Rules[node.left_bracket].pattern;
+    const QRegularExpression &right_bracket_regex = m_Rules[node.right_bracket].pattern;
     int main_index = 0;
 
     // We loop over the line several times
@@ -345,20 +333,10 @@ void XHTMLHighlighter::HighlightLine(const QString &text, int state)
         int right_bracket_index = -1;
         int right_bracket_len = 0;
 
-        if (!left_bracket_regex.pattern().isEmpty()) {
-            QRegularExpressionMatch left_bracket_match = left_bracket_regex.match(text, main_index);
-            if (left_bracket_match.hasMatch()) {
-                left_bracket_index = left_bracket_match.capturedStart();
-                left_bracket_len = left_bracket_match.capturedLength();
-            }
-        }
-
-        if (!right_bracket_regex.pattern().isEmpty()) {
-            QRegularExpressionMatch right_bracket_match = right_bracket_regex.match(text, main_index);
-            if (right_bracket_match.hasMatch()) {
-                right_bracket_index = right_bracket_match.capturedStart();
-                right_bracket_len = right_bracket_match.capturedLength();
-            }
+        QRegularExpressionMatch left_bracket_match = left_bracket_regex.match(text, main_index);
+        if (left_bracket_match.hasMatch()) {
+            left_bracket_index = left_bracket_match.capturedStart();
+            left_bracket_len = left_bracket_match.capturedLength();
         }
 
         // If we are not starting our state and our state is
@@ -367,6 +345,12 @@ void XHTMLHighlighter::HighlightLine(const QString &text, int state)
             return;
         }
 
+        QRegularExpressionMatch right_bracket_match = right_bracket_regex.match(text, main_index);
+        if (right_bracket_match.hasMatch()) {
+            right_bracket_index = right_bracket_match.capturedStart();
+            right_bracket_len = right_bracket_match.capturedLength();
+        }
+
         // Every node/state has a left "bracket", a right "bracket" and the inside body.
         // This example uses HTML tags, but the principle is the same for every node/state.
         // There are four possible cases:
@@ -417,16 +401,99 @@ void XHTMLHighlighter::HighlightLine(const QString &text, int state)
 }
 
 
-void XHTMLHighlighter::CheckSpelling(const QString &text)
+void XHTMLHighlighter::ApplySpelling(const QString &text)
 {
-    QTextCharFormat format;
-    format.setUnderlineColor(m_codeViewAppearance.spelling_underline_color);
-    // QTextCharFormat::SpellCheckUnderline has issues with Qt 5. It only displays
-    // at some zoom levels and often doesn't display at all. So we're using wave
-    // underline since it's good enough for most people.
-    format.setUnderlineStyle(QTextCharFormat::WaveUnderline);
-    QList<HTMLSpellCheck::MisspelledWord> misspelled_words = HTMLSpellCheck::GetMisspelledWords(text);
-    foreach(HTMLSpellCheck::MisspelledWord misspelled_word, misspelled_words) {
-        setFormat(misspelled_word.offset, misspelled_word.length, format);
+    SpellingData *data = static_cast<SpellingData *>(currentBlockUserData());
+
+    // Words found for older text would be underlined in the wrong place
+    if (!data || data->text_hash != qHash(text)) {
+        QueueSpelling(currentBlock().blockNumber());
+        return;
+    }
+
+    // After a dictionary change the old results are still shown
+    // until the recheck is done so the underlines don't flicker
+    if (data->spelling_revision != SpellCheck::instance()->revision()) {
+        QueueSpelling(currentBlock().blockNumber());
+    }
+
+    foreach(HTMLSpellCheck::MisspelledWord misspelled_word, data->words) {
+        setFormat(misspelled_word.offset, misspelled_word.length, m_SpellingFormat);
+    }
+}
+
+
+void XHTMLHighlighter::QueueSpelling(int block_number)
+{
+    m_PendingSpelling.insert(block_number);
+
+    if (!m_SpellingTimer.isActive()) {
+        m_SpellingTimer.start();
+    }
+}
+
+
+void XHTMLHighlighter::CheckQueuedSpelling()
+{
+    QTextDocument *doc = document();
+
+    if (!doc || !SettingsStore::snapshot().spell_check) {
+        m_PendingSpelling.clear();
+        return;
+    }
+
+    int spelling_revision = SpellCheck::instance()->revision();
+    QElapsedTimer timer;
+    timer.start();
+
+    while (!m_PendingSpelling.empty() && timer.elapsed() < SPELLING_SLICE_MSECS) {
+        // Blocks from the top of the viewport down are checked first,
+        // then we wrap around to the ones above it.
+        std::set<int>::iterator next = m_PendingSpelling.lower_bound(m_FirstVisibleBlock);
+
+        if (next == m_PendingSpelling.end()) {
+            next = m_PendingSpelling.begin();
+        }
+
+        // Block numbers shift as lines are added and removed, so a queued
+        // number may now be another block. That's fine since every block
+        // is checked against the text its results were found for.
+        QTextBlock block = doc->findBlockByNumber(*next);
+        m_PendingSpelling.erase(next);
+
+        if (!block.isValid()) {
+            continue;
+        }
+
+        QString text = block.text();
+        uint text_hash = qHash(text);
+        SpellingData *data = static_cast<SpellingData *>(block.userData());
+
+        if (data && data->text_hash == text_hash && data->spelling_revision == spelling_revision) {
+            continue;
+        }
+
+        bool was_underlined = data && data->text_hash == text_hash && !data->words.isEmpty();
+
+        if (!data) {
+            data = new SpellingData();
+            block.setUserData(data);
+        }
+
+        data->text_hash = text_hash;
+        data->spelling_revision = spelling_revision;
+        data->words = HTMLSpellCheck::GetMisspelledWords(text);
+
+        if (was_underlined || !data->words.isEmpty()) {
+            // Like CodeViewEditor::RehighlightDocument we block the document's
+            // signals so the new formatting isn't taken for an edit.
+            doc->blockSignals(true);
+            rehighlightBlock(block);
+            doc->blockSignals(false);
+        }
+    }
+
+    if (!m_PendingSpelling.empty()) {
+        m_SpellingTimer.start();
     }
 }
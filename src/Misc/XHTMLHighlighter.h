@@ -23,6 +23,9 @@
 #ifndef XHTMLHIGHLIGHTER_H
 #define XHTMLHIGHLIGHTER_H
 
+#include <set>
+
+#include <QtCore/QTimer>
 #include <QtGui/QSyntaxHighlighter>
 #include <QRegularExpression>
 
@@ -30,12 +33,17 @@
 
 class XHTMLHighlighter : public QSyntaxHighlighter
 {
+    Q_OBJECT
 
 public:
 
     // Constructor
     XHTMLHighlighter(bool checkSpelling, QObject *parent = 0);
 
+    // Sets the block at the top of the editor's viewport;
+    // queued spell checks start from there
+    void SetFirstVisibleBlock(int block_number);
+
 protected:
 
     // Overrides the function from QSyntaxHighlighter;
@@ -43,13 +51,56 @@ protected:
     // a block (line of text) needs to be repainted
     void highlightBlock(const QString &text);
 
+private slots:
+
+    // Spell checks queued blocks for one time slice and
+    // rehighlights the blocks whose underlines changed
+    void CheckQueuedSpelling();
+
 private:
 
-    // Returns the regex that matches the left bracket of a state
-    QRegularExpression GetLeftBracketRegEx(int state) const;
+    // Al the possible nodes/states
+    enum BlockState {
+        State_Text          = 1 << 0,
+        State_Entity        = 1 << 1,
+        State_HTML          = 1 << 2,
+        State_CSS           = 1 << 3,
+        State_CSSComment    = 1 << 4,
+        State_HTMLComment   = 1 << 5,
+        State_DOCTYPE       = 1 << 6
+    };
+
+    // The patterns used to find nodes and their parts
+    enum Rule {
+        Rule_DOCTYPEBegin,
+        Rule_HTMLElementBegin,
+        Rule_HTMLElementName,
+        Rule_HTMLElementEnd,
+        Rule_HTMLCommentBegin,
+        Rule_HTMLCommentEnd,
+        Rule_CSSBegin,
+        Rule_CSSEnd,
+        Rule_CSSCommentBegin,
+        Rule_CSSCommentEnd,
+        Rule_AttributeName,
+        Rule_AttributeValue,
+        Rule_EntityBegin,
+        Rule_EntityEnd,
+        Rule_Count
+    };
 
-    // Returns the regex that matches the right bracket of a state
-    QRegularExpression GetRightBracketRegEx(int state) const;
+    // A node type: its state and the rules
+    // matching its left and right "brackets"
+    struct Node {
+        BlockState state;
+        Rule left_bracket;
+        Rule right_bracket;
+    };
+
+    struct HighlightingRule {
+        QRegularExpression pattern;
+        QTextCharFormat format;
+    };
 
     // Sets the requested state for the current text block
     void SetState(int state);
@@ -68,37 +119,28 @@ private:
     // "length" is the length of chars to format
     void FormatBody(const QString &text, int state, int index, int length);
 
-    // Highlights the current line according to the state requested;
-    // check to see if the node of type "state" is present;
+    // Highlights the current line for the requested node;
+    // check to see if the node is present;
     // if it is, the node is formatted
-    void HighlightLine(const QString &text, int state);
+    void HighlightLine(const QString &text, const Node &node);
 
-    void CheckSpelling(const QString &text);
+    // Underlines the misspelled words found for the current block,
+    // queueing the block if it hasn't been checked since it changed
+    void ApplySpelling(const QString &text);
+
+    // Adds a block to the spell check queue
+    void QueueSpelling(int block_number);
 
 
     ///////////////////////////////
     // PRIVATE MEMBER VARIABLES
     ///////////////////////////////
 
-    // Al the possible nodes/states
-    enum BlockState {
-        State_Text          = 1 << 0,
-        State_Entity        = 1 << 1,
-        State_HTML          = 1 << 2,
-        State_CSS           = 1 << 3,
-        State_CSSComment    = 1 << 4,
-        State_HTMLComment   = 1 << 5,
-        State_DOCTYPE       = 1 << 6
-    };
-
-    struct HighlightingRule {
-        QRegularExpression pattern;
-        QTextCharFormat format;
-    };
-
     // Stores all of our highlighting rules
     // and the text formats used
-    QHash<QString, HighlightingRule> m_Rules;
+    HighlightingRule m_Rules[Rule_Count];
+
+    QTextCharFormat m_SpellingFormat;
 
     // Determine if spell check should be used on the document.
     bool m_checkSpelling;
@@ -106,8 +148,14 @@ private:
     // Determine if automatic spell check is enabled
     bool m_enableSpellCheck;
 
+    // Numbers of the blocks waiting to be spell checked
+    std::set<int> m_PendingSpelling;
+
+    int m_FirstVisibleBlock;
+
+    QTimer m_SpellingTimer;
+
     SettingsStore::CodeViewAppearance m_codeViewAppearance;
 };
 
 #endif // XHTMLHIGHLIGHTER_H
-
@@ -0,0 +1,400 @@
+/************************************************************************
+**
+**  Copyright (C) 2026 agent <agent@local>
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#include <algorithm>
+
+#include <QHash>
+#include <QXmlStreamReader>
+
+#include "XMLPrettyPrint.h"
+
+// must be kept in sync with ebook_xml_empty_tags in xmlprocessor.py
+static const QStringList defaultEmptyElementTags = QStringList()
+                                                   << "meta"
+                                                   << "item"
+                                                   << "itemref"
+                                                   << "reference"
+                                                   << "content";
+
+// must be kept in sync with EBOOK_XML_PARENT_TAGS in sigil_bs4
+static const QStringList xmlParentTags = QStringList()
+                                         << "package"
+                                         << "metadata"
+                                         << "manifest"
+                                         << "spine"
+                                         << "guide"
+                                         << "ncx"
+                                         << "head"
+                                         << "doctitle"
+                                         << "docauthor"
+                                         << "navmap"
+                                         << "navpoint"
+                                         << "navlabel"
+                                         << "pagelist"
+                                         << "pagetarget";
+
+static const QString XML_NAMESPACE = "http://www.w3.org/XML/1998/namespace";
+static const QString XML_DECLARATION = "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n";
+
+// The ascii whitespace that bs4 collapses in whitespace only strings
+static bool IsAsciiSpace(QChar c)
+{
+    ushort u = c.unicode();
+    return u == 0x20 || u == 0x0a || u == 0x09 || u == 0x0c || u == 0x0d;
+}
+
+// the "minimal" bs4 formatter, optionally also escaping double quotes
+// the way quoted_attribute_value does
+static void AppendEscaped(const QString &text, bool is_attribute, QString &out)
+{
+    const QChar *p = text.constData();
+    const QChar *end = p + text.length();
+    const QChar *run = p;
+    for (; p != end; ++p) {
+        const char *entity = NULL;
+        switch (p->unicode()) {
+            case '&': entity = "&amp;";  break;
+            case '<': entity = "&lt;";   break;
+            case '>': entity = "&gt;";   break;
+            case '"': entity = is_attribute ? "&quot;" : NULL; break;
+            default: break;
+        }
+        if (entity) {
+            out.append(run, p - run);
+            out.append(QLatin1String(entity));
+            run = p + 1;
+        }
+    }
+    out.append(run, end - run);
+}
+
+static bool AttributeLessThan(const QPair<QString, QString> &a, const QPair<QString, QString> &b)
+{
+    return a.first < b.first;
+}
+
+
+XMLPrettyPrint::XMLPrettyPrint(const QString &source)
+    : m_source(source),
+      m_root(NULL),
+      m_wellFormed(false),
+      m_indentChars("  "),
+      m_emptyElementTags(defaultEmptyElementTags)
+{
+    parse();
+}
+
+XMLPrettyPrint::~XMLPrettyPrint()
+{
+    Q_FOREACH(XMLNode * n, m_nodes) {
+        delete n;
+    }
+    m_nodes.clear();
+}
+
+bool XMLPrettyPrint::isWellFormed() const
+{
+    return m_wellFormed;
+}
+
+void XMLPrettyPrint::setIndentChars(const QString &indent)
+{
+    m_indentChars = indent;
+}
+
+void XMLPrettyPrint::setEmptyElementTags(const QStringList &tags)
+{
+    m_emptyElementTags = tags;
+}
+
+QString XMLPrettyPrint::prettyPrint()
+{
+    if (!m_wellFormed) {
+        return QString();
+    }
+    QString out;
+    // the pretty printed result is rarely much bigger than its source
+    out.reserve(m_source.length() + m_source.length() / 4 + XML_DECLARATION.length());
+    out.append(XML_DECLARATION);
+    serializeContents(m_root, 1, out);
+    return out;
+}
+
+XMLPrettyPrint::XMLNode *XMLPrettyPrint::newNode(NODE_TYPE type, XMLNode *parent)
+{
+    XMLNode *node = new XMLNode();
+    node->type = type;
+    m_nodes.append(node);
+    if (parent) {
+        parent->children.append(node);
+    }
+    return node;
+}
+
+// Adds any pending character data to the parent, collapsing whitespace
+// only strings to a single space or newline just as bs4 endData() does
+void XMLPrettyPrint::flushText(QString &text, XMLNode *parent)
+{
+    if (text.isEmpty()) {
+        return;
+    }
+    bool strippable = true;
+    foreach(QChar c, text) {
+        if (!IsAsciiSpace(c)) {
+            strippable = false;
+            break;
+        }
+    }
+    if (strippable) {
+        text = text.contains('\n') ? QString("\n") : QString(" ");
+    }
+    XMLNode *node = newNode(NODE_TYPE_TEXT, parent);
+    node->value = text;
+    text.clear();
+}
+
+void XMLPrettyPrint::parse()
+{
+    m_root = newNode(NODE_TYPE_ROOT, NULL);
+
+    // stack of inverted namespace maps (namespace uri -> prefix) where
+    // an empty prefix stands for the default namespace
+    QList<QHash<QString, QString> > nsmaps;
+    QHash<QString, QString> default_nsmap;
+    default_nsmap.insert(XML_NAMESPACE, "xml");
+    nsmaps.append(default_nsmap);
+
+    QList<XMLNode *> stack;
+    stack.append(m_root);
+    QString text;
+
+    QXmlStreamReader reader(m_source);
+    while (!reader.atEnd()) {
+        reader.readNext();
+        switch (reader.tokenType()) {
+            case QXmlStreamReader::StartElement: {
+                flushText(text, stack.last());
+                QHash<QString, QString> nsmap;
+                QList<QPair<QString, QString> > attributes;
+                foreach(QXmlStreamNamespaceDeclaration decl, reader.namespaceDeclarations()) {
+                    QString prefix = decl.prefix().toString();
+                    nsmap.insert(decl.namespaceUri().toString(), prefix);
+                    attributes.append(qMakePair(prefix.isEmpty() ? QString("xmlns") : "xmlns:" + prefix,
+                                                decl.namespaceUri().toString()));
+                }
+                nsmaps.append(nsmap);
+
+                foreach(QXmlStreamAttribute attr, reader.attributes()) {
+                    QString name = attr.name().toString();
+                    QString ns = attr.namespaceUri().toString();
+                    if (!ns.isEmpty()) {
+                        // attributes use the innermost prefix bound to their namespace
+                        for (int i = nsmaps.count() - 1; i >= 0; --i) {
+                            if (nsmaps.at(i).contains(ns)) {
+                                QString prefix = nsmaps.at(i).value(ns);
+                                if (!prefix.isEmpty()) {
+                                    name = prefix + ":" + name;
+                                }
+                                break;
+                            }
+                        }
+                    }
+                    attributes.append(qMakePair(name, attr.value().toString()));
+                }
+                std::sort(attributes.begin(), attributes.end(), AttributeLessThan);
+
+                // tags use the most recent prefix bound to their namespace
+                // unless it was ever bound as the default namespace
+                QString prefix;
+                QString ns = reader.namespaceUri().toString();
+                if (!ns.isEmpty()) {
+                    foreach(const QHash<QString, QString> &map, nsmaps) {
+                        if (map.contains(ns)) {
+                            prefix = map.value(ns);
+                            if (prefix.isEmpty()) {
+                                break;
+                            }
+                        }
+                    }
+                }
+
+                XMLNode *node = newNode(NODE_TYPE_ELEMENT, stack.last());
+                node->name = reader.name().toString();
+                node->value = prefix.isEmpty() ? node->name : prefix + ":" + node->name;
+                node->attributes = attributes;
+                stack.append(node);
+                break;
+            }
+            case QXmlStreamReader::EndElement:
+                flushText(text, stack.last());
+                stack.removeLast();
+                nsmaps.removeLast();
+                break;
+            case QXmlStreamReader::Characters:
+                // character data outside of the root element is never kept
+                if (stack.count() > 1) {
+                    text.append(reader.text());
+                }
+                break;
+            case QXmlStreamReader::Comment: {
+                flushText(text, stack.last());
+                XMLNode *node = newNode(NODE_TYPE_COMMENT, stack.last());
+                node->value = reader.text().toString();
+                break;
+            }
+            case QXmlStreamReader::ProcessingInstruction: {
+                flushText(text, stack.last());
+                XMLNode *node = newNode(NODE_TYPE_PI, stack.last());
+                node->value = reader.processingInstructionTarget().toString() + " " +
+                              reader.processingInstructionData().toString();
+                break;
+            }
+            case QXmlStreamReader::DTD: {
+                flushText(text, stack.last());
+                XMLNode *node = newNode(NODE_TYPE_DOC_TYPE, stack.last());
+                QString value = reader.dtdName().toString();
+                QString pubid = reader.dtdPublicId().toString();
+                QString sysid = reader.dtdSystemId().toString();
+                if (!pubid.isEmpty()) {
+                    value += " PUBLIC \"" + pubid + "\"";
+                    if (!sysid.isEmpty()) {
+                        value += " \"" + sysid + "\"";
+                    }
+                } else if (!sysid.isEmpty()) {
+                    value += " SYSTEM \"" + sysid + "\"";
+                }
+                node->value = value;
+                break;
+            }
+            case QXmlStreamReader::EntityReference:
+                // unresolved entities need the recovering parser
+                reader.raiseError("unresolved entity reference");
+                break;
+            default:
+                break;
+        }
+    }
+    m_wellFormed = !reader.hasError();
+}
+
+// The bs4 .string property: the only string child of a node, looking
+// through any chain of single child elements
+const QString *XMLPrettyPrint::singleString(const XMLNode *node) const
+{
+    if (node->children.count() != 1) {
+        return NULL;
+    }
+    const XMLNode *child = node->children.at(0);
+    if (child->type == NODE_TYPE_ELEMENT) {
+        return singleString(child);
+    }
+    return &child->value;
+}
+
+void XMLPrettyPrint::serializeElement(XMLNode *node, int level, bool has_next_sibling, QString &out)
+{
+    bool is_parent = xmlParentTags.contains(node->name.toLower());
+
+    // for pure xml, a self closing tag with only whitespace
+    // "contents" should be treated as empty
+    bool can_be_empty = m_emptyElementTags.contains(node->name);
+    if (can_be_empty) {
+        const QString *contents = singleString(node);
+        if (contents && contents->trimmed().isEmpty()) {
+            node->children.clear();
+        }
+    }
+    bool is_empty = can_be_empty && node->children.isEmpty();
+
+    QString indent_space = m_indentChars.repeated(qMax(level - 1, 0));
+
+    out.append(indent_space);
+    out.append('<');
+    out.append(node->value);
+    for (int i = 0; i < node->attributes.count(); ++i) {
+        const QPair<QString, QString> &attr = node->attributes.at(i);
+        out.append(' ');
+        out.append(attr.first);
+        out.append("=\"");
+        AppendEscaped(attr.second, true, out);
+        out.append('"');
+    }
+    out.append(is_empty ? "/>" : ">");
+    if (is_parent) {
+        out.append('\n');
+    }
+
+    int contents_start = out.length();
+    serializeContents(node, is_parent ? level + 1 : level, out);
+    bool has_contents = out.length() > contents_start;
+
+    if ((has_contents && out.at(out.length() - 1) != '\n' && is_parent) || is_empty) {
+        out.append('\n');
+    }
+    if (!is_empty) {
+        if (is_parent) {
+            out.append(indent_space);
+        }
+        out.append("</");
+        out.append(node->value);
+        out.append('>');
+        if (has_next_sibling) {
+            out.append('\n');
+        }
+    }
+}
+
+void XMLPrettyPrint::serializeContents(const XMLNode *node, int level, QString &out)
+{
+    bool is_parent = (node->type == NODE_TYPE_ELEMENT) && xmlParentTags.contains(node->name.toLower());
+    int contents_start = out.length();
+    int count = node->children.count();
+    for (int i = 0; i < count; ++i) {
+        XMLNode *child = node->children.at(i);
+        QString text;
+        switch (child->type) {
+            case NODE_TYPE_ELEMENT:
+                serializeElement(child, level, i < count - 1, out);
+                continue;
+            case NODE_TYPE_TEXT:
+                AppendEscaped(child->value, false, text);
+                break;
+            case NODE_TYPE_COMMENT:
+                text = "<!--" + child->value + "-->";
+                break;
+            case NODE_TYPE_PI:
+                text = "<?" + child->value + "?>";
+                break;
+            case NODE_TYPE_DOC_TYPE:
+                text = "<!DOCTYPE " + child->value + ">";
+                break;
+            default:
+                break;
+        }
+        text = text.trimmed();
+        if (!text.isEmpty()) {
+            if (is_parent && out.length() == contents_start) {
+                out.append(m_indentChars.repeated(qMax(level - 1, 0)));
+            }
+            out.append(text);
+        }
+    }
+}
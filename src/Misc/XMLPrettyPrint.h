@@ -0,0 +1,94 @@
+/************************************************************************
+**
+**  Copyright (C) 2026 agent <agent@local>
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#ifndef XML_PRETTY_PRINT
+#define XML_PRETTY_PRINT
+
+#include <QList>
+#include <QPair>
+#include <QString>
+#include <QStringList>
+
+/**
+ * Native pretty printer for the ebook xml files (opf, ncx, ...).
+ *
+ * Produces exactly the same layout as the sigil_bs4 decodexml()
+ * serializer used by xmlprocessor.repairXML so that it can replace
+ * that Python round trip for well-formed sources. Sources that are
+ * not well-formed are reported through isWellFormed() so the caller
+ * can fall back to the recovering lxml based repair.
+ */
+class XMLPrettyPrint
+{
+public:
+    XMLPrettyPrint(const QString &source);
+    ~XMLPrettyPrint();
+
+    /**
+     * Was the source parsed without any error.
+     * prettyPrint() returns an empty string when it was not.
+     */
+    bool isWellFormed() const;
+
+    QString prettyPrint();
+
+    void setIndentChars(const QString &indent);
+    void setEmptyElementTags(const QStringList &tags);
+
+private:
+    typedef enum {
+        NODE_TYPE_ROOT,
+        NODE_TYPE_ELEMENT,
+        NODE_TYPE_TEXT,
+        NODE_TYPE_COMMENT,
+        NODE_TYPE_PI,
+        NODE_TYPE_DOC_TYPE
+    } NODE_TYPE;
+
+    typedef struct XMLNode {
+        NODE_TYPE type;
+        // local name for elements
+        QString name;
+        // prefixed name for elements, raw content for everything else
+        QString value;
+        // attributes sorted by their (prefixed) name
+        QList<QPair<QString, QString> > attributes;
+        QList<XMLNode *> children;
+    } XMLNode;
+
+    void parse();
+    XMLNode *newNode(NODE_TYPE type, XMLNode *parent);
+    void flushText(QString &text, XMLNode *parent);
+    const QString *singleString(const XMLNode *node) const;
+
+    void serializeElement(XMLNode *node, int level, bool has_next_sibling, QString &out);
+    void serializeContents(const XMLNode *node, int level, QString &out);
+
+    QString m_source;
+    QList<XMLNode *> m_nodes;
+    XMLNode *m_root;
+    bool m_wellFormed;
+    QString m_indentChars;
+    QStringList m_emptyElementTags;
+};
+
+#endif
+
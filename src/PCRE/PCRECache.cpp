@@ -19,23 +19,45 @@
 **
 *************************************************************************/
 
+#include <QtCore/QThreadStorage>
+
 #include "PCRE/PCRECache.h"
 
-PCRECache *PCRECache::m_instance = 0;
+// QThreadStorage deletes the cache when its thread exits.
+static QThreadStorage<PCRECache *> s_instances;
 
 PCRECache *PCRECache::instance()
 {
-    if (m_instance == 0) {
-        m_instance = new PCRECache();
+    if (!s_instances.hasLocalData()) {
+        s_instances.setLocalData(new PCRECache());
     }
 
-    return m_instance;
+    return s_instances.localData();
 }
 
+// The JIT stack of each thread starts small and grows on demand. The
+// maximum is only reserved address space until a match needs it. A
+// pattern that backtracks over a whole large file needs a lot of it, and
+// running out makes the match fail instead of crashing like running the
+// interpreter out of the thread's own stack does.
+static const int JIT_STACK_START_SIZE = 32 * 1024;
+static const int JIT_STACK_MAX_SIZE   = 16 * 1024 * 1024;
+
 PCRECache::PCRECache()
+    : m_jitStack(pcre16_jit_stack_alloc(JIT_STACK_START_SIZE, JIT_STACK_MAX_SIZE))
 {
 }
 
+PCRECache::~PCRECache()
+{
+    // The cached SPCRE's reference the stack so they have to go first.
+    m_cache.clear();
+
+    if (m_jitStack != NULL) {
+        pcre16_jit_stack_free(m_jitStack);
+    }
+}
+
 bool PCRECache::insert(const QString &key, SPCRE *object)
 {
     return m_cache.insert(key, object);
@@ -46,7 +68,7 @@ SPCRE *PCRECache::getObject(const QString &key)
     // Create a new SPCRE if it doesn't alreayd exit.
     // The key is the pattern for initializing the SPCRE.
     if (!m_cache.contains(key)) {
-        SPCRE *spcre = new SPCRE(key);
+        SPCRE *spcre = new SPCRE(key, m_jitStack);
         m_cache.insert(key, spcre, 1);
         return spcre;
     }
@@ -30,15 +30,19 @@
 #include "PCRE/SPCRE.h"
 
 /**
- * Singleton. A cache of SPCRE regular expression objects.
+ * Per thread singleton. A cache of SPCRE regular expression objects.
  *
- * The SPCRE's are cached to improve performance.
+ * The SPCRE's are cached to improve performance. Every thread gets
+ * its own cache (and so its own SPCRE objects) so searches can run
+ * on a worker pool without one thread evicting an SPCRE another
+ * thread is still using. Each thread's cache also owns the stack the
+ * JIT compiled patterns in it match with.
  */
 class PCRECache
 {
 public:
     /**
-     * The accessor function to access the cache.
+     * The accessor function to access the cache of the calling thread.
      */
     static PCRECache *instance();
     ~PCRECache();
@@ -71,8 +75,9 @@ private:
 
     // The cache that we store the SPCRE's.
     QCache<QString, SPCRE> m_cache;
-    // The single instance of the cache.
-    static PCRECache *m_instance;
+    // The JIT stack shared by the SPCRE's of this thread. NULL if pcre
+    // was built without JIT support.
+    pcre16_jit_stack *m_jitStack;
 };
 
 #endif // PCRECACHE_H
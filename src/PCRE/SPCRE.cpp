@@ -26,7 +26,7 @@
 // The maximum number of catpures that we will allow.
 const int PCRE_MAX_CAPTURE_GROUPS = 30;
 
-SPCRE::SPCRE(const QString &patten)
+SPCRE::SPCRE(const QString &patten, pcre16_jit_stack *jit_stack)
 {
     m_pattern = patten;
     m_re = NULL;
@@ -39,8 +39,21 @@ SPCRE::SPCRE(const QString &patten)
     // Pattern is valid.
     if (m_re != NULL) {
         m_valid = true;
-        // Study the pattern and save the results of the study.
-        m_study = pcre16_study(m_re, 0, &error);
+        // Study the pattern and save the results of the study. We also ask
+        // for the pattern to be JIT compiled. If the library was built
+        // without JIT support or the pattern can't be compiled pcre quietly
+        // leaves us with a normal study and matching is interpreted.
+        m_study = pcre16_study(m_re, PCRE_STUDY_JIT_COMPILE, &error);
+
+        if (m_study != NULL) {
+            int jitted = 0;
+            pcre16_fullinfo(m_re, m_study, PCRE_INFO_JIT, &jitted);
+
+            if (jitted && jit_stack != NULL) {
+                pcre16_assign_jit_stack(m_study, NULL, jit_stack);
+            }
+        }
+
         // Store the number of capture subpatterns.
         pcre16_fullinfo(m_re, m_study, PCRE_INFO_CAPTURECOUNT, &m_captureSubpatternCount);
     }
@@ -58,7 +71,8 @@ SPCRE::~SPCRE()
     }
 
     if (m_study != NULL) {
-        pcre16_free(m_study);
+        // Also releases the JIT code.
+        pcre16_free_study(m_study);
         m_study = NULL;
     }
 }
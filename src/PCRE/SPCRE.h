@@ -48,8 +48,11 @@ public:
      * Constructor.
      *
      * @param pattern The search pattern.
+     * @param jit_stack The stack JIT compiled matching should use. If NULL
+     * pcre's small default stack is used. The stack must not be used by
+     * more than one thread at a time.
      */
-    SPCRE(const QString &patten);
+    SPCRE(const QString &patten, pcre16_jit_stack *jit_stack = NULL);
     ~SPCRE();
 
     /**
@@ -151,7 +154,8 @@ private:
     QString m_pattern;
     // The compiled regular expression.
     pcre16 *m_re;
-    // The result of a study of the pcre.
+    // The result of a study of the pcre. Holds the JIT code if the
+    // pattern was JIT compiled.
     pcre16_extra *m_study;
     // The number of capture subpatterns with the expression.
     int m_captureSubpatternCount;
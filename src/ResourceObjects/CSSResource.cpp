@@ -26,6 +26,7 @@
 
 #include "Misc/Utility.h"
 #include "ResourceObjects/CSSResource.h"
+#include "SourceUpdates/PerformCSSUpdates.h"
 
 static const QString W3C_HTML_FORM = "<html>"
                                      " <body>"
@@ -49,10 +50,84 @@ static const QString W3C_HTML_FORM = "<html>"
 
 CSSResource::CSSResource(const QString &mainfolder, const QString &fullfilepath, QObject *parent)
     : TextResource(mainfolder, fullfilepath, parent),
-      m_TemporaryValidationFiles(QList<QString>())
+      m_TemporaryValidationFiles(QList<QString>()),
+      m_ReferencesRevision(-1),
+      m_SelectorIndexRevision(-1)
 {
 }
 
+QStringList CSSResource::GetReferences() const
+{
+    QMutexLocker locker(&m_ReferencesMutex);
+    int revision = GetTextRevision();
+
+    if (m_ReferencesRevision != revision) {
+        m_References = PerformCSSUpdates::GetReferences(GetText());
+        m_ReferencesRevision = revision;
+    }
+
+    return m_References;
+}
+
+QSharedPointer<const CSSResource::SelectorIndex> CSSResource::GetSelectorIndex() const
+{
+    QMutexLocker locker(&m_SelectorIndexMutex);
+    int revision = GetTextRevision();
+
+    if (m_SelectorIndexRevision == revision) {
+        return m_SelectorIndex;
+    }
+
+    QSharedPointer<SelectorIndex> index(new SelectorIndex());
+    CSSInfo css_info(GetText(), true);
+    foreach(CSSInfo::CSSSelector *selector, css_info.getClassSelectors()) {
+        int position = index->class_selectors.count();
+        index->class_selectors.append(*selector);
+        foreach(QString class_name, selector->classNames) {
+            if (selector->elementNames.isEmpty()) {
+                if (!index->class_selectors_any_element.contains(class_name)) {
+                    index->class_selectors_any_element.insert(class_name, position);
+                }
+
+                continue;
+            }
+
+            foreach(QString element_name, selector->elementNames) {
+                QString element_class = element_name + "." + class_name;
+
+                // Make sure the full element.class is actually in the text
+                // to avoid, e.g., div class="test" matching p.test + div
+                if (selector->groupText.contains(element_class) &&
+                    !index->element_class_selectors.contains(element_class)) {
+                    index->element_class_selectors.insert(element_class, position);
+                }
+            }
+        }
+    }
+    m_SelectorIndex = index;
+    m_SelectorIndexRevision = revision;
+    return m_SelectorIndex;
+}
+
+const CSSInfo::CSSSelector *CSSResource::SelectorIndex::Find(const QString &element_name, const QString &class_name) const
+{
+    int any_element = class_selectors_any_element.value(class_name, -1);
+    int element_class = element_class_selectors.value(element_name + "." + class_name, -1);
+
+    // The selector that comes first in the file wins
+    int position = any_element;
+
+    if (position == -1 || (element_class != -1 && element_class < position)) {
+        position = element_class;
+    }
+
+    if (position == -1) {
+        return NULL;
+    }
+
+    return &class_selectors.at(position);
+}
+
 CSSResource::~CSSResource()
 {
     foreach(QString filepath, m_TemporaryValidationFiles) {
@@ -26,6 +26,10 @@
 #ifndef CSSRESOURCE_H
 #define CSSRESOURCE_H
 
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QSharedPointer>
+
 #include "Misc/CSSInfo.h"
 #include "ResourceObjects/TextResource.h"
 
@@ -47,10 +51,51 @@ public:
      */
     CSSResource(const QString &mainfolder, const QString &fullfilepath, QObject *parent = NULL);
 
+    /**
+     * The class selectors of a stylesheet indexed by the
+     * element.class pairs they match.
+     */
+    struct SelectorIndex {
+        /**
+         * The class selectors in the order they appear in the file.
+         */
+        QList<CSSInfo::CSSSelector> class_selectors;
+
+        /**
+         * For each "element.class", the first selector naming both.
+         */
+        QHash<QString, int> element_class_selectors;
+
+        /**
+         * For each class, the first selector matching it on any element.
+         */
+        QHash<QString, int> class_selectors_any_element;
+
+        /**
+         * The first selector that matches the element and class, in the
+         * same way as CSSInfo::getCSSSelectorForElementClass.
+         *
+         * @return The selector or NULL if none matches.
+         */
+        const CSSInfo::CSSSelector *Find(const QString &element_name, const QString &class_name) const;
+    };
+
     ~CSSResource();
 
     bool DeleteCSStyles(QList<CSSInfo::CSSSelector *> css_selectors);
 
+    /**
+     * Every url(), @import etc. reference to another file, as written.
+     * Cached until the text changes.
+     */
+    QStringList GetReferences() const;
+
+    /**
+     * The class selector index of the stylesheet.
+     * Built from one parse and cached until the text changes.
+     */
+    QSharedPointer<const SelectorIndex> GetSelectorIndex() const;
+
     // inherited
     virtual ResourceType Type() const;
 
@@ -59,6 +104,14 @@ public:
 private:
 
     QList<QString> m_TemporaryValidationFiles;
+
+    mutable QStringList m_References;
+    mutable int m_ReferencesRevision;
+    mutable QMutex m_ReferencesMutex;
+
+    mutable QSharedPointer<const SelectorIndex> m_SelectorIndex;
+    mutable int m_SelectorIndexRevision;
+    mutable QMutex m_SelectorIndexMutex;
 };
 
 #endif // CSSRESOURCE_H
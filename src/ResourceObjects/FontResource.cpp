@@ -22,6 +22,8 @@
 #include "Misc/Utility.h"
 #include "ResourceObjects/FontResource.h"
 
+QAtomicInt FontResource::m_ObfuscationRevision;
+
 FontResource::FontResource(const QString &mainfolder, const QString &fullfilepath, QObject *parent)
     : Resource(mainfolder, fullfilepath, parent)
 {
@@ -42,7 +44,18 @@ QString FontResource::GetObfuscationAlgorithm() const
 
 void FontResource::SetObfuscationAlgorithm(const QString &algorithm)
 {
+    if (algorithm == m_ObfuscationAlgorithm) {
+        return;
+    }
+
     m_ObfuscationAlgorithm = algorithm;
+    m_ObfuscationRevision.fetchAndAddOrdered(1);
+}
+
+
+int FontResource::ObfuscationRevision()
+{
+    return m_ObfuscationRevision.loadAcquire();
 }
 
 bool FontResource::LoadFromDisk()
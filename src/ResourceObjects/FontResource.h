@@ -23,6 +23,8 @@
 #ifndef FONTRESOURCE_H
 #define FONTRESOURCE_H
 
+#include <QtCore/QAtomicInt>
+
 #include "ResourceObjects/Resource.h"
 
 /**
@@ -50,11 +52,19 @@ public:
 
     void SetObfuscationAlgorithm(const QString &algorithm);
 
+    /**
+     * Returns a number that changes every time
+     * the obfuscation algorithm of any font changes.
+     */
+    static int ObfuscationRevision();
+
     virtual bool LoadFromDisk();
 
 private:
 
     QString m_ObfuscationAlgorithm;
+
+    static QAtomicInt m_ObfuscationRevision;
 };
 
 #endif // FONTRESOURCE_H
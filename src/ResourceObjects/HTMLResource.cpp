@@ -33,6 +33,7 @@
 #include "Misc/Utility.h"
 #include "Misc/GumboInterface.h"
 #include "ResourceObjects/HTMLResource.h"
+#include "SourceUpdates/PerformCSSUpdates.h"
 #include "sigil_exception.h"
 
 static const QString LOADED_CONTENT_MIMETYPE = "application/xhtml+xml";
@@ -46,7 +47,9 @@ HTMLResource::HTMLResource(const QString &mainfolder, const QString &fullfilepat
                            QObject *parent)
     :
     XMLResource(mainfolder, fullfilepath, parent),
-    m_Resources(resources)
+    m_Resources(resources),
+    m_ParsedReferencesValid(false),
+    m_ParsedReferencesRevision(0)
 {
 }
 
@@ -84,14 +87,107 @@ void HTMLResource::SetText(const QString &text)
 
 void HTMLResource::SaveToDisk(bool book_wide_save)
 {
-    SetText(GetText());
+    // Edits made in Code View don't go through SetText(),
+    // so pick up the resources they link to now.
+    if (!IsSavedToDisk()) {
+        TrackNewResources(GetPathsToLinkedResources());
+    }
+
     XMLResource::SaveToDisk(book_wide_save);
 }
 
 
 QStringList HTMLResource::GetLinkedStylesheets()
 {
-    return XhtmlDoc::GetLinkedStylesheets(GetText());
+    return GetParsedReferences().stylesheets;
+}
+
+
+HTMLResource::ParsedReferences HTMLResource::GetParsedReferences() const
+{
+    QMutexLocker locker(&m_ParsedReferencesMutex);
+    int revision = GetTextRevision();
+    if (!m_ParsedReferencesValid || (m_ParsedReferencesRevision != revision)) {
+        const QString text = GetText();
+        GumboInterface gi(text);
+        gi.parse();
+        ParsedReferences refs;
+        refs.ids = XhtmlDoc::GetAllDescendantIDs(gi);
+        refs.hrefs = XhtmlDoc::GetAllDescendantHrefs(gi);
+        refs.classes = XhtmlDoc::GetAllDescendantClasses(gi);
+        refs.style_urls = XhtmlDoc::GetAllDescendantStyleUrls(gi);
+        refs.image_paths = XhtmlDoc::GetAllMediaPathsFromMediaChildren(gi, GIMAGE_TAGS);
+        refs.video_paths = XhtmlDoc::GetAllMediaPathsFromMediaChildren(gi, GVIDEO_TAGS);
+        refs.audio_paths = XhtmlDoc::GetAllMediaPathsFromMediaChildren(gi, GAUDIO_TAGS);
+        refs.stylesheets = XhtmlDoc::GetLinkedStylesheets(gi);
+        refs.link_elements = XhtmlDoc::GetTagsInDocument(gi, GUMBO_TAG_A);
+        refs.references = refs.hrefs + XhtmlDoc::GetAllDescendantSrcs(gi) + PerformCSSUpdates::GetReferences(text);
+        m_ParsedReferences = refs;
+        m_ParsedReferencesRevision = revision;
+        m_ParsedReferencesValid = true;
+    }
+    return m_ParsedReferences;
+}
+
+
+QStringList HTMLResource::GetIds() const
+{
+    return GetParsedReferences().ids;
+}
+
+
+QStringList HTMLResource::GetHrefs() const
+{
+    return GetParsedReferences().hrefs;
+}
+
+
+QStringList HTMLResource::GetClasses() const
+{
+    return GetParsedReferences().classes;
+}
+
+
+QStringList HTMLResource::GetStyleUrls() const
+{
+    return GetParsedReferences().style_urls;
+}
+
+
+QStringList HTMLResource::GetImagePaths() const
+{
+    return GetParsedReferences().image_paths;
+}
+
+
+QStringList HTMLResource::GetVideoPaths() const
+{
+    return GetParsedReferences().video_paths;
+}
+
+
+QStringList HTMLResource::GetAudioPaths() const
+{
+    return GetParsedReferences().audio_paths;
+}
+
+
+QStringList HTMLResource::GetMediaPaths() const
+{
+    ParsedReferences refs = GetParsedReferences();
+    return refs.image_paths + refs.video_paths + refs.audio_paths;
+}
+
+
+QList<XhtmlDoc::XMLElement> HTMLResource::GetLinkElements() const
+{
+    return GetParsedReferences().link_elements;
+}
+
+
+QStringList HTMLResource::GetReferences() const
+{
+    return GetParsedReferences().references;
 }
 
 
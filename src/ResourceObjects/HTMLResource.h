@@ -25,9 +25,11 @@
 #define HTMLRESOURCE_H
 
 #include <QtCore/QHash>
+#include <QtCore/QMutex>
 
 #include "Misc/CSSInfo.h"
 #include "BookManipulation/GuideSemantics.h"
+#include "BookManipulation/XhtmlDoc.h"
 #include "ResourceObjects/XMLResource.h"
 
 class QString;
@@ -101,6 +103,29 @@ public:
 
     QStringList GetManifestProperties() const;
 
+    /**
+     * The following return the references found in the text.
+     * They are all extracted from a single parse that is cached
+     * until the text changes, so calling several of them in a row
+     * (or from several book-wide queries) costs only one parse.
+     */
+    QStringList GetIds() const;
+    QStringList GetHrefs() const;
+    QStringList GetClasses() const;
+    QStringList GetStyleUrls() const;
+    QStringList GetImagePaths() const;
+    QStringList GetVideoPaths() const;
+    QStringList GetAudioPaths() const;
+    QStringList GetMediaPaths() const;
+    QList<XhtmlDoc::XMLElement> GetLinkElements() const;
+
+    /**
+     * Every reference to another file that a source update could
+     * rewrite: all href and src attribute values plus the url(),
+     * @import etc. of the inline CSS, as written.
+     */
+    QStringList GetReferences() const;
+
     bool DeleteCSStyles(QList<CSSInfo::CSSSelector *> css_selectors);
 
 signals:
@@ -109,6 +134,25 @@ signals:
     void LoadedFromDisk();
 
 private:
+    struct ParsedReferences {
+        QStringList ids;
+        QStringList hrefs;
+        QStringList classes;
+        QStringList style_urls;
+        QStringList image_paths;
+        QStringList video_paths;
+        QStringList audio_paths;
+        QStringList stylesheets;
+        QList<XhtmlDoc::XMLElement> link_elements;
+        QStringList references;
+    };
+
+    /**
+     * Returns the references for the current text,
+     * reparsing only if the text revision changed.
+     */
+    ParsedReferences GetParsedReferences() const;
+
     /**
      * Makes sure the given paths are watched for updates.
      *
@@ -125,6 +169,18 @@ private:
      * @todo This is ugly as hell. Find a way to remove this.
      */
     const QHash<QString, Resource *> &m_Resources;
+
+    /**
+     * The cached references, valid for m_ParsedReferencesRevision
+     * of the text. Guarded by m_ParsedReferencesMutex.
+     */
+    mutable ParsedReferences m_ParsedReferences;
+
+    mutable bool m_ParsedReferencesValid;
+
+    mutable int m_ParsedReferencesRevision;
+
+    mutable QMutex m_ParsedReferencesMutex;
 };
 
 #endif // HTMLRESOURCE_H
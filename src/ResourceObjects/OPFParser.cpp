@@ -19,7 +19,6 @@
 **
 *************************************************************************/
 
-#include "Misc/EmbeddedPython.h"
 #include "Misc/Utility.h"
 #include "ResourceObjects/OPFParser.h"
 
@@ -372,76 +371,261 @@ QString BindingsEntry::convert_to_xml() const
 }
 
 
-void OPFParser::parse(const QString& source)
-{
-  int rv = 0;
-  QString traceback;
+// The scanner below is a direct port of the tag iterator that used to live in
+// python3lib/opf_newparser.py.  It is deliberately forgiving and only knows
+// enough about the OPF structure to fill in the entries above.
 
-  QList<QVariant> args;
-  args.append(QVariant(source));
-  EmbeddedPython* epp = EmbeddedPython::instance();
-  QVariant res = epp->runInPython( QString("opf_newparser"), QString("parseopf"), args, &rv, traceback, true);
-  if (rv) fprintf(stderr, "setext parseropf error %d traceback %s\n",rv, traceback.toStdString().c_str());
+static const QStringList OPF_PARENT_TAGS = QStringList() << "xml" << "package" << "metadata" << "dc-metadata"
+                                                         << "x-metadata" << "manifest" << "spine" << "tours"
+                                                         << "guide" << "bindings";
 
-  PyObjectPtr mpo = PyObjectPtr(res);
+enum OPFTagType {
+    OPFBeginTag,
+    OPFEndTag,
+    OPFSingleTag
+};
 
-  args.clear();
-  res = epp->callPyObjMethod(mpo, QString("get_package"), args, &rv, traceback);
-  if (rv) fprintf(stderr, "setext package error %d traceback %s\n",rv, traceback.toStdString().c_str());
-  m_package = PackageEntry(res);
 
-  res = epp->callPyObjMethod(mpo, QString("get_metadata_attr"), args, &rv, traceback);
-  if (rv) fprintf(stderr, "setext meta_attr error %d traceback %s\n",rv, traceback.toStdString().c_str());
-  m_metans = MetaNSEntry(res);
-
-  res = epp->callPyObjMethod(mpo, QString("get_metadata"), args, &rv, traceback);
-  if (rv) fprintf(stderr, "setext metadata error %d traceback %s\n",rv, traceback.toStdString().c_str());
-  m_metadata.clear();
-  QList<QVariant> lst = res.toList();
-  foreach(QVariant qv, lst) {
-    m_metadata.append(MetaEntry(qv));
-  }
+// Returns either the leading text or the next complete tag starting at pos.
+static bool NextOPFChunk(const QString& opf, int& pos, QString& chunk, bool& is_tag)
+{
+    int n = opf.length();
+    int p = pos;
+    if (p >= n) {
+        return false;
+    }
+    if (opf.at(p) != QChar('<')) {
+        int res = opf.indexOf(QChar('<'), p);
+        if (res == -1) {
+            res = n;
+        }
+        pos = res;
+        chunk = opf.mid(p, res - p);
+        is_tag = false;
+        return true;
+    }
+    int te;
+    // handle comment as a special case
+    if (opf.midRef(p, 4) == QLatin1String("<!--")) {
+        te = opf.indexOf("-->", p + 1);
+        if (te != -1) {
+            te = te + 2;
+        }
+    } else {
+        te = opf.indexOf(QChar('>'), p + 1);
+        int ntb = opf.indexOf(QChar('<'), p + 1);
+        if ((ntb != -1) && ((te == -1) || (ntb < te))) {
+            pos = ntb;
+            chunk = opf.mid(p, ntb - p);
+            is_tag = false;
+            return true;
+        }
+    }
+    if (te == -1) {
+        // unterminated tag, treat the rest as text
+        pos = n;
+        chunk = opf.mid(p);
+        is_tag = false;
+        return true;
+    }
+    pos = te + 1;
+    chunk = opf.mid(p, te + 1 - p);
+    is_tag = true;
+    return true;
+}
 
-  m_idpos.clear();
-  m_hrefpos.clear();
 
-  res = epp->callPyObjMethod(mpo, QString("get_manifest"), args, &rv, traceback);
-  if (rv) fprintf(stderr, "setext manifest error %d traceback %s\n",rv, traceback.toStdString().c_str());
-  m_manifest.clear();
-  lst = res.toList();
-  for (int i = 0; i < lst.count(); i++) {
-    ManifestEntry me = ManifestEntry(lst.at(i));
-    m_idpos[me.m_id] = i;
-    m_hrefpos[me.m_href] = i;
-    m_manifest.append(me);
-  }
+// Identifies the tag name, its type and its attributes.
+static OPFTagType ParseOPFTag(const QString& s, QString& tname, QHash<QString,QString>& tattr)
+{
+    static const QString NAME_STOPS = QString(">/ \"'\r\n");
+    static const QString VALUE_STOPS = QString(">/ ");
+    int n = s.length();
+    int p = 1;
+    bool type_known = false;
+    OPFTagType ttype = OPFBeginTag;
+    tattr.clear();
+    while ((p < n) && (s.at(p) == QChar(' '))) p++;
+    if ((p < n) && (s.at(p) == QChar('/'))) {
+        ttype = OPFEndTag;
+        type_known = true;
+        p++;
+        while ((p < n) && (s.at(p) == QChar(' '))) p++;
+    }
+    int b = p;
+    while ((p < n) && !NAME_STOPS.contains(s.at(p))) p++;
+    tname = s.mid(b, p - b).toLower();
+    // remove redundant opf: namespace prefixes on opf tags
+    if (tname.startsWith("opf:")) {
+        tname = tname.mid(4);
+    }
+    // some special cases
+    if (tname == "?xml") {
+        tname = "xml";
+    }
+    if (tname == "!--") {
+        ttype = OPFSingleTag;
+        type_known = true;
+        tattr["comment"] = s.mid(p, qMax(0, n - 3 - p)).trimmed();
+    }
+    if (!type_known) {
+        // parse any attributes of begin or single tags
+        while (s.indexOf(QChar('='), p) != -1) {
+            while ((p < n) && (s.at(p) == QChar(' '))) p++;
+            b = p;
+            while ((p < n) && (s.at(p) != QChar('='))) p++;
+            QString aname = s.mid(b, p - b).toLower();
+            while (aname.endsWith(QChar(' '))) aname.chop(1);
+            p++;
+            while ((p < n) && (s.at(p) == QChar(' '))) p++;
+            QString val;
+            if ((p < n) && ((s.at(p) == QChar('"')) || (s.at(p) == QChar('\'')))) {
+                QChar qt = s.at(p);
+                p++;
+                b = p;
+                while ((p < n) && (s.at(p) != qt)) p++;
+                val = s.mid(b, p - b);
+                p++;
+            } else {
+                b = p;
+                while ((p < n) && !VALUE_STOPS.contains(s.at(p))) p++;
+                val = s.mid(b, p - b);
+            }
+            tattr[aname] = val;
+        }
+        if (s.indexOf(QChar('/'), p) >= 0) {
+            ttype = OPFSingleTag;
+        }
+    }
+    return ttype;
+}
 
-  res = epp->callPyObjMethod(mpo, QString("get_spine_attr"), args, &rv, traceback);
-  if (rv) fprintf(stderr, "setext spineattr error %d traceback %s\n",rv, traceback.toStdString().c_str());
-  m_spineattr = SpineAttrEntry(res);
 
-  res = epp->callPyObjMethod(mpo, QString("get_spine"), args, &rv, traceback);
-  if (rv) fprintf(stderr, "setext spine error %d traceback %s\n",rv, traceback.toStdString().c_str());
+void OPFParser::parse(const QString& source)
+{
+  m_package = PackageEntry();
+  m_metans = MetaNSEntry();
+  m_metadata.clear();
+  m_manifest.clear();
+  m_spineattr = SpineAttrEntry();
   m_spine.clear();
-  lst = res.toList();
-  foreach(QVariant qv, lst) {
-    m_spine.append(SpineEntry(qv));
-  }
-
-  res = epp->callPyObjMethod(mpo, QString("get_guide"), args, &rv, traceback);
-  if (rv) fprintf(stderr, "setext guide error %d traceback %s\n",rv, traceback.toStdString().c_str());
   m_guide.clear();
-  lst = res.toList();
-  foreach(QVariant qv, lst) {
-    m_guide.append(GuideEntry(qv));
-  }
-
-  res = epp->callPyObjMethod(mpo, QString("get_bindings"), args, &rv, traceback);
-  if (rv) fprintf(stderr, "setext bindings error %d traceback %s\n",rv, traceback.toStdString().c_str());
   m_bindings.clear();
-  lst = res.toList();
-  foreach(QVariant qv, lst) {
-    m_bindings.append(BindingsEntry(qv));
+  m_idpos.clear();
+  m_hrefpos.clear();
+
+  QStringList prefix;
+  QString tcontent;
+  QHash<QString,QString> last_tattr;
+  QHash<QString,QString> tattr;
+  QString tname;
+  QString chunk;
+  bool is_tag = false;
+  int pos = 0;
+  int cnt = 0;
+
+  while (NextOPFChunk(source, pos, chunk, is_tag)) {
+    if (!is_tag) {
+      tcontent = chunk;
+      int e = tcontent.length();
+      while ((e > 0) && QString(" \r\n").contains(tcontent.at(e - 1))) e--;
+      tcontent.truncate(e);
+      continue;
+    }
+
+    OPFTagType ttype = ParseOPFTag(chunk, tname, tattr);
+    if (ttype == OPFBeginTag) {
+      tcontent.clear();
+      prefix.append(tname);
+      if (!OPF_PARENT_TAGS.contains(tname)) {
+        last_tattr = tattr;
+        continue;
+      }
+    } else {
+      if (ttype == OPFEndTag) {
+        if (!prefix.isEmpty()) {
+          prefix.removeLast();
+        }
+        tattr = last_tattr;
+        last_tattr.clear();
+      } else {
+        tcontent.clear();
+      }
+      if ((ttype == OPFEndTag) && OPF_PARENT_TAGS.contains(tname)) {
+        tcontent.clear();
+        continue;
+      }
+    }
+    QString content = tcontent;
+    if (ttype != OPFBeginTag) {
+      tcontent.clear();
+    }
+    QString path = prefix.join(".");
+
+    // package
+    if (tname == "package") {
+      m_package.m_version = tattr.contains("version") ? tattr.take("version") : QString("2.0");
+      m_package.m_uniqueid = tattr.contains("unique-identifier") ? tattr.take("unique-identifier") : QString("bookid");
+      m_package.m_atts = tattr;
+      continue;
+    }
+    // metadata
+    if (tname == "metadata") {
+      m_metans.m_atts = tattr;
+      continue;
+    }
+    if ((tname == "meta") || (tname == "link") || (tname.startsWith("dc:") && path.contains("metadata"))) {
+      MetaEntry me;
+      me.m_name = tname;
+      me.m_content = content;
+      me.m_atts = tattr;
+      m_metadata.append(me);
+      continue;
+    }
+    // manifest
+    if ((tname == "item") && path.endsWith("manifest")) {
+      QString nid = QString("xid%1").arg(cnt, 3, 10, QChar('0'));
+      cnt++;
+      ManifestEntry me;
+      me.m_id = tattr.contains("id") ? tattr.take("id") : nid;
+      me.m_href = Utility::URLDecodePath(tattr.take("href"));
+      me.m_mtype = tattr.take("media-type");
+      me.m_atts = tattr;
+      int n = m_manifest.count();
+      m_idpos[me.m_id] = n;
+      m_hrefpos[me.m_href] = n;
+      m_manifest.append(me);
+      continue;
+    }
+    // spine
+    if (tname == "spine") {
+      m_spineattr.m_atts = tattr;
+      continue;
+    }
+    if ((tname == "itemref") && path.endsWith("spine")) {
+      SpineEntry se;
+      se.m_idref = tattr.take("idref");
+      se.m_atts = tattr;
+      m_spine.append(se);
+      continue;
+    }
+    // guide
+    if ((tname == "reference") && path.endsWith("guide")) {
+      GuideEntry ge;
+      ge.m_type = tattr.take("type");
+      ge.m_title = tattr.take("title");
+      ge.m_href = Utility::URLDecodePath(tattr.take("href"));
+      m_guide.append(ge);
+      continue;
+    }
+    // bindings
+    if (((tname == "mediatype") || (tname == "mediatypes")) && path.endsWith("bindings")) {
+      BindingsEntry be;
+      be.m_mtype = tattr.take("media-type");
+      be.m_handler = tattr.take("handler");
+      m_bindings.append(be);
+      continue;
+    }
   }
 }
 
@@ -66,7 +66,9 @@ static const QString TEMPLATE_TEXT =
 
 
 OPFResource::OPFResource(const QString &mainfolder, const QString &fullfilepath, QObject *parent)
-  : XMLResource(mainfolder, fullfilepath, parent)
+  : XMLResource(mainfolder, fullfilepath, parent),
+    m_ParsedOPFValid(false),
+    m_ParsedOPFRevision(0)
 {
     CreateMimetypes();
     FillWithDefaultText();
@@ -107,9 +109,7 @@ void OPFResource::SetText(const QString &text)
 GuideSemantics::GuideSemanticType OPFResource::GetGuideSemanticTypeForResource(const Resource *resource) const
 {
     QReadLocker locker(&GetLock());
-    QString source = CleanSource::ProcessXML(GetText());
-    OPFParser p;
-    p.parse(source);
+    OPFParser p = GetParsedOPF();
     return GetGuideSemanticTypeForResource(resource, p);
 }
 
@@ -122,9 +122,7 @@ QString OPFResource::GetGuideSemanticNameForResource(Resource *resource)
 QHash <QString, QString>  OPFResource::GetGuideSemanticNameForPaths()
 {
     QReadLocker locker(&GetLock());
-    QString source = CleanSource::ProcessXML(GetText());
-    OPFParser p;
-    p.parse(source);
+    OPFParser p = GetParsedOPF();
     QHash <QString, QString> semantic_types;
 
     foreach(GuideEntry ge, p.m_guide) {
@@ -155,9 +153,7 @@ QHash <QString, QString>  OPFResource::GetGuideSemanticNameForPaths()
 QHash <Resource *, int>  OPFResource::GetReadingOrderAll( const QList <Resource *> resources)
 {
     QReadLocker locker(&GetLock());
-    QString source = CleanSource::ProcessXML(GetText());
-    OPFParser p;
-    p.parse(source);
+    OPFParser p = GetParsedOPF();
     QHash <Resource *, int> reading_order;
     QHash<QString, int> id_order;
     for (int i = 0; i < p.m_spine.count(); ++i) {
@@ -173,9 +169,7 @@ QHash <Resource *, int>  OPFResource::GetReadingOrderAll( const QList <Resource
 int OPFResource::GetReadingOrder(const HTMLResource *html_resource) const
 {
     QReadLocker locker(&GetLock());
-    QString source = CleanSource::ProcessXML(GetText());
-    OPFParser p;
-    p.parse(source);
+    OPFParser p = GetParsedOPF();
     const Resource *resource = static_cast<const Resource *>(html_resource);
     QString resource_id = GetResourceManifestID(resource, p);
     for (int i = 0; i < p.m_spine.count(); ++i) {
@@ -190,9 +184,7 @@ int OPFResource::GetReadingOrder(const HTMLResource *html_resource) const
 QString OPFResource::GetMainIdentifierValue() const
 {
     QReadLocker locker(&GetLock());
-    QString source = CleanSource::ProcessXML(GetText());
-    OPFParser p;
-    p.parse(source);
+    OPFParser p = GetParsedOPF();
     int i = GetMainIdentifier(p);
     if (i > -1) {
         return QString(p.m_metadata.at(i).m_content);
@@ -205,7 +197,16 @@ void OPFResource::SaveToDisk(bool book_wide_save)
     QString source = CleanSource::ProcessXML(GetText());
     // Work around for covers appearing on the Nook. Issue 942.
     source = source.replace(QRegularExpression("<meta content=\"([^\"]+)\" name=\"cover\""), "<meta name=\"cover\" content=\"\\1\"");
+    int revision = GetTextRevision();
     TextResource::SetText(source);
+    {
+        // Reformatting does not change the package contents so
+        // a model built for the old text is still good.
+        QMutexLocker locker(&m_ParsedOPFMutex);
+        if (m_ParsedOPFValid && (m_ParsedOPFRevision == revision)) {
+            m_ParsedOPFRevision = GetTextRevision();
+        }
+    }
     TextResource::SaveToDisk(book_wide_save);
 }
 
@@ -213,9 +214,7 @@ void OPFResource::SaveToDisk(bool book_wide_save)
 QString OPFResource::GetPackageVersion() const
 {
   QReadLocker locker(&GetLock());
-  QString source = CleanSource::ProcessXML(GetText());
-  OPFParser p;
-  p.parse(source);
+  OPFParser p = GetParsedOPF();
   return p.m_package.m_version;
 }
 
@@ -224,9 +223,7 @@ QString OPFResource::GetUUIDIdentifierValue()
 {
     EnsureUUIDIdentifierPresent();
     QReadLocker locker(&GetLock());
-    QString source = CleanSource::ProcessXML(GetText());
-    OPFParser p;
-    p.parse(source);
+    OPFParser p = GetParsedOPF();
     for (int i=0; i < p.m_metadata.count(); ++i) {
         MetaEntry me = p.m_metadata.at(i);
         if(me.m_name.startsWith("dc:identifier")) {
@@ -246,9 +243,7 @@ QString OPFResource::GetUUIDIdentifierValue()
 void OPFResource::EnsureUUIDIdentifierPresent()
 {
     QWriteLocker locker(&GetLock());
-    QString source = CleanSource::ProcessXML(GetText());
-    OPFParser p;
-    p.parse(source);
+    OPFParser p = GetParsedOPF();
     for (int i=0; i < p.m_metadata.count(); ++i) {
         MetaEntry me = p.m_metadata.at(i);
         if(me.m_name.startsWith("dc:identifier")) {
@@ -266,9 +261,7 @@ void OPFResource::EnsureUUIDIdentifierPresent()
 QString OPFResource::AddNCXItem(const QString &ncx_path)
 {
     QWriteLocker locker(&GetLock());
-    QString source = CleanSource::ProcessXML(GetText());
-    OPFParser p;
-    p.parse(source);
+    OPFParser p = GetParsedOPF();
     QString path_to_oebps_folder = QFileInfo(GetFullPath()).absolutePath() + "/";
     QString ncx_oebps_path  = QString(ncx_path).remove(path_to_oebps_folder);
     int n = p.m_manifest.count();
@@ -287,9 +280,7 @@ QString OPFResource::AddNCXItem(const QString &ncx_path)
 void OPFResource::UpdateNCXOnSpine(const QString &new_ncx_id)
 {
     QWriteLocker locker(&GetLock());
-    QString source = CleanSource::ProcessXML(GetText());
-    OPFParser p;
-    p.parse(source);
+    OPFParser p = GetParsedOPF();
     QString ncx_id = p.m_spineattr.m_atts.value(QString("toc"),"");
     if (new_ncx_id != ncx_id) {
         p.m_spineattr.m_atts[QString("toc")] = new_ncx_id;
@@ -301,9 +292,7 @@ void OPFResource::UpdateNCXOnSpine(const QString &new_ncx_id)
 void OPFResource::UpdateNCXLocationInManifest(const NCXResource *ncx)
 {
     QWriteLocker locker(&GetLock());
-    QString source = CleanSource::ProcessXML(GetText());
-    OPFParser p;
-    p.parse(source);
+    OPFParser p = GetParsedOPF();
     QString ncx_id = p.m_spineattr.m_atts.value(QString("toc"), "");
     int pos = p.m_idpos.value(ncx_id, -1);
     if (pos > -1) {
@@ -321,9 +310,7 @@ void OPFResource::UpdateNCXLocationInManifest(const NCXResource *ncx)
 void OPFResource::AddSigilVersionMeta()
 {
     QWriteLocker locker(&GetLock());
-    QString source = CleanSource::ProcessXML(GetText());
-    OPFParser p;
-    p.parse(source);
+    OPFParser p = GetParsedOPF();
     for (int i=0; i < p.m_metadata.count(); ++i) {
         MetaEntry me = p.m_metadata.at(i);
         if ((me.m_name == "meta") && (me.m_atts.contains("name"))) {  
@@ -348,9 +335,7 @@ void OPFResource::AddSigilVersionMeta()
 bool OPFResource::IsCoverImage(const ImageResource *image_resource) const
 {
     QReadLocker locker(&GetLock());
-    QString source = CleanSource::ProcessXML(GetText());
-    OPFParser p;
-    p.parse(source);
+    OPFParser p = GetParsedOPF();
     QString resource_id = GetResourceManifestID(image_resource, p);
     return IsCoverImageCheck(resource_id, p);
 }
@@ -370,9 +355,7 @@ bool OPFResource::IsCoverImageCheck(QString resource_id, const OPFParser & p) co
 bool OPFResource::CoverImageExists() const
 {
     QReadLocker locker(&GetLock());
-    QString source = CleanSource::ProcessXML(GetText());
-    OPFParser p;
-    p.parse(source);
+    OPFParser p = GetParsedOPF();
     return GetCoverMeta(p) > -1;
 }
 
@@ -388,9 +371,7 @@ void OPFResource::AutoFixWellFormedErrors()
 QStringList OPFResource::GetSpineOrderFilenames() const
 {
     QReadLocker locker(&GetLock());
-    QString source = CleanSource::ProcessXML(GetText());
-    OPFParser p;
-    p.parse(source);
+    OPFParser p = GetParsedOPF();
     QStringList filenames_in_reading_order;
     for (int i=0; i < p.m_spine.count(); ++i) {
         SpineEntry sp = p.m_spine.at(i);
@@ -409,9 +390,7 @@ QStringList OPFResource::GetSpineOrderFilenames() const
 QList<Metadata::MetaElement> OPFResource::GetDCMetadata() const
 {
     QReadLocker locker(&GetLock());
-    QString source = CleanSource::ProcessXML(GetText());
-    OPFParser p;
-    p.parse(source);
+    OPFParser p = GetParsedOPF();
     QList<Metadata::MetaElement> metadata;
     for (int i=0; i < p.m_metadata.count(); ++i) {
         MetaEntry me = p.m_metadata.at(i);
@@ -441,9 +420,7 @@ QList<QVariant> OPFResource::GetDCMetadataValues(QString text) const
 void OPFResource::SetDCMetadata(const QList<Metadata::MetaElement> &metadata)
 {
     QWriteLocker locker(&GetLock());
-    QString source = CleanSource::ProcessXML(GetText());
-    OPFParser p;
-    p.parse(source);
+    OPFParser p = GetParsedOPF();
     RemoveDCElements(p);
     foreach(Metadata::MetaElement book_meta, metadata) {
         MetadataDispatcher(book_meta, p);;
@@ -455,9 +432,7 @@ void OPFResource::SetDCMetadata(const QList<Metadata::MetaElement> &metadata)
 void OPFResource::AddResource(const Resource *resource)
 {
     QWriteLocker locker(&GetLock());
-    QString source = CleanSource::ProcessXML(GetText());
-    OPFParser p;
-    p.parse(source);
+    OPFParser p = GetParsedOPF();
     ManifestEntry me;
     me.m_id = GetUniqueID(GetValidID(resource->Filename()),p);
     me.m_href = resource->GetRelativePathToOEBPS();
@@ -519,9 +494,7 @@ void OPFResource::AddCoverMetaForImage(const Resource *resource, OPFParser &p)
 void OPFResource::RemoveResource(const Resource *resource)
 {
     QWriteLocker locker(&GetLock());
-    QString source = CleanSource::ProcessXML(GetText());
-    OPFParser p;
-    p.parse(source);
+    OPFParser p = GetParsedOPF();
     if (p.m_manifest.isEmpty()) return;
 
     QString resource_oebps_path = resource->GetRelativePathToOEBPS();
@@ -562,9 +535,7 @@ void OPFResource::RemoveResource(const Resource *resource)
 void OPFResource::AddGuideSemanticType(HTMLResource *html_resource, GuideSemantics::GuideSemanticType new_type)
 {
     QWriteLocker locker(&GetLock());
-    QString source = CleanSource::ProcessXML(GetText());
-    OPFParser p;
-    p.parse(source);
+    OPFParser p = GetParsedOPF();
     GuideSemantics::GuideSemanticType current_type = GetGuideSemanticTypeForResource(html_resource, p);
 
     if (current_type != new_type) {
@@ -583,9 +554,7 @@ void OPFResource::AddGuideSemanticType(HTMLResource *html_resource, GuideSemanti
 void OPFResource::SetResourceAsCoverImage(ImageResource *image_resource)
 {
     QWriteLocker locker(&GetLock());
-    QString source = CleanSource::ProcessXML(GetText());
-    OPFParser p;
-    p.parse(source);
+    OPFParser p = GetParsedOPF();
     if (IsCoverImage(image_resource)) {
         RemoveCoverMetaForImage(image_resource, p);
     } else {
@@ -603,9 +572,7 @@ void OPFResource::SetResourceAsCoverImage(ImageResource *image_resource)
 void OPFResource::UpdateSpineOrder(const QList<::HTMLResource *> html_files)
 {
     QWriteLocker locker(&GetLock());
-    QString source = CleanSource::ProcessXML(GetText());
-    OPFParser p;
-    p.parse(source);
+    OPFParser p = GetParsedOPF();
     QList<SpineEntry> new_spine;
     foreach(HTMLResource * html_resource, html_files) {
         const Resource *resource = static_cast<const Resource *>(html_resource);
@@ -635,9 +602,7 @@ void OPFResource::UpdateSpineOrder(const QList<::HTMLResource *> html_files)
 void OPFResource::ResourceRenamed(const Resource *resource, QString old_full_path)
 {
     QWriteLocker locker(&GetLock());
-    QString source = CleanSource::ProcessXML(GetText());
-    OPFParser p;
-    p.parse(source);
+    OPFParser p = GetParsedOPF();
     QString path_to_oebps_folder = QFileInfo(GetFullPath()).absolutePath() + "/";
     QString resource_oebps_path  = QString(old_full_path).remove(path_to_oebps_folder);
     QString old_id;
@@ -937,9 +902,7 @@ void OPFResource::WriteIdentifier(const QString &metaname, const QString &metava
 void OPFResource::AddModificationDateMeta()
 {
     QWriteLocker locker(&GetLock());
-    QString source = CleanSource::ProcessXML(GetText());
-    OPFParser p;
-    p.parse(source);
+    OPFParser p = GetParsedOPF();
     QString date;
     QDate d = QDate::currentDate();
     // We can't use QDate.toString() because it will take into account the locale. Which mean we may not get Arabic 
@@ -1086,5 +1049,26 @@ QString OPFResource::GetRelativePathToRoot() const
 void OPFResource::UpdateText(const OPFParser &p)
 {
     TextResource::SetText(p.convert_to_xml());
+    // The model we serialized from is already what a reparse of
+    // the new text would give us, so keep it instead of dropping it.
+    QMutexLocker locker(&m_ParsedOPFMutex);
+    m_ParsedOPF = p;
+    m_ParsedOPFRevision = GetTextRevision();
+    m_ParsedOPFValid = true;
+}
+
+
+OPFParser OPFResource::GetParsedOPF() const
+{
+    QMutexLocker locker(&m_ParsedOPFMutex);
+    int revision = GetTextRevision();
+    if (!m_ParsedOPFValid || (m_ParsedOPFRevision != revision)) {
+        QString source = CleanSource::ProcessXML(GetText());
+        m_ParsedOPF.parse(source);
+        m_ParsedOPFRevision = revision;
+        m_ParsedOPFValid = true;
+    }
+    // All members are implicitly shared so this copy is cheap
+    return m_ParsedOPF;
 }
 
@@ -24,6 +24,7 @@
 #define OPFRESOURCE_H
 
 #include <memory>
+#include <QtCore/QMutex>
 #include "BookManipulation/GuideSemantics.h"
 #include "BookManipulation/Metadata.h"
 #include "ResourceObjects/XMLResource.h"
@@ -251,6 +252,12 @@ private:
 
     void UpdateText(const OPFParser &p);
 
+    /**
+     * Returns the parsed package model for the current text.
+     * The model is only rebuilt when the text revision changes.
+     */
+    OPFParser GetParsedOPF() const;
+
     /**
      * Initializes m_Mimetypes.
      */
@@ -266,6 +273,17 @@ private:
      */
     QHash<QString, QString> m_Mimetypes;
 
+    /**
+     * The parsed package model matching m_ParsedOPFRevision
+     * of the text. Guarded by m_ParsedOPFMutex.
+     */
+    mutable OPFParser m_ParsedOPF;
+
+    mutable bool m_ParsedOPFValid;
+
+    mutable int m_ParsedOPFRevision;
+
+    mutable QMutex m_ParsedOPFMutex;
 };
 
 #endif // OPFRESOURCE_H
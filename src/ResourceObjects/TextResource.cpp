@@ -28,35 +28,49 @@
 #include <QtGui/QTextDocument>
 
 #include "Misc/Utility.h"
+#include "PCRE/PCRECache.h"
 #include "ResourceObjects/TextResource.h"
 #include "sigil_exception.h"
 
 TextResource::TextResource(const QString &mainfolder, const QString &fullfilepath, QObject *parent)
     :
     Resource(mainfolder, fullfilepath, parent),
-    m_CacheInUse(false),
-    m_TextDocument(new QTextDocument(this)),
-    m_IsLoaded(false)
+    m_TextDocumentIsNewer(false),
+    m_DelayedUpdatePending(false),
+    m_TextDocument(NULL),
+    m_IsLoaded(false),
+    m_TextRevision(0),
+    m_SavedRevision(-1),
+    m_UpdatingTextDocument(false),
+    m_MatchIndexRevision(-1)
 {
-    m_TextDocument->setDocumentLayout(new QPlainTextDocumentLayout(m_TextDocument));
-    connect(m_TextDocument, SIGNAL(contentsChanged()), this, SIGNAL(Modified()));
 }
 
 
 QString TextResource::GetText() const
 {
-    QMutexLocker locker(&m_CacheAccessMutex);
+    QMutexLocker locker(&m_TextAccessMutex);
 
-    if (m_CacheInUse) {
-        return m_Cache;
+    // Pick up the edits made in an open tab since we last looked.
+    if (m_TextDocumentIsNewer) {
+        m_Text = m_TextDocument->toPlainText();
+        m_TextDocumentIsNewer = false;
     }
 
-    return m_TextDocument->toPlainText();
+    return m_Text;
 }
 
 
 void TextResource::SetText(const QString &text)
 {
+    {
+        QMutexLocker locker(&m_TextAccessMutex);
+        m_Text = text;
+        m_TextDocumentIsNewer = false;
+        m_IsLoaded = true;
+        m_TextRevision.ref();
+    }
+
     //   We need to delay updating the QTextDocument if SetText has
     // been called from something other than the main GUI thread. Why?
     // Because a CodeView is probably connected to the text document,
@@ -64,51 +78,72 @@ void TextResource::SetText(const QString &text)
     // CodeView base class to update as well and that will crash us since
     // the base class derives from QWidget (and those can only be updated
     // in the GUI thread).
-    //   So we cache the text update into m_Cache and update the QTextDocument
-    // when we return to the GUI thread. The single-shot timer makes sure
-    // of that.
+    //   So the text is stored right away and the QTextDocument (if any)
+    // is updated when we return to the GUI thread. The single-shot timer
+    // makes sure of that.
     if (QThread::currentThread() == QApplication::instance()->thread()) {
-        SetTextInternal(text);
+        UpdateTextDocument();
     } else {
-        QMutexLocker locker(&m_CacheAccessMutex);
-        m_Cache = text;
-
-        // We want to make sure we schedule only one delayed update
-        if (!m_CacheInUse) {
-            m_CacheInUse = true;
-            QTimer::singleShot(0, this, SLOT(DelayedUpdateToTextDocument()));
-        }
+        ScheduleDelayedUpdate();
     }
 }
 
 
 QTextDocument &TextResource::GetTextDocumentForWriting()
 {
-    Q_ASSERT(m_TextDocument);
+    if (!m_TextDocument) {
+        QTextDocument *document = new QTextDocument(this);
+        document->setDocumentLayout(new QPlainTextDocumentLayout(document));
+        m_UpdatingTextDocument = true;
+        document->setPlainText(GetText());
+        m_UpdatingTextDocument = false;
+        document->setModified(false);
+        connect(document, SIGNAL(contentsChanged()), this, SLOT(TextDocumentContentsChanged()));
+        QMutexLocker locker(&m_TextAccessMutex);
+        m_TextDocument = document;
+    }
+
     return *m_TextDocument;
 }
 
 
+void TextResource::ReleaseTextDocument()
+{
+    if (!m_TextDocument) {
+        return;
+    }
+
+    QMutexLocker locker(&m_TextAccessMutex);
+
+    if (m_TextDocumentIsNewer) {
+        m_Text = m_TextDocument->toPlainText();
+        m_TextDocumentIsNewer = false;
+    }
+
+    delete m_TextDocument;
+    m_TextDocument = NULL;
+}
+
+
 void TextResource::SaveToDisk(bool book_wide_save)
 {
     {
         QWriteLocker locker(&GetLock());
 
-        if (!m_CacheInUse && !m_IsLoaded) {
+        if (!m_IsLoaded) {
             return;
         }
 
-        // We can't perform the document modified check
-        // here because that causes problems with epub export
-        // when the user has not changed the text file.
-        // (some text files have placeholder text on disk)
+        // We can't use the document modified check here because most
+        // resources have no document, and some text files have
+        // placeholder text on disk that was replaced with SetText().
+        // The text revision covers both, so only text that changed
+        // since it was last written goes to disk.
+        int revision = GetTextRevision();
 
-        // But we always want to save the most up to date version
-
-        if (m_CacheInUse) {
-            Utility::WriteUnicodeTextFile(m_Cache, GetFullPath());
-        } else {
+        if (revision != m_SavedRevision || !QFile::exists(GetFullPath())) {
             Utility::WriteUnicodeTextFile(GetText(), GetFullPath());
+            m_SavedRevision = revision;
         }
     }
 
@@ -116,7 +151,10 @@ void TextResource::SaveToDisk(bool book_wide_save)
         emit ResourceUpdatedOnDisk();
     }
 
-    m_TextDocument->setModified(false);
+    if (m_TextDocument && (QThread::currentThread() == QApplication::instance()->thread())) {
+        m_TextDocument->setModified(false);
+    }
+
     Resource::SaveToDisk(book_wide_save);
 }
 
@@ -144,9 +182,8 @@ void TextResource::InitialLoad()
       * it had been opened in a tab first.
       */
     QWriteLocker locker(&GetLock());
-    Q_ASSERT(m_TextDocument);
 
-    if (m_TextDocument->toPlainText().isEmpty() && QFile::exists(GetFullPath())) {
+    if (GetText().isEmpty() && QFile::exists(GetFullPath())) {
         SetText(Utility::ReadUnicodeTextFile(GetFullPath()));
     }
 }
@@ -161,15 +198,14 @@ bool TextResource::LoadFromDisk()
 {
     try {
         const QString &text = Utility::ReadUnicodeTextFile(GetFullPath());
-        QMutexLocker locker(&m_CacheAccessMutex);
-        m_Cache = text;
-
-        // We want to make sure we schedule only one delayed update
-        if (!m_CacheInUse) {
-            m_CacheInUse = true;
-            QTimer::singleShot(0, this, SLOT(DelayedUpdateToTextDocument()));
+        {
+            QMutexLocker locker(&m_TextAccessMutex);
+            m_Text = text;
+            m_TextDocumentIsNewer = false;
+            m_IsLoaded = true;
+            m_TextRevision.ref();
         }
-
+        ScheduleDelayedUpdate();
         return true;
     } catch (CannotOpenFile) {
         // ?
@@ -179,30 +215,93 @@ bool TextResource::LoadFromDisk()
 }
 
 
+void TextResource::ScheduleDelayedUpdate()
+{
+    QMutexLocker locker(&m_TextAccessMutex);
+
+    // We want to make sure we schedule only one delayed update
+    if (!m_DelayedUpdatePending) {
+        m_DelayedUpdatePending = true;
+        QTimer::singleShot(0, this, SLOT(DelayedUpdateToTextDocument()));
+    }
+}
+
+
 void TextResource::DelayedUpdateToTextDocument()
 {
-    QMutexLocker locker(&m_CacheAccessMutex);
+    {
+        QMutexLocker locker(&m_TextAccessMutex);
 
-    if (!m_CacheInUse) {
-        return;
+        if (!m_DelayedUpdatePending) {
+            return;
+        }
+
+        m_DelayedUpdatePending = false;
+    }
+
+    UpdateTextDocument();
+}
+
+
+void TextResource::TextDocumentContentsChanged()
+{
+    if (!m_UpdatingTextDocument) {
+        QMutexLocker locker(&m_TextAccessMutex);
+        m_TextDocumentIsNewer = true;
+        m_TextRevision.ref();
     }
 
-    SetTextInternal(m_Cache);
+    emit Modified();
 }
 
 
-void TextResource::SetTextInternal(const QString &text)
+void TextResource::UpdateTextDocument()
 {
-    m_TextDocument->setPlainText(text);
+    if (!m_TextDocument) {
+        // Nobody is looking at a document, just tell them the text changed.
+        emit Modified();
+        return;
+    }
+
+    // Emits Modified() through TextDocumentContentsChanged().
+    m_UpdatingTextDocument = true;
+    m_TextDocument->setPlainText(GetText());
+    m_UpdatingTextDocument = false;
     m_TextDocument->setModified(false);
-    // Clear anything left in the cache
-    m_Cache = "";
-    m_CacheInUse = false;
-    // Our resource has now been loaded with some text
-    m_IsLoaded = true;
 }
 
 bool TextResource::IsLoaded()
 {
     return m_IsLoaded;
 }
+
+int TextResource::GetTextRevision() const
+{
+    return m_TextRevision.load();
+}
+
+bool TextResource::IsSavedToDisk() const
+{
+    return m_TextRevision.load() == m_SavedRevision;
+}
+
+QList<SPCRE::MatchInfo> TextResource::GetMatchIndex(const QString &search_regex) const
+{
+    {
+        QMutexLocker locker(&m_MatchIndexMutex);
+
+        if (m_MatchIndexRevision == GetTextRevision() && m_MatchIndexRegex == search_regex) {
+            return m_MatchIndex;
+        }
+    }
+
+    // Read the revision before the text so that a concurrent change
+    // leaves us with an outdated revision rather than an outdated index.
+    int revision = GetTextRevision();
+    QList<SPCRE::MatchInfo> match_index = PCRECache::instance()->getObject(search_regex)->getEveryMatchInfo(GetText());
+    QMutexLocker locker(&m_MatchIndexMutex);
+    m_MatchIndexRegex = search_regex;
+    m_MatchIndexRevision = revision;
+    m_MatchIndex = match_index;
+    return match_index;
+}
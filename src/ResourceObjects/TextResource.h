@@ -23,8 +23,10 @@
 #ifndef TEXTRESOURCE_H
 #define TEXTRESOURCE_H
 
+#include <QtCore/QAtomicInt>
 #include <QtCore/QMutex>
 
+#include "PCRE/SPCRE.h"
 #include "ResourceObjects/Resource.h"
 
 class QTextDocument;
@@ -62,7 +64,9 @@ public:
 
     /**
      * Returns a reference to the QTextDocument that can be read and written to
-     * in consumers. If you need just read access, use GetTextDocumentForReading().
+     * in consumers. The document is only created the first time this is
+     * called (i.e. when a tab is opened for the resource), resources that are
+     * never shown just keep their text in a plain string.
      *
      * @warning Make sure to get a write lock externally before calling this function!
      *
@@ -70,6 +74,12 @@ public:
      */
     QTextDocument &GetTextDocumentForWriting();
 
+    /**
+     * Drops the QTextDocument once no tab is showing it anymore.
+     * The text it holds is kept in the resource.
+     */
+    void ReleaseTextDocument();
+
     // inherited
     void SaveToDisk(bool book_wide_save = false);
 
@@ -82,6 +92,36 @@ public:
 
     bool IsLoaded();
 
+    /**
+     * Returns a counter that changes every time the text of the
+     * resource changes, no matter if it was changed through SetText(),
+     * a reload from disk or by editing the QTextDocument directly.
+     * Consumers can use it to know when cached data derived from
+     * the text has gone stale.
+     *
+     * @return The current text revision.
+     */
+    int GetTextRevision() const;
+
+    /**
+     * Returns whether the file on disk holds the current text,
+     * i.e. the text has not changed since SaveToDisk() last wrote it.
+     *
+     * @return \c true if there is nothing to save.
+     */
+    bool IsSavedToDisk() const;
+
+    /**
+     * Returns the offsets of every match of the regex in the text.
+     * The index for the last regex asked for is kept until the text
+     * changes, so counting, stepping through the files and replacing
+     * with the same regex only runs it once per file.
+     *
+     * @param search_regex The regex to match with.
+     * @return The matches, in text order.
+     */
+    QList<SPCRE::MatchInfo> GetMatchIndex(const QString &search_regex) const;
+
     // inherited
     virtual ResourceType Type() const;
 
@@ -92,18 +132,29 @@ private slots:
 
     /**
      * Performs the delayed update of m_TextDocument with the text
-     * stored in m_Cache.
+     * stored in m_Text.
      */
     void DelayedUpdateToTextDocument();
 
+    /**
+     * Marks the QTextDocument as newer than m_Text and bumps the text
+     * revision when the document is edited directly (i.e. from an open tab).
+     */
+    void TextDocumentContentsChanged();
+
 private:
 
     /**
-     * Actually sets the text to m_TextDocument.
-     *
-     * @param text The text to set.
+     * Schedules a DelayedUpdateToTextDocument() on the GUI thread
+     * unless one is already pending.
      */
-    void SetTextInternal(const QString &text);
+    void ScheduleDelayedUpdate();
+
+    /**
+     * Pushes m_Text into m_TextDocument if there is one.
+     * Must be called from the GUI thread.
+     */
+    void UpdateTextDocument();
 
 
     ///////////////////////////////
@@ -111,26 +162,57 @@ private:
     ///////////////////////////////
 
     /**
-     * If \c true, then the m_Cache var is holding cached text.
+     * The text of the resource. When a tab has m_TextDocument
+     * open the document may be newer, @see m_TextDocumentIsNewer.
      */
-    bool m_CacheInUse;
+    mutable QString m_Text;
 
     /**
-     * The cached text used when threads are in use. @see SetText() internals.
+     * If \c true, m_TextDocument has been edited since m_Text was last synced.
      */
-    QString m_Cache;
+    mutable bool m_TextDocumentIsNewer;
 
     /**
-     * The access mutex for the cache.
+     * If \c true, a DelayedUpdateToTextDocument() call is queued.
      */
-    mutable QMutex m_CacheAccessMutex;
+    bool m_DelayedUpdatePending;
+
+    /**
+     * The access mutex for the text.
+     */
+    mutable QMutex m_TextAccessMutex;
 
     /**
      * The syntax colored cache of the TextResource text content.
+     * Only exists while a tab is showing the resource.
      */
     QTextDocument *m_TextDocument;
 
     bool m_IsLoaded;
+
+    /**
+     * The revision of the text. @see GetTextRevision().
+     */
+    QAtomicInt m_TextRevision;
+
+    /**
+     * The text revision SaveToDisk() last wrote to disk.
+     */
+    int m_SavedRevision;
+
+    /**
+     * Set while we push text into m_TextDocument ourselves
+     * so that the revision is not bumped a second time.
+     */
+    bool m_UpdatingTextDocument;
+
+    /**
+     * The cached match index. @see GetMatchIndex().
+     */
+    mutable QString m_MatchIndexRegex;
+    mutable int m_MatchIndexRevision;
+    mutable QList<SPCRE::MatchInfo> m_MatchIndex;
+    mutable QMutex m_MatchIndexMutex;
 };
 
 #endif // TEXTRESOURCE_H
@@ -387,6 +387,7 @@ class Options(ctypes.Structure):
         ('use_xhtml_rules', ctypes.c_bool),
         ('stop_on_first_error', ctypes.c_bool),
         ('max_errors', ctypes.c_int),
+        ('arena', ctypes.c_void_p),
         ]
 
 
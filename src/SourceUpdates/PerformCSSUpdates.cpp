@@ -20,12 +20,16 @@
 *************************************************************************/
 
 #include <QtCore/QFileInfo>
+#include <QtCore/QHashIterator>
 #include <QtCore/QString>
 #include <QRegularExpression>
 #include <QRegularExpressionMatch>
 
 #include "SourceUpdates/PerformCSSUpdates.h"
 
+static const QString CSS_REFERENCE_SEARCH = "url\\(\\s*[\"']?([^\"'\\)]+)"
+                                            "|(?:@import|src\\s*:|background(?:-image)?\\s*:)\\s*[\"']([^\"']+)[\"']";
+
 PerformCSSUpdates::PerformCSSUpdates(const QString &source, const QHash<QString, QString> &css_updates)
     :
     m_Source(source),
@@ -36,41 +40,77 @@ PerformCSSUpdates::PerformCSSUpdates(const QString &source, const QHash<QString,
 
 QString PerformCSSUpdates::operator()()
 {
-    const QList<QString> &keys = m_CSSUpdates.keys();
-    int num_keys = keys.count();
-
-    for (int i = 0; i < num_keys; ++i) {
-        const QString &key_path = keys.at(i);
-        const QString &filename = QFileInfo(key_path).fileName();
-        QString filename_regex_part =
-            "[^\\(\\)\"']*/"
-            + QRegularExpression::escape(filename) + "|"
-            + QRegularExpression::escape(filename);
-        QRegularExpression reference(
-            "(?:(?:src|background|background-image)\\s*:|@import)\\s*"
-            "[^;\\}\\(\"']*"
-            "(?:"
-            "url\\([\"']?(" + filename_regex_part + ")[\"']?\\)"
-            "|"
-            "[\"'](" + filename_regex_part + ")[\"']"
-            ")"
-            "[^;\\}]*"
-            "(?:;|\\})");
-        int start_index = 0;
-        QRegularExpressionMatch mo = reference.match(m_Source, start_index);
-        do {
-            for (int i = 1; i < reference.captureCount(); ++i) {
-                if (mo.captured(i).trimmed().isEmpty()) {
-                    continue;
-                }
-
-                m_Source.replace(mo.capturedStart(i), mo.capturedLength(i), m_CSSUpdates.value(key_path));
-            }
-
-            start_index += mo.capturedLength();
-            mo = reference.match(m_Source, start_index);
-        } while (mo.hasMatch());
+    if (m_CSSUpdates.isEmpty()) {
+        return m_Source;
+    }
+
+    // References can reach the same file through different
+    // relative paths so the updates are looked up by file name.
+    QHash<QString, QString> updates_by_filename;
+    QHashIterator<QString, QString> update(m_CSSUpdates);
+
+    while (update.hasNext()) {
+        update.next();
+        updates_by_filename.insert(QFileInfo(update.key()).fileName(), update.value());
+    }
+
+    QString new_source;
+    int copied_up_to = 0;
+    QRegularExpression reference_search(CSS_REFERENCE_SEARCH);
+    QRegularExpressionMatchIterator it = reference_search.globalMatch(m_Source);
+
+    while (it.hasNext()) {
+        QRegularExpressionMatch mo = it.next();
+        int group = mo.capturedStart(1) != -1 ? 1 : 2;
+        int start = mo.capturedStart(group);
+        int end = mo.capturedEnd(group);
+
+        // An unquoted url( a.png ) leaves whitespace around the path
+        while (start < end && m_Source.at(start).isSpace()) {
+            start++;
+        }
+
+        while (end > start && m_Source.at(end - 1).isSpace()) {
+            end--;
+        }
+
+        const QString path = m_Source.mid(start, end - start);
+        const QString filename = path.mid(path.lastIndexOf(QChar('/')) + 1);
+        QHash<QString, QString>::const_iterator new_path = updates_by_filename.constFind(filename);
+
+        if (new_path == updates_by_filename.constEnd()) {
+            continue;
+        }
+
+        if (new_source.isNull()) {
+            new_source.reserve(m_Source.length() + m_Source.length() / 16);
+        }
+
+        new_source.append(m_Source.midRef(copied_up_to, start - copied_up_to));
+        new_source.append(new_path.value());
+        copied_up_to = end;
+    }
+
+    if (new_source.isNull()) {
+        return m_Source;
+    }
+
+    new_source.append(m_Source.midRef(copied_up_to));
+    return new_source;
+}
+
+
+QStringList PerformCSSUpdates::GetReferences(const QString &source)
+{
+    QStringList references;
+    QRegularExpression reference_search(CSS_REFERENCE_SEARCH);
+    QRegularExpressionMatchIterator it = reference_search.globalMatch(source);
+
+    while (it.hasNext()) {
+        QRegularExpressionMatch mo = it.next();
+        QString reference = mo.captured(1).isEmpty() ? mo.captured(2) : mo.captured(1);
+        references.append(reference.trimmed());
     }
 
-    return m_Source;
+    return references;
 }
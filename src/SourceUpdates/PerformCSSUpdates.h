@@ -24,6 +24,7 @@
 #define PERFORMCSSUPDATES_H
 
 #include <QtCore/QHash>
+#include <QtCore/QStringList>
 
 class QString;
 
@@ -34,8 +35,22 @@ public:
 
     PerformCSSUpdates(const QString &source, const QHash<QString, QString> &css_updates);
 
+    /**
+     * Rewrites the references to updated files in one forward pass.
+     * References are matched on file name, so they are updated
+     * whatever relative path they use. Works on stylesheets as well
+     * as on HTML with <style> blocks and style attributes.
+     */
     QString operator()();
 
+    /**
+     * Returns every reference to another file (url(), @import and quoted
+     * src/background values) in the CSS of source, as written. These are
+     * the references operator()() rewrites, so a source with no
+     * reference to a file never needs updating for it.
+     */
+    static QStringList GetReferences(const QString &source);
+
 private:
 
     ///////////////////////////////
@@ -199,7 +199,7 @@ QString UniversalUpdates::LoadAndUpdateOneHTMLFile(HTMLResource *html_resource,
         const QHash<QString, QString> &css_updates,
         const QList<XMLResource *> &non_well_formed)
 {
-    SettingsStore ss;
+    bool clean_on_open = SettingsStore::snapshot().clean_on & CLEANON_OPEN;
     QString source;
 
     if (!html_resource) {
@@ -216,9 +216,20 @@ QString UniversalUpdates::LoadAndUpdateOneHTMLFile(HTMLResource *html_resource,
 
     try {
         source = XhtmlDoc::ResolveCustomEntities(html_resource->GetText());
+
+        // Well-formed files, by far the common case, are checked, updated and
+        // cleaned using a single parse.
+        QString loaded = CleanSource::CleanAndUpdateOnLoad(source, html_updates, css_updates,
+                                                           currentpath, clean_on_open);
+        if (!loaded.isEmpty()) {
+            html_resource->SetCurrentBookRelPath("");
+            html_resource->SetText(loaded);
+            return QString();
+        }
+
         source = CleanSource::CharToEntity(source);
 
-        if (ss.cleanOn() & CLEANON_OPEN) {
+        if (clean_on_open) {
             source = CleanSource::Clean(source);
         }
         // Even though well formed checks might have already run we need to double check because cleaning might
@@ -231,7 +242,7 @@ QString UniversalUpdates::LoadAndUpdateOneHTMLFile(HTMLResource *html_resource,
         html_resource->SetCurrentBookRelPath("");
         // For files that are valid we need to do a second clean becasue PerformHTMLUpdates) will remove
         // the formatting.
-        if (ss.cleanOn() & CLEANON_OPEN) {
+        if (clean_on_open) {
             source = CleanSource::Clean(source);
         }
         html_resource->SetText(source);
@@ -256,7 +267,9 @@ void UniversalUpdates::LoadAndUpdateOneCSSFile(CSSResource *css_resource,
         return;
     }
 
-    const QString &source = Utility::ReadUnicodeTextFile(css_resource->GetFullPath());
+    // The EPUB importer has usually decoded the text already.
+    const QString &source = css_resource->IsLoaded() ? css_resource->GetText()
+                                                     : Utility::ReadUnicodeTextFile(css_resource->GetFullPath());
     css_resource->SetText(PerformCSSUpdates(source, css_updates)());
     css_resource->SaveToDisk();
 }
@@ -124,6 +124,9 @@ FlowTab::~FlowTab()
         m_wCodeView = 0;
     }
 
+    // Nothing is showing the resource's QTextDocument anymore.
+    m_HTMLResource->ReleaseTextDocument();
+
     if (m_views) {
         delete(m_views);
         m_views = 0;
@@ -387,7 +390,10 @@ void FlowTab::SaveTabContent()
     }
 
     // Either from being in CV or saving from BV above we now reset the resource to say no user changes unsaved.
-    m_HTMLResource->GetTextDocumentForWriting().setModified(false);
+    // Only Code View has a QTextDocument, don't create one just to reset it.
+    if (m_wCodeView) {
+        m_wCodeView->document()->setModified(false);
+    }
 }
 
 void FlowTab::ResourceModified()
@@ -55,6 +55,9 @@ TextTab::~TextTab()
         delete m_wCodeView;
         m_wCodeView = 0;
     }
+
+    // Nothing is showing the resource's QTextDocument anymore.
+    m_TextResource->ReleaseTextDocument();
 }
 
 
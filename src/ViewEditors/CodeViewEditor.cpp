@@ -1878,6 +1878,16 @@ void CodeViewEditor::UpdateLineNumberArea(const QRect &area_to_update, int verti
 }
 
 
+void CodeViewEditor::UpdateSpellingViewport()
+{
+    XHTMLHighlighter *highlighter = qobject_cast<XHTMLHighlighter *>(m_Highlighter);
+
+    if (highlighter) {
+        highlighter->SetFirstVisibleBlock(firstVisibleBlock().blockNumber());
+    }
+}
+
+
 void CodeViewEditor::HighlightCurrentLine()
 {
     QList<QTextEdit::ExtraSelection> extraSelections;
@@ -3540,6 +3550,7 @@ void CodeViewEditor::ConnectSignalsToSlots()
 {
     connect(this, SIGNAL(blockCountChanged(int)), this, SLOT(UpdateLineNumberAreaMargin()));
     connect(this, SIGNAL(updateRequest(const QRect &, int)), this, SLOT(UpdateLineNumberArea(const QRect &, int)));
+    connect(this, SIGNAL(updateRequest(const QRect &, int)), this, SLOT(UpdateSpellingViewport()));
     connect(this, SIGNAL(cursorPositionChanged()), this, SLOT(HighlightCurrentLine()));
     connect(this, SIGNAL(cursorPositionChanged()), this, SLOT(EmitFilteredCursorMoved()));
     connect(this, SIGNAL(textChanged()), this, SIGNAL(PageUpdated()));
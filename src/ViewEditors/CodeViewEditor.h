@@ -493,6 +493,11 @@ private slots:
      */
     void UpdateLineNumberArea(const QRect &rectangle, int vertical_delta);
 
+    /**
+     * Lets the highlighter spell check the visible lines first.
+     */
+    void UpdateSpellingViewport();
+
     /**
      * Highlights the line the user is editing.
      */